@@ -0,0 +1,464 @@
+/************************************************************************************/
+/* An OpenCV/Qt based realtime application to magnify motion and color              */
+/* Copyright (C) 2015  Jens Schindel <kontakt@jens-schindel.de>                     */
+/*                                                                                  */
+/* Based on the work of                                                             */
+/*      Joseph Pan      <https://github.com/wzpan/QtEVM>                            */
+/*      Nick D'Ademo    <https://github.com/nickdademo/qt-opencv-multithreaded>     */
+/*                                                                                  */
+/* Realtime-Video-Magnification->bench.cpp                                          */
+/*                                                                                  */
+/* This program is free software: you can redistribute it and/or modify             */
+/* it under the terms of the GNU General Public License as published by             */
+/* the Free Software Foundation, either version 3 of the License, or                */
+/* (at your option) any later version.                                              */
+/*                                                                                  */
+/* This program is distributed in the hope that it will be useful,                  */
+/* but WITHOUT ANY WARRANTY; without even the implied warranty of                   */
+/* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                    */
+/* GNU General Public License for more details.                                     */
+/*                                                                                  */
+/* You should have received a copy of the GNU General Public License                */
+/* along with this program.  If not, see <http://www.gnu.org/licenses/>.            */
+/************************************************************************************/
+
+// Qt
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QStringList>
+#include <QTextStream>
+// OpenCV
+#include <opencv2/core.hpp>
+#include <opencv2/imgproc.hpp>
+#include <opencv2/videoio.hpp>
+// C++
+#ifdef Q_OS_WIN
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+// Local
+#include "main/helper/AllocationCounter.h"
+#include "main/helper/MagnificationExecutor.h"
+#include "main/helper/Profiler.h"
+#include "main/magnification/Magnificator.h"
+#include "main/other/Config.h"
+#include "main/other/Structures.h"
+
+// Benchmark of the magnification. Feeds a synthetic clip and optionally
+// recorded clips at standard ROI sizes through colorMagnify(), laplaceMagnify()
+// and rieszMagnify(), driven like the export of a VideoView, and reports
+// per-stage ns/pixel, frames/s, allocations/frame and peak RSS as JSON. The
+// peak RSS of a run starts from the memory the process held before it, so it
+// is reported per run only where the peak can be reset (Linux).
+// With --check-allocations it fails if the Laplace or Riesz magnification
+// allocates Mat buffers once warmed up.
+// The synthetic clip is generated from a fixed seed, so runs of different
+// commits on the same machine can be compared.
+
+// Peak resident set size of the process in KiB, -1 if unknown. On Linux it is
+// the peak since the last resetPeakRss().
+static long long peakRssKiB()
+{
+#ifdef Q_OS_LINUX
+    // "VmHWM:    1234 kB"
+    QFile status("/proc/self/status");
+    if(status.open(QIODevice::ReadOnly)) {
+        const QList<QByteArray> lines = status.readAll().split('\n');
+        for(int i = 0; i < lines.size(); i++)
+            if(lines.at(i).startsWith("VmHWM:"))
+                return lines.at(i).mid(6).trimmed().split(' ').first().toLongLong();
+    }
+#endif
+#ifdef Q_OS_WIN
+    PROCESS_MEMORY_COUNTERS counters;
+    if(GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+        return counters.PeakWorkingSetSize / 1024;
+#else
+    struct rusage usage;
+    if(getrusage(RUSAGE_SELF, &usage) == 0)
+#ifdef Q_OS_MAC
+        // Bytes on macOS
+        return usage.ru_maxrss / 1024;
+#else
+        return usage.ru_maxrss;
+#endif
+#endif
+    return -1;
+}
+
+// Lowers the peak resident set size to the current one, false if the system
+// can't. Only Linux can (since 4.0), elsewhere the peak is the process-wide one.
+static bool resetPeakRss()
+{
+#ifdef Q_OS_LINUX
+    QFile clearRefs("/proc/self/clear_refs");
+    return clearRefs.open(QIODevice::WriteOnly | QIODevice::Unbuffered) && clearRefs.write("5") == 1;
+#else
+    return false;
+#endif
+}
+
+static int fail(const QString &message)
+{
+    QTextStream(stderr) << "rvm-bench: " << message << "\n";
+    return 1;
+}
+
+// Frames of 1 benchmark run, either synthetic or cropped from a recorded clip
+class ClipSource
+{
+public:
+    ClipSource(const QString &clip, Size size) :
+        framerate(DEFAULT_EXECUTOR_FRAMERATE), clip(clip), size(size), index(0)
+    {
+        if(clip.isEmpty()) {
+            // Smooth noise moving 1.5 pixels and pulsing 2 gray values at 1 Hz,
+            // near the default passbands of the magnifications
+            texture.create(size.height + 8, size.width + 8, CV_8UC3);
+            RNG rng(BENCH_SEED);
+            rng.fill(texture, RNG::UNIFORM, 0, 256);
+            GaussianBlur(texture, texture, Size(0, 0), 2.0);
+        }
+        else if(cap.open(clip.toStdString()) && cap.get(cv::CAP_PROP_FPS) > 0) {
+            framerate = cap.get(cv::CAP_PROP_FPS);
+        }
+    }
+
+    // False if the clip can't be read or is smaller than the ROI
+    bool next(Mat &frame)
+    {
+        if(clip.isEmpty()) {
+            const double phase = 2.0*M_PI*index/framerate;
+            const double shift = 4.0 + 1.5*std::sin(phase);
+            Mat transform = (Mat_<double>(2, 3) << 1, 0, -shift, 0, 1, -shift);
+            warpAffine(texture, frame, transform, size, INTER_LINEAR, BORDER_REFLECT);
+            frame.convertTo(frame, -1, 1.0, 2.0*std::sin(phase));
+        }
+        else {
+            // Loop the clip
+            if(!cap.read(grabbed)) {
+                cap.set(cv::CAP_PROP_POS_FRAMES, 0);
+                if(!cap.read(grabbed))
+                    return false;
+            }
+            if(grabbed.cols < size.width || grabbed.rows < size.height)
+                return false;
+            // ROI in the center of the clip
+            Rect roi((grabbed.cols - size.width)/2, (grabbed.rows - size.height)/2, size.width, size.height);
+            grabbed(roi).copyTo(frame);
+        }
+        index++;
+        return true;
+    }
+
+    double framerate;
+
+private:
+    QString clip;
+    Size size;
+    int index;
+    Mat texture;
+    VideoCapture cap;
+    Mat grabbed;
+};
+
+struct BenchSize {
+    const char *name;
+    int width;
+    int height;
+};
+
+static const BenchSize BENCH_SIZES[] = {
+    { "vga", 640, 480 },
+    { "720p", 1280, 720 },
+    { "1080p", 1920, 1080 },
+    { "4k", 3840, 2160 }
+};
+
+// Default magnification of mode, converted like MagnifyOptions
+static bool modeSettings(const QString &mode, bool grayscale, ImageProcessingFlags &flags,
+                         ImageProcessingSettings &settings)
+{
+    flags = ImageProcessingFlags();
+    flags.grayscaleOn = grayscale;
+    if(mode == "color") {
+        flags.colorMagnifyOn = true;
+        settings.amplification = DEFAULT_CM_AMPLIFICATION;
+        settings.coWavelength = DEFAULT_CM_COWAVELENGTH*10.0;
+        settings.coLow = DEFAULT_CM_COLOW;
+        settings.coHigh = DEFAULT_CM_COHIGH;
+        settings.chromAttenuation = DEFAULT_CM_CHROMATTENUATION/100.0;
+    }
+    else if(mode == "laplace") {
+        flags.laplaceMagnifyOn = true;
+        settings.amplification = DEFAULT_MM_AMPLIFICATION;
+        settings.coWavelength = DEFAULT_MM_COWAVELENGTH*10.0;
+        settings.coLow = DEFAULT_MM_COLOW/100.0;
+        settings.coHigh = DEFAULT_MM_COHIGH/100.0;
+        settings.chromAttenuation = DEFAULT_MM_CHROMATTENUATION/100.0;
+    }
+    else if(mode == "riesz") {
+        flags.rieszMagnifyOn = true;
+        settings.amplification = DEFAULT_PB_AMPLIFICATION;
+        settings.coWavelength = DEFAULT_PB_COWAVELENGTH;
+        settings.coLow = DEFAULT_PB_COLOW;
+        settings.coHigh = DEFAULT_PB_COHIGH;
+        settings.chromAttenuation = 0;
+    }
+    else
+        return false;
+    return true;
+}
+
+// Magnifies warmup+frames frames like SavingThread and measures the last frames.
+// Returns an empty object if the clip doesn't provide enough frames.
+static QJsonObject runBenchmark(const QString &mode, const QString &clip, const BenchSize &benchSize,
+                                int levels, int warmup, int frames, bool grayscale, double filterTolerance,
+                                MagnificationExecutor &executor, int stream)
+{
+    const Size size(benchSize.width, benchSize.height);
+    ClipSource source(clip, size);
+    ImageProcessingFlags flags;
+    ImageProcessingSettings settings;
+    modeSettings(mode, grayscale, flags, settings);
+    settings.levels = std::min(levels, Magnificator().calculateMaxLevels(size));
+    settings.rieszFilterTolerance = filterTolerance;
+    settings.framerate = source.framerate;
+    settings.frameWidth = size.width;
+    settings.frameHeight = size.height;
+
+    std::vector<Mat> buffer;
+    Magnificator magnificator(&buffer, &flags, &settings);
+    Profiler profiler;
+    magnificator.setProfiler(&profiler);
+    size_t bufferLength = flags.colorMagnifyOn ? magnificator.getOptimalBufferSize(settings.framerate) : 2;
+
+    Mat frame;
+    QElapsedTimer timer;
+    qint64 nsecs = 0;
+    long long frameAllocations = 0;
+    long long frameBytes = 0;
+    long long magnifyMatAllocations = 0;
+    int inputFrames = 0;
+    for(int n = 0; n < warmup + frames; n++) {
+        if(n == warmup)
+            profiler.reset();
+        if(flags.colorMagnifyOn && bufferLength > 2 && n == 1)
+            bufferLength = 2;
+
+        // Reading and the grayscale conversion aren't measured
+        int read = 0;
+        while(buffer.size() < bufferLength) {
+            if(!source.next(frame))
+                return QJsonObject();
+            if(flags.grayscaleOn)
+                cvtColor(frame, frame, cv::COLOR_BGR2GRAY, 1);
+            buffer.push_back(frame.clone());
+            read++;
+        }
+
+        const long long allocationsBefore = allocationCount();
+        const long long bytesBefore = allocatedBytes();
+        const long long matAllocationsBefore = matAllocationCount();
+        timer.start();
+        executor.run(stream, [&]() {
+            if(flags.colorMagnifyOn)
+                magnificator.colorMagnify();
+            else if(flags.laplaceMagnifyOn)
+                magnificator.laplaceMagnify();
+            else
+                magnificator.rieszMagnify();
+        });
+        // Mat buffers of the magnification itself, the handed over frame is the consumer's
+        const long long magnifyMats = matAllocationCount() - matAllocationsBefore;
+        magnificator.getFrameFirst();
+        const qint64 elapsed = timer.nsecsElapsed();
+
+        if(n >= warmup) {
+            nsecs += elapsed;
+            frameAllocations += allocationCount() - allocationsBefore;
+            frameBytes += allocatedBytes() - bytesBefore;
+            magnifyMatAllocations += magnifyMats;
+            inputFrames += read;
+        }
+    }
+
+    // Rates per magnified input frame
+    const double pixels = (double)inputFrames*size.area();
+    QJsonObject stages;
+    for(int i = 0; i < profiler.stages(); i++)
+        stages.insert(profiler.name(i), pixels > 0 ? profiler.stats(i).total/pixels : 0.0);
+
+    QJsonObject run;
+    run.insert("mode", mode);
+    run.insert("source", clip.isEmpty() ? QString("synthetic") : clip);
+    run.insert("size", benchSize.name);
+    run.insert("width", size.width);
+    run.insert("height", size.height);
+    run.insert("levels", settings.levels);
+    run.insert("grayscale", grayscale);
+    if(flags.rieszMagnifyOn)
+        run.insert("filterTolerance", filterTolerance);
+    run.insert("frames", inputFrames);
+    run.insert("framesPerSecond", nsecs > 0 ? inputFrames*1e9/nsecs : 0.0);
+    run.insert("nsPerPixel", pixels > 0 ? nsecs/pixels : 0.0);
+    run.insert("stagesNsPerPixel", stages);
+    run.insert("allocationsPerFrame", inputFrames > 0 ? (double)frameAllocations/inputFrames : 0.0);
+    run.insert("allocatedBytesPerFrame", inputFrames > 0 ? (double)frameBytes/inputFrames : 0.0);
+    run.insert("magnifyMatAllocationsPerFrame", inputFrames > 0 ? (double)magnifyMatAllocations/inputFrames : 0.0);
+    return run;
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+    QCoreApplication::setApplicationName("rvm-bench");
+    QCoreApplication::setApplicationVersion(APP_VERSION);
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Benchmarks the magnification and reports the results as JSON.");
+    parser.addHelpOption();
+    parser.addVersionOption();
+
+    QCommandLineOption modesOption("modes", "Magnifications to run: color, laplace, riesz.", "modes",
+                                   "color,laplace,riesz");
+    QCommandLineOption sizesOption("sizes", "ROI sizes to run: vga, 720p, 1080p, 4k.", "sizes",
+                                   "vga,720p,1080p,4k");
+    QCommandLineOption levelsOption(QStringList() << "l" << "levels",
+                                    "Pyramid levels to run, limited by the ROI size.", "levels", "4");
+    QCommandLineOption framesOption(QStringList() << "n" << "frames", "Measured frames per run.", "frames",
+                                    QString::number(BENCH_FRAMES));
+    QCommandLineOption warmupOption("warmup", "Frames magnified before measuring.", "frames",
+                                    QString::number(BENCH_WARMUP_FRAMES));
+    QCommandLineOption clipOption("clip", "Recorded clip to run in addition, the ROI is its center. "
+                                  "May be given several times.", "file");
+    QCommandLineOption noSyntheticOption("no-synthetic", "Run only the recorded clips.");
+    QCommandLineOption grayscaleOption(QStringList() << "g" << "grayscale", "Convert to grayscale before magnifying.");
+    QCommandLineOption filterToleranceOption("filter-tolerance", "Relative error of the separable Riesz pyramid "
+                                             "filters, 0 uses the exact 9x9 kernels.", "error",
+                                             QString::number(DEFAULT_RIESZ_FILTER_TOLERANCE));
+    QCommandLineOption coresOption("cores", "Cores used for magnification, default is all cores.", "cores",
+                                   QString::number(DEFAULT_MAGNIFICATION_CORES));
+    QCommandLineOption labelOption("label", "Label stored with the results, e.g. the commit.", "label");
+    QCommandLineOption checkAllocationsOption("check-allocations", "Fail if the Laplace or Riesz magnification "
+                                              "allocates Mat buffers after the warm-up.");
+    QCommandLineOption outputOption(QStringList() << "o" << "output", "JSON file to write, default is stdout.", "file");
+    parser.addOption(modesOption);
+    parser.addOption(sizesOption);
+    parser.addOption(levelsOption);
+    parser.addOption(framesOption);
+    parser.addOption(warmupOption);
+    parser.addOption(clipOption);
+    parser.addOption(noSyntheticOption);
+    parser.addOption(grayscaleOption);
+    parser.addOption(filterToleranceOption);
+    parser.addOption(coresOption);
+    parser.addOption(labelOption);
+    parser.addOption(checkAllocationsOption);
+    parser.addOption(outputOption);
+    parser.process(a);
+
+    bool ok;
+    const int frames = parser.value(framesOption).toInt(&ok);
+    if(!ok || frames < 1)
+        return fail("Frames have to be a positive number.");
+    const int warmup = parser.value(warmupOption).toInt(&ok);
+    if(!ok || warmup < 0)
+        return fail("Warm-up has to be a positive number.");
+    const QStringList modes = parser.value(modesOption).toLower().split(',');
+    ImageProcessingFlags flags;
+    ImageProcessingSettings settings;
+    for(int i = 0; i < modes.size(); i++)
+        if(!modeSettings(modes.at(i), false, flags, settings))
+            return fail("Unknown mode " + modes.at(i) + ".");
+    QList<BenchSize> sizes;
+    const QStringList sizeNames = parser.value(sizesOption).toLower().split(',');
+    for(int i = 0; i < sizeNames.size(); i++) {
+        int known = 0;
+        while(known < 4 && sizeNames.at(i) != BENCH_SIZES[known].name)
+            known++;
+        if(known == 4)
+            return fail("Unknown size " + sizeNames.at(i) + ".");
+        sizes.append(BENCH_SIZES[known]);
+    }
+    QList<int> levels;
+    const QStringList levelValues = parser.value(levelsOption).split(',');
+    for(int i = 0; i < levelValues.size(); i++) {
+        levels.append(levelValues.at(i).toInt(&ok));
+        if(!ok || levels.last() < 1)
+            return fail("Levels have to be positive numbers.");
+    }
+    const double filterTolerance = parser.value(filterToleranceOption).toDouble(&ok);
+    if(!ok || filterTolerance < 0)
+        return fail("Filter tolerance has to be a positive number.");
+    QStringList clips = parser.values(clipOption);
+    if(!parser.isSet(noSyntheticOption))
+        clips.prepend(QString());
+    if(clips.isEmpty())
+        return fail("Nothing to run without the synthetic clip and recorded clips.");
+
+    MagnificationExecutor executor(parser.value(coresOption).toInt());
+    const int stream = executor.addStream();
+    CountingMatAllocator allocator;
+    Mat::setDefaultAllocator(&allocator);
+
+    QJsonArray runs;
+    QStringList allocatingRuns;
+    // Peak of the whole process, the per-run peaks reset it
+    long long peakRss = -1;
+    for(int c = 0; c < clips.size(); c++)
+        for(int m = 0; m < modes.size(); m++)
+            for(int s = 0; s < sizes.size(); s++)
+                for(int l = 0; l < levels.size(); l++) {
+                    const QString source = clips.at(c).isEmpty() ? QString("synthetic") : clips.at(c);
+                    QTextStream(stderr) << source << " " << modes.at(m) << " " << sizes.at(s).name
+                                        << " " << levels.at(l) << " levels\n";
+                    peakRss = std::max(peakRss, peakRssKiB());
+                    const bool runPeakRss = resetPeakRss();
+                    QJsonObject run = runBenchmark(modes.at(m), clips.at(c), sizes.at(s), levels.at(l),
+                                                   warmup, frames, parser.isSet(grayscaleOption), filterTolerance,
+                                                   executor, stream);
+                    if(runPeakRss && !run.isEmpty())
+                        run.insert("peakRssKiB", (double)peakRssKiB());
+                    if(run.isEmpty())
+                        QTextStream(stderr) << "  skipped, clip unreadable or smaller than the ROI\n";
+                    else
+                        runs.append(run);
+                    // The color magnification keeps a new input image for every frame of its window
+                    if(!run.isEmpty() && modes.at(m) != "color" && run.value("magnifyMatAllocationsPerFrame").toDouble() > 0)
+                        allocatingRuns.append(source + " " + modes.at(m) + " " + sizes.at(s).name + " "
+                                              + QString::number(levels.at(l)) + " levels");
+                }
+    Mat::setDefaultAllocator(0);
+
+    QJsonObject results;
+    results.insert("benchmark", QString("rvm-bench"));
+    results.insert("version", QString(APP_VERSION));
+    results.insert("opencv", QString(CV_VERSION));
+    results.insert("label", parser.value(labelOption));
+    results.insert("cores", executor.cores());
+    results.insert("warmup", warmup);
+    results.insert("peakRssKiB", (double)std::max(peakRss, peakRssKiB()));
+    results.insert("runs", runs);
+    const QByteArray json = QJsonDocument(results).toJson();
+
+    if(parser.isSet(outputOption)) {
+        QFile file(parser.value(outputOption));
+        if(!file.open(QIODevice::WriteOnly) || file.write(json) != json.size())
+            return fail("Not able to write " + parser.value(outputOption) + ".");
+    }
+    else
+        QTextStream(stdout) << json;
+
+    if(parser.isSet(checkAllocationsOption) && !allocatingRuns.isEmpty())
+        return fail("Mat buffers allocated after the warm-up by " + allocatingRuns.join(", ") + ".");
+
+    return 0;
+}
@@ -0,0 +1,264 @@
+/************************************************************************************/
+/* An OpenCV/Qt based realtime application to magnify motion and color              */
+/* Copyright (C) 2015  Jens Schindel <kontakt@jens-schindel.de>                     */
+/*                                                                                  */
+/* Based on the work of                                                             */
+/*      Joseph Pan      <https://github.com/wzpan/QtEVM>                            */
+/*      Nick D'Ademo    <https://github.com/nickdademo/qt-opencv-multithreaded>     */
+/*                                                                                  */
+/* Realtime-Video-Magnification->cli.cpp                                            */
+/*                                                                                  */
+/* This program is free software: you can redistribute it and/or modify             */
+/* it under the terms of the GNU General Public License as published by             */
+/* the Free Software Foundation, either version 3 of the License, or                */
+/* (at your option) any later version.                                              */
+/*                                                                                  */
+/* This program is distributed in the hope that it will be useful,                  */
+/* but WITHOUT ANY WARRANTY; without even the implied warranty of                   */
+/* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                    */
+/* GNU General Public License for more details.                                     */
+/*                                                                                  */
+/* You should have received a copy of the GNU General Public License                */
+/* along with this program.  If not, see <http://www.gnu.org/licenses/>.            */
+/************************************************************************************/
+
+// Qt
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QStringList>
+#include <QTextStream>
+// Local
+#include "main/threads/SavingThread.h"
+#include "main/helper/MagnificationExecutor.h"
+#include "main/other/Config.h"
+#include "main/other/Structures.h"
+
+// Headless batch magnifier, reads a video file, magnifies it with the same
+// code as the export of a VideoView and writes it to another file.
+// Values of the magnification are given in the units of the magnify options
+// in the GUI and converted like MagnifyOptions does.
+
+static int fail(const QString &message)
+{
+    QTextStream(stderr) << "rvm-cli: " << message << "\n";
+    return 1;
+}
+
+// Parse a double option, keep value if the option isn't set
+static bool parseDouble(const QCommandLineParser &parser, const QCommandLineOption &option, double &value)
+{
+    if(!parser.isSet(option))
+        return true;
+    bool ok;
+    value = parser.value(option).toDouble(&ok);
+    return ok;
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+    QCoreApplication::setApplicationName("rvm-cli");
+    QCoreApplication::setApplicationVersion(APP_VERSION);
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Magnifies motion or color in a video file without a display.");
+    parser.addHelpOption();
+    parser.addVersionOption();
+    parser.addPositionalArgument("input", "Video file to magnify.");
+    parser.addPositionalArgument("output", "Video file to write.");
+
+    QCommandLineOption modeOption(QStringList() << "m" << "mode",
+                                  "Magnification: none, color, laplace or riesz.", "mode", "riesz");
+    QCommandLineOption levelsOption(QStringList() << "l" << "levels",
+                                    "Levels of the image pyramid, limited by the ROI size.", "levels");
+    QCommandLineOption lowOption("low", "Lower cutoff frequency (color, riesz: Hz, laplace: %).", "cutoff");
+    QCommandLineOption highOption("high", "Upper cutoff frequency (color, riesz: Hz, laplace: %).", "cutoff");
+    QCommandLineOption amplificationOption(QStringList() << "a" << "amplification",
+                                           "Amplification factor.", "factor");
+    QCommandLineOption wavelengthOption("wavelength", "Cutoff wavelength (riesz: threshold in % of pi).", "wavelength");
+    QCommandLineOption chromOption("chrom", "Chrominance attenuation in % (color, laplace).", "percent");
+    QCommandLineOption filterToleranceOption("filter-tolerance", "Relative error of the separable Riesz pyramid "
+                                             "filters, 0 uses the exact 9x9 kernels.", "error",
+                                             QString::number(DEFAULT_RIESZ_FILTER_TOLERANCE));
+    QCommandLineOption roiOption("roi", "Region of interest, default is the whole frame.", "x,y,width,height");
+    QCommandLineOption codecOption(QStringList() << "c" << "codec",
+                                   "FOURCC of the output codec, default is the codec of the input.", "fourcc");
+    QCommandLineOption grayscaleOption(QStringList() << "g" << "grayscale", "Convert to grayscale before magnifying.");
+    QCommandLineOption originalOption(QStringList() << "o" << "original",
+                                      "Write the original next to the magnified frame.");
+    QCommandLineOption coresOption("cores", "Cores used for magnification, default is all cores.", "cores",
+                                   QString::number(DEFAULT_MAGNIFICATION_CORES));
+    QCommandLineOption workersOption("workers", "Workers exporting laplace and riesz in parallel chunks, "
+                                     "default is the number of cores, 1 exports serially.", "workers",
+                                     QString::number(DEFAULT_EXPORT_WORKERS));
+    QCommandLineOption prerollOption("preroll", "Frames every chunk is magnified ahead of its start at least.", "frames",
+                                     QString::number(DEFAULT_EXPORT_PREROLL_FRAMES));
+    QCommandLineOption toleranceOption("tolerance", "Maximal difference of a chunked to a serial export "
+                                       "in gray values, 0 exports serially.", "gray",
+                                       QString::number(DEFAULT_EXPORT_TOLERANCE));
+    parser.addOption(modeOption);
+    parser.addOption(levelsOption);
+    parser.addOption(lowOption);
+    parser.addOption(highOption);
+    parser.addOption(amplificationOption);
+    parser.addOption(wavelengthOption);
+    parser.addOption(chromOption);
+    parser.addOption(filterToleranceOption);
+    parser.addOption(roiOption);
+    parser.addOption(codecOption);
+    parser.addOption(grayscaleOption);
+    parser.addOption(originalOption);
+    parser.addOption(coresOption);
+    parser.addOption(workersOption);
+    parser.addOption(prerollOption);
+    parser.addOption(toleranceOption);
+    parser.process(a);
+
+    const QStringList files = parser.positionalArguments();
+    if(files.size() != 2)
+        return fail("Expected input and output file, see --help.");
+
+    // Magnification type and its defaults, like MagnifyOptions
+    ImageProcessingFlags flags;
+    ImageProcessingSettings settings;
+    double amplification, wavelength, low, high, chrom;
+    int levels = DEFAULT_LAP_MAG_LEVELS;
+    const QString mode = parser.value(modeOption).toLower();
+    flags.grayscaleOn = parser.isSet(grayscaleOption);
+    if(mode == "color") {
+        flags.colorMagnifyOn = true;
+        amplification = DEFAULT_CM_AMPLIFICATION;
+        wavelength = DEFAULT_CM_COWAVELENGTH;
+        low = DEFAULT_CM_COLOW;
+        high = DEFAULT_CM_COHIGH;
+        chrom = DEFAULT_CM_CHROMATTENUATION;
+        levels = DEFAULT_COL_MAG_LEVELS;
+    }
+    else if(mode == "laplace") {
+        flags.laplaceMagnifyOn = true;
+        amplification = DEFAULT_MM_AMPLIFICATION;
+        wavelength = DEFAULT_MM_COWAVELENGTH;
+        low = DEFAULT_MM_COLOW;
+        high = DEFAULT_MM_COHIGH;
+        chrom = DEFAULT_MM_CHROMATTENUATION;
+    }
+    else if(mode == "riesz") {
+        flags.rieszMagnifyOn = true;
+        amplification = DEFAULT_PB_AMPLIFICATION;
+        wavelength = DEFAULT_PB_COWAVELENGTH;
+        low = DEFAULT_PB_COLOW;
+        high = DEFAULT_PB_COHIGH;
+        chrom = 0;
+    }
+    else if(mode == "none") {
+        amplification = DEFAULT_AMPLIFICATION;
+        wavelength = DEFAULT_COWAVELENGTH;
+        low = DEFAULT_COLOW;
+        high = DEFAULT_COHIGH;
+        chrom = DEFAULT_CHROMATTENUATION;
+    }
+    else
+        return fail("Unknown mode " + mode + ".");
+
+    bool ok = parseDouble(parser, amplificationOption, amplification) &&
+              parseDouble(parser, wavelengthOption, wavelength) &&
+              parseDouble(parser, lowOption, low) &&
+              parseDouble(parser, highOption, high) &&
+              parseDouble(parser, chromOption, chrom);
+    if(!ok)
+        return fail("Magnification values have to be numbers.");
+    if(parser.isSet(levelsOption)) {
+        levels = parser.value(levelsOption).toInt(&ok);
+        if(!ok || levels < 1)
+            return fail("Levels have to be a positive number.");
+    }
+    if(mode != "none" && low >= high)
+        return fail("Lower cutoff has to be below the upper cutoff.");
+    const int workers = parser.value(workersOption).toInt(&ok);
+    if(!ok)
+        return fail("Workers have to be a number.");
+    const int preroll = parser.value(prerollOption).toInt(&ok);
+    if(!ok || preroll < 0)
+        return fail("Pre-roll has to be a positive number.");
+    const double tolerance = parser.value(toleranceOption).toDouble(&ok);
+    if(!ok)
+        return fail("Tolerance has to be a number.");
+    const double filterTolerance = parser.value(filterToleranceOption).toDouble(&ok);
+    if(!ok || filterTolerance < 0)
+        return fail("Filter tolerance has to be a positive number.");
+
+    // Open input
+    MagnificationExecutor executor(parser.value(coresOption).toInt());
+    SavingThread saver(&executor);
+    const std::string input = files.at(0).toStdString();
+    if(!saver.loadFile(input))
+        return fail("Not able to load video " + files.at(0) + ".");
+    const double framerate = saver.getVideoFramerate() > 0 ? saver.getVideoFramerate() : DEFAULT_EXECUTOR_FRAMERATE;
+    const QRect frame = saver.getVideoDimensions();
+
+    // Region of interest
+    QRect roi = frame;
+    if(parser.isSet(roiOption)) {
+        const QStringList values = parser.value(roiOption).split(',');
+        int v[4];
+        ok = values.size() == 4;
+        for(int i = 0; ok && i < 4; i++)
+            v[i] = values.at(i).toInt(&ok);
+        if(!ok)
+            return fail("ROI has to be given as x,y,width,height.");
+        roi = QRect(v[0], v[1], v[2], v[3]);
+        if(roi.width() <= 0 || roi.height() <= 0 || !frame.contains(roi))
+            return fail("ROI has to lie inside the frame.");
+    }
+    const int maxLevels = Magnificator().calculateMaxLevels(roi);
+    if(levels > maxLevels)
+        levels = maxLevels;
+
+    // Convert like MagnifyOptions::updateSettingsFromOptionsTab()
+    settings.amplification = amplification;
+    settings.coWavelength = flags.rieszMagnifyOn ? wavelength : wavelength*10.0;
+    settings.coLow = flags.laplaceMagnifyOn ? low/100.0 : low;
+    settings.coHigh = flags.laplaceMagnifyOn ? high/100.0 : high;
+    settings.chromAttenuation = chrom/100.0;
+    settings.levels = levels;
+    settings.rieszFilterTolerance = filterTolerance;
+    settings.framerate = framerate;
+    settings.frameWidth = roi.width();
+    settings.frameHeight = roi.height();
+
+    // Codec
+    if(parser.isSet(codecOption)) {
+        const QByteArray fourcc = parser.value(codecOption).toLatin1();
+        if(fourcc.size() != 4)
+            return fail("Codec has to be a FOURCC like MJPG.");
+        saver.savingCodec = VideoWriter::fourcc(fourcc[0], fourcc[1], fourcc[2], fourcc[3]);
+    }
+    else
+        saver.savingCodec = saver.getVideoCodec();
+
+    // Start saving, the application quits at the end of the video
+    saver.settings(flags, settings);
+    saver.setParallelExport(workers, preroll, tolerance);
+    if(!saver.saveFile(files.at(1).toStdString(), framerate, roi, parser.isSet(originalOption)))
+        return fail("Not able to write " + files.at(1) + ", check filename, -ending and codec.");
+
+    const int length = saver.getVideoLength();
+    int lastPercent = -1;
+    QObject::connect(&saver, &SavingThread::updateProgress, &a, [&](int frame) {
+        const int percent = length > 0 ? (100*frame)/length : 0;
+        if(percent != lastPercent) {
+            lastPercent = percent;
+            QTextStream(stderr) << "\r" << frame << "/" << length << " frames (" << percent << "%)";
+        }
+    });
+    QObject::connect(&saver, &SavingThread::endOfSaving, &a, [&]() {
+        QTextStream(stderr) << "\n";
+        a.quit();
+    });
+    saver.start();
+
+    const int result = a.exec();
+    if(saver.hasFailed())
+        return fail("Not able to magnify every frame of " + files.at(0) + ".");
+    return result;
+}
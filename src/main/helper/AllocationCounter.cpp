@@ -0,0 +1,98 @@
+/************************************************************************************/
+/* An OpenCV/Qt based realtime application to magnify motion and color              */
+/* Copyright (C) 2015  Jens Schindel <kontakt@jens-schindel.de>                     */
+/*                                                                                  */
+/* Based on the work of                                                             */
+/*      Joseph Pan      <https://github.com/wzpan/QtEVM>                            */
+/*      Nick D'Ademo    <https://github.com/nickdademo/qt-opencv-multithreaded>     */
+/*                                                                                  */
+/* Realtime-Video-Magnification->AllocationCounter.cpp                              */
+/*                                                                                  */
+/* This program is free software: you can redistribute it and/or modify             */
+/* it under the terms of the GNU General Public License as published by             */
+/* the Free Software Foundation, either version 3 of the License, or                */
+/* (at your option) any later version.                                              */
+/*                                                                                  */
+/* This program is distributed in the hope that it will be useful,                  */
+/* but WITHOUT ANY WARRANTY; without even the implied warranty of                   */
+/* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                    */
+/* GNU General Public License for more details.                                     */
+/*                                                                                  */
+/* You should have received a copy of the GNU General Public License                */
+/* along with this program.  If not, see <http://www.gnu.org/licenses/>.            */
+/************************************************************************************/
+
+#include "main/helper/AllocationCounter.h"
+
+// C++
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+// Allocations of all threads, the Mat buffers and everything else
+static std::atomic<long long> allocations(0);
+static std::atomic<long long> bytes(0);
+// Mat buffers only, they are counted by both
+static std::atomic<long long> matAllocations(0);
+
+void *operator new(std::size_t size)
+{
+    allocations++;
+    bytes += size;
+    if(void *memory = std::malloc(size ? size : 1))
+        return memory;
+    throw std::bad_alloc();
+}
+
+void operator delete(void *memory) noexcept
+{
+    std::free(memory);
+}
+
+void operator delete(void *memory, std::size_t) noexcept
+{
+    std::free(memory);
+}
+
+long long allocationCount()
+{
+    return allocations;
+}
+
+long long allocatedBytes()
+{
+    return bytes;
+}
+
+long long matAllocationCount()
+{
+    return matAllocations;
+}
+
+CountingMatAllocator::CountingMatAllocator() : stdAllocator(cv::Mat::getStdAllocator())
+{
+}
+
+cv::UMatData *CountingMatAllocator::allocate(int dims, const int *sizes, int type, void *data, size_t *step,
+                                             cv::AccessFlag flags, cv::UMatUsageFlags usageFlags) const
+{
+    if(!data) {
+        size_t size = CV_ELEM_SIZE(type);
+        for(int i = 0; i < dims; i++)
+            size *= sizes[i];
+        allocations++;
+        bytes += size;
+        matAllocations++;
+    }
+    return stdAllocator->allocate(dims, sizes, type, data, step, flags, usageFlags);
+}
+
+bool CountingMatAllocator::allocate(cv::UMatData *data, cv::AccessFlag accessFlags, cv::UMatUsageFlags usageFlags) const
+{
+    return stdAllocator->allocate(data, accessFlags, usageFlags);
+}
+
+void CountingMatAllocator::deallocate(cv::UMatData *data) const
+{
+    stdAllocator->deallocate(data);
+}
@@ -0,0 +1,58 @@
+/************************************************************************************/
+/* An OpenCV/Qt based realtime application to magnify motion and color              */
+/* Copyright (C) 2015  Jens Schindel <kontakt@jens-schindel.de>                     */
+/*                                                                                  */
+/* Based on the work of                                                             */
+/*      Joseph Pan      <https://github.com/wzpan/QtEVM>                            */
+/*      Nick D'Ademo    <https://github.com/nickdademo/qt-opencv-multithreaded>     */
+/*                                                                                  */
+/* Realtime-Video-Magnification->AllocationCounter.h                                */
+/*                                                                                  */
+/* This program is free software: you can redistribute it and/or modify             */
+/* it under the terms of the GNU General Public License as published by             */
+/* the Free Software Foundation, either version 3 of the License, or                */
+/* (at your option) any later version.                                              */
+/*                                                                                  */
+/* This program is distributed in the hope that it will be useful,                  */
+/* but WITHOUT ANY WARRANTY; without even the implied warranty of                   */
+/* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                    */
+/* GNU General Public License for more details.                                     */
+/*                                                                                  */
+/* You should have received a copy of the GNU General Public License                */
+/* along with this program.  If not, see <http://www.gnu.org/licenses/>.            */
+/************************************************************************************/
+
+#ifndef ALLOCATIONCOUNTER_H
+#define ALLOCATIONCOUNTER_H
+
+// OpenCV
+#include <opencv2/core.hpp>
+
+// Counts the allocations of all threads for the benchmark and the checks.
+// Linking AllocationCounter.cpp replaces the global operator new, so it
+// is only part of rvm-bench and rvm-test.
+
+// Allocations and their bytes, operator new and the Mat buffers
+long long allocationCount();
+long long allocatedBytes();
+// Mat buffers only, counted by both above
+long long matAllocationCount();
+
+// OpenCV allocates the data of a Mat with its own allocator, count it before
+// handing it on. The allocated data keeps the standard allocator for its release.
+// Install with cv::Mat::setDefaultAllocator().
+class CountingMatAllocator : public cv::MatAllocator
+{
+public:
+    CountingMatAllocator();
+
+    cv::UMatData *allocate(int dims, const int *sizes, int type, void *data, size_t *step,
+                           cv::AccessFlag flags, cv::UMatUsageFlags usageFlags) const override;
+    bool allocate(cv::UMatData *data, cv::AccessFlag accessFlags, cv::UMatUsageFlags usageFlags) const override;
+    void deallocate(cv::UMatData *data) const override;
+
+private:
+    cv::MatAllocator *stdAllocator;
+};
+
+#endif // ALLOCATIONCOUNTER_H
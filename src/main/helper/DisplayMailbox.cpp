@@ -0,0 +1,63 @@
+/************************************************************************************/
+/* An OpenCV/Qt based realtime application to magnify motion and color              */
+/* Copyright (C) 2015  Jens Schindel <kontakt@jens-schindel.de>                     */
+/*                                                                                  */
+/* Based on the work of                                                             */
+/*      Joseph Pan      <https://github.com/wzpan/QtEVM>                            */
+/*      Nick D'Ademo    <https://github.com/nickdademo/qt-opencv-multithreaded>     */
+/*                                                                                  */
+/* Realtime-Video-Magnification->DisplayMailbox.cpp                                 */
+/*                                                                                  */
+/* This program is free software: you can redistribute it and/or modify             */
+/* it under the terms of the GNU General Public License as published by             */
+/* the Free Software Foundation, either version 3 of the License, or                */
+/* (at your option) any later version.                                              */
+/*                                                                                  */
+/* This program is distributed in the hope that it will be useful,                  */
+/* but WITHOUT ANY WARRANTY; without even the implied warranty of                   */
+/* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                    */
+/* GNU General Public License for more details.                                     */
+/*                                                                                  */
+/* You should have received a copy of the GNU General Public License                */
+/* along with this program.  If not, see <http://www.gnu.org/licenses/>.            */
+/************************************************************************************/
+
+#include "main/helper/DisplayMailbox.h"
+
+DisplayMailbox::DisplayMailbox()
+{
+    // Initialize variables(s)
+    fresh = false;
+}
+
+void DisplayMailbox::post(const QImage &image)
+{
+    // Release the replaced frame outside of the lock, it may return a pooled frame
+    QImage old;
+    mutex.lock();
+    old.swap(latest);
+    latest = image;
+    fresh = true;
+    mutex.unlock();
+}
+
+bool DisplayMailbox::take(QImage &image)
+{
+    QMutexLocker locker(&mutex);
+    if(!fresh)
+        return false;
+    // The mailbox keeps no reference, the label owns the frame it shows
+    image.swap(latest);
+    latest = QImage();
+    fresh = false;
+    return true;
+}
+
+void DisplayMailbox::clear()
+{
+    QImage old;
+    mutex.lock();
+    old.swap(latest);
+    fresh = false;
+    mutex.unlock();
+}
@@ -0,0 +1,55 @@
+/************************************************************************************/
+/* An OpenCV/Qt based realtime application to magnify motion and color              */
+/* Copyright (C) 2015  Jens Schindel <kontakt@jens-schindel.de>                     */
+/*                                                                                  */
+/* Based on the work of                                                             */
+/*      Joseph Pan      <https://github.com/wzpan/QtEVM>                            */
+/*      Nick D'Ademo    <https://github.com/nickdademo/qt-opencv-multithreaded>     */
+/*                                                                                  */
+/* Realtime-Video-Magnification->DisplayMailbox.h                                   */
+/*                                                                                  */
+/* This program is free software: you can redistribute it and/or modify             */
+/* it under the terms of the GNU General Public License as published by             */
+/* the Free Software Foundation, either version 3 of the License, or                */
+/* (at your option) any later version.                                              */
+/*                                                                                  */
+/* This program is distributed in the hope that it will be useful,                  */
+/* but WITHOUT ANY WARRANTY; without even the implied warranty of                   */
+/* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                    */
+/* GNU General Public License for more details.                                     */
+/*                                                                                  */
+/* You should have received a copy of the GNU General Public License                */
+/* along with this program.  If not, see <http://www.gnu.org/licenses/>.            */
+/************************************************************************************/
+
+#ifndef DISPLAYMAILBOX_H
+#define DISPLAYMAILBOX_H
+
+// Qt
+#include <QtCore/QMutex>
+#include <QtGui/QImage>
+
+// Holds only the newest frame for a view. The processing thread posts every
+// frame it has shown, the GUI thread takes one per screen refresh. A frame the
+// GUI didn't take in time is replaced, so a slow GUI neither queues images
+// nor makes the poster wait longer than the swap of one image.
+class DisplayMailbox
+{
+    public:
+        DisplayMailbox();
+        // Replaces the held frame with image
+        void post(const QImage &image);
+        // Moves the frame posted since the last take() into image, returns
+        // false and leaves image untouched if there is none
+        bool take(QImage &image);
+        // Drops the held frame, e.g. when its thread stops
+        void clear();
+
+    private:
+        QMutex mutex;
+        QImage latest;
+        // Set by post(), cleared by take()
+        bool fresh;
+};
+
+#endif // DISPLAYMAILBOX_H
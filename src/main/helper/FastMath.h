@@ -0,0 +1,127 @@
+/************************************************************************************/
+/* An OpenCV/Qt based realtime application to magnify motion and color              */
+/* Copyright (C) 2015  Jens Schindel <kontakt@jens-schindel.de>                     */
+/*                                                                                  */
+/* Based on the work of                                                             */
+/*      Joseph Pan      <https://github.com/wzpan/QtEVM>                            */
+/*      Nick D'Ademo    <https://github.com/nickdademo/qt-opencv-multithreaded>     */
+/*                                                                                  */
+/* Realtime-Video-Magnification->FastMath.h                                         */
+/*                                                                                  */
+/* This program is free software: you can redistribute it and/or modify             */
+/* it under the terms of the GNU General Public License as published by             */
+/* the Free Software Foundation, either version 3 of the License, or                */
+/* (at your option) any later version.                                              */
+/*                                                                                  */
+/* This program is distributed in the hope that it will be useful,                  */
+/* but WITHOUT ANY WARRANTY; without even the implied warranty of                   */
+/* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                    */
+/* GNU General Public License for more details.                                     */
+/*                                                                                  */
+/* You should have received a copy of the GNU General Public License                */
+/* along with this program.  If not, see <http://www.gnu.org/licenses/>.            */
+/************************************************************************************/
+
+#ifndef FASTMATH_H
+#define FASTMATH_H
+
+// C++
+#include <algorithm>
+#include <cmath>
+// OpenCV
+#include <opencv2/core.hpp>
+#include <opencv2/core/hal/intrin.hpp>
+
+// Polynomial approximations for the phase kernels of the Riesz pyramid. The
+// scalar versions handle the tails of the rows the SIMD versions leave, both
+// evaluate the same polynomials. rvm-test checks them against the C++ library.
+//
+// acos(x) = sqrt(1-|x|) * p(|x|) (Abramowitz & Stegun 4.4.46), the
+// polynomial error is below 2e-8 on [-1,1], |x| > 1 is clamped. In float
+// the result is within 5e-7 of acos.
+static const float acosCoeffs[8] = {  1.5707963050f, -0.2145988016f,  0.0889789874f, -0.0501743046f,
+                                      0.0308918810f, -0.0170881256f,  0.0066700901f, -0.0012624911f };
+// cos/sin after reduction by n*pi/2 onto [-pi/4,pi/4] (Cephes), the error
+// is about 1e-7 for arguments up to some thousands.
+static const float piHalf1 = 1.5703125f;
+static const float piHalf2 = 4.837512969970703125e-4f;
+static const float piHalf3 = 7.54978995489188216e-8f;
+static const float sinCoeffs[3] = { -1.6666654611e-1f,  8.3321608736e-3f, -1.9515295891e-4f };
+static const float cosCoeffs[3] = {  4.166664568298827e-2f, -1.388731625493765e-3f,  2.443315711809948e-5f };
+
+inline float fastArcCos(float x)
+{
+    const float a = std::min(std::fabs(x), 1.0f);
+    float p = acosCoeffs[7];
+    for (int i = 6; i >= 0; --i)
+        p = p * a + acosCoeffs[i];
+    const float r = std::sqrt(1.0f - a) * p;
+    return x < 0.0f ? static_cast<float>(CV_PI) - r : r;
+}
+
+inline void fastCosSin(float x, float &c, float &s)
+{
+    const int q = cvRound(x * static_cast<float>(2.0/CV_PI));
+    const float n = static_cast<float>(q);
+    const float r = ((x - n * piHalf1) - n * piHalf2) - n * piHalf3;
+    const float r2 = r * r;
+    const float ps = r + r * r2 * (sinCoeffs[0] + r2 * (sinCoeffs[1] + r2 * sinCoeffs[2]));
+    const float pc = 1.0f - 0.5f * r2 + r2 * r2 * (cosCoeffs[0] + r2 * (cosCoeffs[1] + r2 * cosCoeffs[2]));
+    const float sv = (q & 1) ? pc : ps;
+    const float cs = (q & 1) ? ps : pc;
+    s = (q & 2) ? -sv : sv;
+    c = ((q + 1) & 2) ? -cs : cs;
+}
+
+// num/den, 0 instead of NaN or inf for a zero den
+inline float safeDivide(float num, float den)
+{
+    return den > 0.0f ? num / den : 0.0f;
+}
+
+#if CV_SIMD
+inline cv::v_float32 v_fastArcCos(const cv::v_float32 &x)
+{
+    const cv::v_float32 one = cv::vx_setall_f32(1.0f);
+    const cv::v_float32 a = cv::v_min(cv::v_abs(x), one);
+    cv::v_float32 p = cv::vx_setall_f32(acosCoeffs[7]);
+    for (int i = 6; i >= 0; --i)
+        p = cv::v_muladd(p, a, cv::vx_setall_f32(acosCoeffs[i]));
+    const cv::v_float32 r = cv::v_sqrt(one - a) * p;
+    return cv::v_select(x < cv::vx_setzero_f32(), cv::vx_setall_f32(static_cast<float>(CV_PI)) - r, r);
+}
+
+inline void v_fastCosSin(const cv::v_float32 &x, cv::v_float32 &c, cv::v_float32 &s)
+{
+    const cv::v_int32 q = cv::v_round(x * cv::vx_setall_f32(static_cast<float>(2.0/CV_PI)));
+    const cv::v_float32 n = cv::v_cvt_f32(q);
+    cv::v_float32 r = cv::v_muladd(n, cv::vx_setall_f32(-piHalf1), x);
+    r = cv::v_muladd(n, cv::vx_setall_f32(-piHalf2), r);
+    r = cv::v_muladd(n, cv::vx_setall_f32(-piHalf3), r);
+    const cv::v_float32 r2 = r * r;
+    cv::v_float32 ps = cv::v_muladd(r2, cv::vx_setall_f32(sinCoeffs[2]), cv::vx_setall_f32(sinCoeffs[1]));
+    ps = cv::v_muladd(ps, r2, cv::vx_setall_f32(sinCoeffs[0]));
+    ps = cv::v_muladd(ps * r2, r, r);
+    cv::v_float32 pc = cv::v_muladd(r2, cv::vx_setall_f32(cosCoeffs[2]), cv::vx_setall_f32(cosCoeffs[1]));
+    pc = cv::v_muladd(pc, r2, cv::vx_setall_f32(cosCoeffs[0]));
+    pc = cv::v_muladd(pc * r2, r2, cv::v_muladd(r2, cv::vx_setall_f32(-0.5f), cv::vx_setall_f32(1.0f)));
+
+    const cv::v_int32 one = cv::vx_setall_s32(1);
+    const cv::v_int32 two = cv::vx_setall_s32(2);
+    const cv::v_float32 swap = cv::v_reinterpret_as_f32((q & one) == one);
+    const cv::v_float32 negS = cv::v_reinterpret_as_f32((q & two) == two);
+    const cv::v_float32 negC = cv::v_reinterpret_as_f32(((q + one) & two) == two);
+    const cv::v_float32 zero = cv::vx_setzero_f32();
+    const cv::v_float32 sv = cv::v_select(swap, pc, ps);
+    const cv::v_float32 cs = cv::v_select(swap, ps, pc);
+    s = cv::v_select(negS, zero - sv, sv);
+    c = cv::v_select(negC, zero - cs, cs);
+}
+
+inline cv::v_float32 v_safeDivide(const cv::v_float32 &num, const cv::v_float32 &den)
+{
+    return cv::v_select(den > cv::vx_setzero_f32(), num / den, cv::vx_setzero_f32());
+}
+#endif
+
+#endif // FASTMATH_H
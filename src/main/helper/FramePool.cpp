@@ -0,0 +1,100 @@
+/************************************************************************************/
+/* An OpenCV/Qt based realtime application to magnify motion and color              */
+/* Copyright (C) 2015  Jens Schindel <kontakt@jens-schindel.de>                     */
+/*                                                                                  */
+/* Based on the work of                                                             */
+/*      Joseph Pan      <https://github.com/wzpan/QtEVM>                            */
+/*      Nick D'Ademo    <https://github.com/nickdademo/qt-opencv-multithreaded>     */
+/*                                                                                  */
+/* Realtime-Video-Magnification->FramePool.cpp                                      */
+/*                                                                                  */
+/* This program is free software: you can redistribute it and/or modify             */
+/* it under the terms of the GNU General Public License as published by             */
+/* the Free Software Foundation, either version 3 of the License, or                */
+/* (at your option) any later version.                                              */
+/*                                                                                  */
+/* This program is distributed in the hope that it will be useful,                  */
+/* but WITHOUT ANY WARRANTY; without even the implied warranty of                   */
+/* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                    */
+/* GNU General Public License for more details.                                     */
+/*                                                                                  */
+/* You should have received a copy of the GNU General Public License                */
+/* along with this program.  If not, see <http://www.gnu.org/licenses/>.            */
+/************************************************************************************/
+
+#include "main/helper/FramePool.h"
+
+FramePool::FramePool(int maxSize)
+{
+    // Initialize variables(s)
+    poolSize = maxSize > 0 ? maxSize : 1;
+    frames.reserve(poolSize);
+    next = 0;
+    allocations = 0;
+}
+
+bool FramePool::isFree(const Mat &frame)
+{
+    // Not allocated yet
+    if(frame.empty())
+        return true;
+    // Only the pool references the storage
+    return frame.u && CV_XADD(&frame.u->refcount, 0) == 1;
+}
+
+Mat& FramePool::acquire()
+{
+    // Round robin search, so a frame is reused as late as possible
+    const int count = frames.size();
+    for(int i = 0; i < count; i++)
+    {
+        const int index = (next + i) % count;
+        if(isFree(frames[index]))
+        {
+            next = (index + 1) % count;
+            return frames[index];
+        }
+    }
+
+    allocations++;
+    // Grow, the new frame gets allocated when it is written
+    if(count < poolSize)
+    {
+        frames.push_back(Mat());
+        next = 0;
+        return frames.back();
+    }
+    // Detach the next frame from its users, they keep the old storage
+    Mat &frame = frames[next];
+    frame.release();
+    next = (next + 1) % count;
+    return frame;
+}
+
+Mat& FramePool::copyRoi(const Mat &src, const Rect &roi)
+{
+    Mat &frame = acquire();
+    src(roi).copyTo(frame);
+    return frame;
+}
+
+int FramePool::size()
+{
+    return frames.size();
+}
+
+int FramePool::maxSize()
+{
+    return poolSize;
+}
+
+int FramePool::nAllocations()
+{
+    return allocations;
+}
+
+void FramePool::clear()
+{
+    frames.clear();
+    next = 0;
+}
@@ -0,0 +1,65 @@
+/************************************************************************************/
+/* An OpenCV/Qt based realtime application to magnify motion and color              */
+/* Copyright (C) 2015  Jens Schindel <kontakt@jens-schindel.de>                     */
+/*                                                                                  */
+/* Based on the work of                                                             */
+/*      Joseph Pan      <https://github.com/wzpan/QtEVM>                            */
+/*      Nick D'Ademo    <https://github.com/nickdademo/qt-opencv-multithreaded>     */
+/*                                                                                  */
+/* Realtime-Video-Magnification->FramePool.h                                        */
+/*                                                                                  */
+/* This program is free software: you can redistribute it and/or modify             */
+/* it under the terms of the GNU General Public License as published by             */
+/* the Free Software Foundation, either version 3 of the License, or                */
+/* (at your option) any later version.                                              */
+/*                                                                                  */
+/* This program is distributed in the hope that it will be useful,                  */
+/* but WITHOUT ANY WARRANTY; without even the implied warranty of                   */
+/* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                    */
+/* GNU General Public License for more details.                                     */
+/*                                                                                  */
+/* You should have received a copy of the GNU General Public License                */
+/* along with this program.  If not, see <http://www.gnu.org/licenses/>.            */
+/************************************************************************************/
+
+#ifndef FRAMEPOOL_H
+#define FRAMEPOOL_H
+
+// C++
+#include <vector>
+// OpenCV
+#include <opencv2/core.hpp>
+
+using namespace cv;
+
+// Reusable frames for a producer thread. A frame is free again once every
+// other Mat referencing it (queued, ROI, copies) is released, so consumers
+// return a frame just by dropping it. Only the owning thread may call
+// acquire(), other threads only release references.
+class FramePool
+{
+    public:
+        FramePool(int maxSize);
+        // Returns a frame no one else references. Writing into it with the
+        // same size and type keeps its storage, so retrieving into it does
+        // not allocate. If all frames are in use the pool grows up to
+        // maxSize, then the next frame is detached and reallocated.
+        Mat& acquire();
+        // Copies only the roi of src into a free frame, which is continuous
+        // and has the size of roi.
+        Mat& copyRoi(const Mat &src, const Rect &roi);
+        int size();
+        int maxSize();
+        // Number of frames that had to be allocated because none was free
+        int nAllocations();
+        void clear();
+
+    private:
+        static bool isFree(const Mat &frame);
+        std::vector<Mat> frames;
+        int poolSize;
+        int next;
+        int allocations;
+};
+
+#endif // FRAMEPOOL_H
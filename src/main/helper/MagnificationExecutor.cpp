@@ -0,0 +1,140 @@
+/************************************************************************************/
+/* An OpenCV/Qt based realtime application to magnify motion and color              */
+/* Copyright (C) 2015  Jens Schindel <kontakt@jens-schindel.de>                     */
+/*                                                                                  */
+/* Based on the work of                                                             */
+/*      Joseph Pan      <https://github.com/wzpan/QtEVM>                            */
+/*      Nick D'Ademo    <https://github.com/nickdademo/qt-opencv-multithreaded>     */
+/*                                                                                  */
+/* Realtime-Video-Magnification->MagnificationExecutor.cpp                          */
+/*                                                                                  */
+/* This program is free software: you can redistribute it and/or modify             */
+/* it under the terms of the GNU General Public License as published by             */
+/* the Free Software Foundation, either version 3 of the License, or                */
+/* (at your option) any later version.                                              */
+/*                                                                                  */
+/* This program is distributed in the hope that it will be useful,                  */
+/* but WITHOUT ANY WARRANTY; without even the implied warranty of                   */
+/* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                    */
+/* GNU General Public License for more details.                                     */
+/*                                                                                  */
+/* You should have received a copy of the GNU General Public License                */
+/* along with this program.  If not, see <http://www.gnu.org/licenses/>.            */
+/************************************************************************************/
+
+#include "main/helper/MagnificationExecutor.h"
+
+// Qt
+#include <QtCore/QThread>
+// OpenCV
+#include <opencv2/core.hpp>
+// Local
+#include "main/other/Config.h"
+
+MagnificationExecutor::MagnificationExecutor(int cores)
+{
+    // Initialize variables(s)
+    nCores = 1;
+    running = 0;
+    nextStream = 0;
+    nextTicket = 0;
+    clock.start();
+    setCores(cores);
+}
+
+int MagnificationExecutor::addStream()
+{
+    QMutexLocker locker(&mutex);
+    Stream stream;
+    stream.period = (qint64)(1000000000.0/DEFAULT_EXECUTOR_FRAMERATE);
+    stream.missedDeadlines = 0;
+    streamMap.insert(nextStream, stream);
+    return nextStream++;
+}
+
+void MagnificationExecutor::removeStream(int stream)
+{
+    QMutexLocker locker(&mutex);
+    streamMap.remove(stream);
+}
+
+void MagnificationExecutor::setStreamFramerate(int stream, double fps)
+{
+    QMutexLocker locker(&mutex);
+    if(streamMap.contains(stream))
+        streamMap[stream].period = (qint64)(1000000000.0/(fps > 0 ? fps : DEFAULT_EXECUTOR_FRAMERATE));
+}
+
+bool MagnificationExecutor::isNext(const Request &request)
+{
+    for(int i = 0; i < waiting.size(); i++) {
+        const Request &other = waiting.at(i);
+        if(other.deadline < request.deadline ||
+           (other.deadline == request.deadline && other.ticket < request.ticket))
+            return false;
+    }
+    return true;
+}
+
+qint64 MagnificationExecutor::acquire(int stream)
+{
+    QMutexLocker locker(&mutex);
+    Request request;
+    request.deadline = clock.nsecsElapsed() + (streamMap.contains(stream) ? streamMap[stream].period
+                                                                          : (qint64)(1000000000.0/DEFAULT_EXECUTOR_FRAMERATE));
+    request.ticket = nextTicket++;
+    waiting.append(request);
+
+    // Wait for a core, the earliest deadline goes first
+    while(running >= nCores || !isNext(request))
+        coreFree.wait(&mutex);
+    for(int i = 0; i < waiting.size(); i++) {
+        if(waiting.at(i).ticket == request.ticket) {
+            waiting.remove(i);
+            break;
+        }
+    }
+    running++;
+    // Another core may be free for the next request
+    coreFree.wakeAll();
+    return request.deadline;
+}
+
+bool MagnificationExecutor::release(int stream, qint64 deadline)
+{
+    QMutexLocker locker(&mutex);
+    running--;
+    coreFree.wakeAll();
+    if(deadline < 0)
+        return false;
+    const bool inTime = clock.nsecsElapsed() <= deadline;
+    if(!inTime && streamMap.contains(stream))
+        streamMap[stream].missedDeadlines++;
+    return inTime;
+}
+
+void MagnificationExecutor::setCores(int cores)
+{
+    QMutexLocker locker(&mutex);
+    nCores = cores > 0 ? cores : qMax(QThread::idealThreadCount(), 1);
+    cv::setNumThreads(nCores);
+    coreFree.wakeAll();
+}
+
+int MagnificationExecutor::cores()
+{
+    QMutexLocker locker(&mutex);
+    return nCores;
+}
+
+int MagnificationExecutor::streams()
+{
+    QMutexLocker locker(&mutex);
+    return streamMap.size();
+}
+
+int MagnificationExecutor::missedDeadlines(int stream)
+{
+    QMutexLocker locker(&mutex);
+    return streamMap.contains(stream) ? streamMap[stream].missedDeadlines : 0;
+}
@@ -0,0 +1,102 @@
+/************************************************************************************/
+/* An OpenCV/Qt based realtime application to magnify motion and color              */
+/* Copyright (C) 2015  Jens Schindel <kontakt@jens-schindel.de>                     */
+/*                                                                                  */
+/* Based on the work of                                                             */
+/*      Joseph Pan      <https://github.com/wzpan/QtEVM>                            */
+/*      Nick D'Ademo    <https://github.com/nickdademo/qt-opencv-multithreaded>     */
+/*                                                                                  */
+/* Realtime-Video-Magnification->MagnificationExecutor.h                            */
+/*                                                                                  */
+/* This program is free software: you can redistribute it and/or modify             */
+/* it under the terms of the GNU General Public License as published by             */
+/* the Free Software Foundation, either version 3 of the License, or                */
+/* (at your option) any later version.                                              */
+/*                                                                                  */
+/* This program is distributed in the hope that it will be useful,                  */
+/* but WITHOUT ANY WARRANTY; without even the implied warranty of                   */
+/* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                    */
+/* GNU General Public License for more details.                                     */
+/*                                                                                  */
+/* You should have received a copy of the GNU General Public License                */
+/* along with this program.  If not, see <http://www.gnu.org/licenses/>.            */
+/************************************************************************************/
+
+#ifndef MAGNIFICATIONEXECUTOR_H
+#define MAGNIFICATIONEXECUTOR_H
+
+// Qt
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QHash>
+#include <QtCore/QVector>
+#include <QtCore/QMutex>
+#include <QtCore/QWaitCondition>
+// Process wide scheduler for the magnification of all camera and video
+// streams. Every stream keeps magnifying in its own thread, because the
+// Magnificator state belongs to the stream, but it has to be granted one
+// of the cores before it may run a frame. Streams waiting for a core are
+// granted earliest deadline first, the deadline of a frame is the time it
+// was submitted plus the frame period of its stream. Streams with the
+// same deadline are granted in order of submission.
+// The number of cores also sets the threads of OpenCV's thread pool, which
+// the magnification uses inside a frame.
+class MagnificationExecutor
+{
+    public:
+        // cores <= 0 uses QThread::idealThreadCount()
+        MagnificationExecutor(int cores);
+        // Returns the id of a new stream
+        int addStream();
+        void removeStream(int stream);
+        // The frame period of the stream is 1/fps, fps <= 0 uses the default
+        void setStreamFramerate(int stream, double fps);
+        // Runs task() in the calling thread once stream is granted a core.
+        // Returns false if the task finished after its deadline. A template,
+        // so no std::function has to be allocated for the task every frame.
+        template<typename Task>
+        bool run(int stream, const Task &task)
+        {
+            const qint64 deadline = acquire(stream);
+            try {
+                task();
+            }
+            catch(...) {
+                release(stream, -1);
+                throw;
+            }
+            return release(stream, deadline);
+        }
+        void setCores(int cores);
+        int cores();
+        int streams();
+        // Number of frames of stream that finished after their deadline
+        int missedDeadlines(int stream);
+
+    private:
+        struct Request {
+            qint64 deadline;
+            qint64 ticket;
+        };
+        struct Stream {
+            qint64 period;
+            int missedDeadlines;
+        };
+        bool isNext(const Request &request);
+        // Waits for a core for stream, returns the deadline of the frame
+        qint64 acquire(int stream);
+        // Frees the core, returns false if the deadline was missed. A
+        // deadline < 0 frees the core without counting the frame.
+        bool release(int stream, qint64 deadline);
+        QMutex mutex;
+        QWaitCondition coreFree;
+        QElapsedTimer clock;
+        QHash<int, Stream> streamMap;
+        // Keeps its capacity, so waiting doesn't allocate every frame
+        QVector<Request> waiting;
+        int nCores;
+        int running;
+        int nextStream;
+        qint64 nextTicket;
+};
+
+#endif // MAGNIFICATIONEXECUTOR_H
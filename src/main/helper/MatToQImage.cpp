@@ -25,35 +25,51 @@
 #include "main/helper/MatToQImage.h"
 // Qt
 #include <QDebug>
+// OpenCV
+#include <opencv2/imgproc.hpp>
 
-QImage MatToQImage(const Mat& mat)
+// Drops the reference of a QImage to its Mat
+static void releaseMat(void *mat)
 {
-    // 8-bits unsigned, NO. OF CHANNELS=1
-    if(mat.type()==CV_8UC1)
+    delete static_cast<Mat*>(mat);
+}
+
+QImage MatToQImage(const Mat &mat, const QSize &size, FramePool *pool)
+{
+    if(mat.type()!=CV_8UC1 && mat.type()!=CV_8UC3)
     {
-        // Set the color table (used to translate colour indexes to qRgb values)
-        QVector<QRgb> colorTable;
-        for (int i=0; i<256; i++)
-            colorTable.push_back(qRgb(i,i,i));
-        // Copy input Mat
-        const uchar *qImageBuffer = (const uchar*)mat.data;
-        // Create QImage with same dimensions as input Mat
-        QImage img(qImageBuffer, mat.cols, mat.rows, mat.step, QImage::Format_Indexed8);
-        img.setColorTable(colorTable);
-        return img;
+        qDebug() << "ERROR: Mat could not be converted to QImage.";
+        return QImage();
     }
-    // 8-bits unsigned, NO. OF CHANNELS=3
-    else if(mat.type()==CV_8UC3)
+
+    Mat shown = mat;
+    // Scale to fit size, shrinking averages the pixels
+    const QSize original(mat.cols, mat.rows);
+    const QSize fitted = size.isValid() ? original.scaled(size, Qt::KeepAspectRatio) : original;
+    if(!fitted.isEmpty() && fitted != original)
     {
-        // Copy input Mat
-        const uchar *qImageBuffer = (const uchar*)mat.data;
-        // Create QImage with same dimensions as input Mat
-        QImage img(qImageBuffer, mat.cols, mat.rows, mat.step, QImage::Format_RGB888);
-        return img.rgbSwapped();
+        Mat scaled;
+        Mat &target = pool ? pool->acquire() : scaled;
+        const int interpolation = fitted.width() < mat.cols ? INTER_AREA : INTER_LINEAR;
+        resize(mat, target, Size(fitted.width(), fitted.height()), 0, 0, interpolation);
+        shown = target;
     }
-    else
+
+    QImage::Format format = QImage::Format_Grayscale8;
+    if(shown.type()==CV_8UC3)
     {
-        qDebug() << "ERROR: Mat could not be converted to QImage.";
-        return QImage();
+#if QT_VERSION >= QT_VERSION_CHECK(5, 14, 0)
+        format = QImage::Format_BGR888;
+#else
+        // No BGR format, swap the channels while copying into a frame of pool
+        Mat swapped;
+        Mat &target = pool ? pool->acquire() : swapped;
+        cvtColor(shown, target, COLOR_BGR2RGB);
+        shown = target;
+        format = QImage::Format_RGB888;
+#endif
     }
+    // The image keeps a reference to shown, a pooled frame is free again once the image is destroyed
+    return QImage((const uchar*)shown.data, shown.cols, shown.rows, shown.step, format,
+                  releaseMat, new Mat(shown));
 }
@@ -26,13 +26,20 @@
 #define MATTOQIMAGE_H
 
 // Qt
+#include <QtCore/QSize>
 #include <QtGui/QImage>
 // OpenCV
 #include <opencv2/core.hpp>
 #include <opencv2/highgui.hpp>
+// Local
+#include "main/helper/FramePool.h"
 
 using namespace cv;
 
-QImage MatToQImage(const Mat&);
+// Converts a BGR or grayscale Mat into a QImage that shares the data of the Mat
+// and keeps a reference to it, no color table or channel swap. If size is valid,
+// the Mat is scaled to fit size keeping its aspect ratio, in the calling thread
+// and into a frame of pool, so the GUI thread only has to blit the image.
+QImage MatToQImage(const Mat &mat, const QSize &size = QSize(), FramePool *pool = 0);
 
 #endif // MATTOQIMAGE_H
@@ -0,0 +1,56 @@
+/************************************************************************************/
+/* An OpenCV/Qt based realtime application to magnify motion and color              */
+/* Copyright (C) 2015  Jens Schindel <kontakt@jens-schindel.de>                     */
+/*                                                                                  */
+/* Based on the work of                                                             */
+/*      Joseph Pan      <https://github.com/wzpan/QtEVM>                            */
+/*      Nick D'Ademo    <https://github.com/nickdademo/qt-opencv-multithreaded>     */
+/*                                                                                  */
+/* Realtime-Video-Magnification->ParallelLevels.cpp                                 */
+/*                                                                                  */
+/* This program is free software: you can redistribute it and/or modify             */
+/* it under the terms of the GNU General Public License as published by             */
+/* the Free Software Foundation, either version 3 of the License, or                */
+/* (at your option) any later version.                                              */
+/*                                                                                  */
+/* This program is distributed in the hope that it will be useful,                  */
+/* but WITHOUT ANY WARRANTY; without even the implied warranty of                   */
+/* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                    */
+/* GNU General Public License for more details.                                     */
+/*                                                                                  */
+/* You should have received a copy of the GNU General Public License                */
+/* along with this program.  If not, see <http://www.gnu.org/licenses/>.            */
+/************************************************************************************/
+
+#include "main/helper/ParallelLevels.h"
+
+int levelBands(const std::vector<int> &levelRows)
+{
+    int bands = 0;
+    for (size_t level = 0; level < levelRows.size(); ++level)
+        bands += (levelRows[level] + LEVEL_TILE_ROWS - 1) / LEVEL_TILE_ROWS;
+    return bands;
+}
+
+void levelBand(const std::vector<int> &levelRows, int i, int &level, cv::Range &rows)
+{
+    // Few levels, so counting down the bands of each is cheaper than a table
+    for (level = 0; level < (int)levelRows.size(); ++level) {
+        const int bands = (levelRows[level] + LEVEL_TILE_ROWS - 1) / LEVEL_TILE_ROWS;
+        if(i < bands)
+            break;
+        i -= bands;
+    }
+    const int y = i*LEVEL_TILE_ROWS;
+    rows = cv::Range(y, std::min(y + LEVEL_TILE_ROWS, levelRows[level]));
+}
+
+float *rowScratch(int slot, size_t size)
+{
+    static thread_local std::vector<float> scratch[ROW_SCRATCH_SLOTS];
+    CV_Assert(slot >= 0 && slot < ROW_SCRATCH_SLOTS);
+    std::vector<float> &buffer = scratch[slot];
+    if(buffer.size() < size)
+        buffer.resize(size);
+    return buffer.data();
+}
@@ -0,0 +1,90 @@
+/************************************************************************************/
+/* An OpenCV/Qt based realtime application to magnify motion and color              */
+/* Copyright (C) 2015  Jens Schindel <kontakt@jens-schindel.de>                     */
+/*                                                                                  */
+/* Based on the work of                                                             */
+/*      Joseph Pan      <https://github.com/wzpan/QtEVM>                            */
+/*      Nick D'Ademo    <https://github.com/nickdademo/qt-opencv-multithreaded>     */
+/*                                                                                  */
+/* Realtime-Video-Magnification->ParallelLevels.h                                   */
+/*                                                                                  */
+/* This program is free software: you can redistribute it and/or modify             */
+/* it under the terms of the GNU General Public License as published by             */
+/* the Free Software Foundation, either version 3 of the License, or                */
+/* (at your option) any later version.                                              */
+/*                                                                                  */
+/* This program is distributed in the hope that it will be useful,                  */
+/* but WITHOUT ANY WARRANTY; without even the implied warranty of                   */
+/* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                    */
+/* GNU General Public License for more details.                                     */
+/*                                                                                  */
+/* You should have received a copy of the GNU General Public License                */
+/* along with this program.  If not, see <http://www.gnu.org/licenses/>.            */
+/************************************************************************************/
+
+#ifndef PARALLELLEVELS_H
+#define PARALLELLEVELS_H
+
+// C++
+#include <vector>
+// OpenCV
+#include <opencv2/core.hpp>
+// Local
+#include "main/other/Config.h"
+
+// Runs body(range) like cv::parallel_for_. The lambda overload of OpenCV wraps
+// the body into a std::function, which allocates for lambdas with more than
+// 2 captures, this wrapper only references it.
+template<typename Body>
+class ParallelBody : public cv::ParallelLoopBody
+{
+    public:
+        explicit ParallelBody(const Body &body) : body(body) {}
+        void operator()(const cv::Range &range) const { body(range); }
+
+    private:
+        const Body &body;
+};
+
+template<typename Body>
+void parallelFor(const cv::Range &range, const Body &body, double nstripes = -1.0)
+{
+    cv::parallel_for_(range, ParallelBody<Body>(body), nstripes);
+}
+
+// Bands of LEVEL_TILE_ROWS rows of all levels with the given rows
+int levelBands(const std::vector<int> &levelRows);
+// Level and rows of band i, largest level first
+void levelBand(const std::vector<int> &levelRows, int i, int &level, cv::Range &rows);
+
+// Runs body for every band of LEVEL_TILE_ROWS rows of every pyramid level,
+// all bands of all levels in 1 parallel loop. Level 0 is split into many
+// bands, small levels are 1 band each, so no level ends up as a long serial
+// tail. Bands are handed out largest level first to the idle threads of
+// OpenCV's process wide thread pool, which all camera and video tabs share.
+// A call while the pool is busy with another tab runs in the calling thread
+// instead of adding threads. Bands have to be independent of each other.
+template<typename Body>
+void parallelForLevels(const std::vector<int> &levelRows, const Body &body)
+{
+    CV_Assert(LEVEL_TILE_ROWS > 0);
+    const int bands = levelBands(levelRows);
+    if(bands == 0)
+        return;
+
+    // 1 stripe per band, so the pool balances the bands between its threads
+    parallelFor(cv::Range(0, bands), [&](const cv::Range &range) {
+        int level;
+        cv::Range rows;
+        for (int i = range.start; i < range.end; ++i) {
+            levelBand(levelRows, i, level, rows);
+            body(level, rows);
+        }
+    }, (double)bands);
+}
+
+// Scratch row of at least size floats of the calling thread, on a buffer
+// that only grows. Each slot can be used by 1 row at a time.
+float *rowScratch(int slot, size_t size);
+
+#endif // PARALLELLEVELS_H
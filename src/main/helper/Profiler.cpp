@@ -0,0 +1,313 @@
+/************************************************************************************/
+/* An OpenCV/Qt based realtime application to magnify motion and color              */
+/* Copyright (C) 2015  Jens Schindel <kontakt@jens-schindel.de>                     */
+/*                                                                                  */
+/* Based on the work of                                                             */
+/*      Joseph Pan      <https://github.com/wzpan/QtEVM>                            */
+/*      Nick D'Ademo    <https://github.com/nickdademo/qt-opencv-multithreaded>     */
+/*                                                                                  */
+/* Realtime-Video-Magnification->Profiler.cpp                                       */
+/*                                                                                  */
+/* This program is free software: you can redistribute it and/or modify             */
+/* it under the terms of the GNU General Public License as published by             */
+/* the Free Software Foundation, either version 3 of the License, or                */
+/* (at your option) any later version.                                              */
+/*                                                                                  */
+/* This program is distributed in the hope that it will be useful,                  */
+/* but WITHOUT ANY WARRANTY; without even the implied warranty of                   */
+/* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                    */
+/* GNU General Public License for more details.                                     */
+/*                                                                                  */
+/* You should have received a copy of the GNU General Public License                */
+/* along with this program.  If not, see <http://www.gnu.org/licenses/>.            */
+/************************************************************************************/
+
+#include "main/helper/Profiler.h"
+
+// Qt
+#include <QtCore/QJsonArray>
+#include <QtCore/QJsonDocument>
+#include <QtCore/QJsonObject>
+// C++
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+namespace {
+
+int log2Floor(quint64 value)
+{
+    int exponent = 0;
+    while(value >>= 1)
+        exponent++;
+    return exponent;
+}
+
+// 0..3 exact, then 4 buckets per power of 2
+int bucketOf(qint64 value)
+{
+    if(value < 4)
+        return value < 0 ? 0 : (int)value;
+    const int exponent = log2Floor(value);
+    return 4*(exponent-1) + (int)((value >> (exponent-2)) & 3);
+}
+
+quint64 bucketUpper(int bucket)
+{
+    if(bucket < 4)
+        return bucket;
+    const int exponent = bucket/4 + 1;
+    return ((quint64)(4 + bucket%4 + 1) << (exponent-2)) - 1;
+}
+
+}
+
+Profiler::Profiler()
+{
+    histograms = new Histogram[PROFILER_MAX_STAGES*PROFILER_THREADS];
+    trace = new TraceEvent[PROFILER_TRACE_EVENTS];
+    for(int i = 0; i < PROFILER_MAX_STAGES; i++) {
+        names[i].store(0);
+        kinds[i].store(Span);
+    }
+    for(int i = 0; i < PROFILER_TRACE_EVENTS; i++)
+        trace[i].stage.store(-1);
+    traceHead.store(0);
+    reset();
+}
+
+Profiler::~Profiler()
+{
+    delete[] histograms;
+    delete[] trace;
+}
+
+qint64 Profiler::now()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Threads are numbered in order of their first sample, threads beyond
+// PROFILER_THREADS share histograms
+int Profiler::threadIndex()
+{
+    static std::atomic<int> nextThread(0);
+    static thread_local int thread = nextThread++;
+    return thread % PROFILER_THREADS;
+}
+
+// Finds or registers stage without locking, -1 if there is no room left
+int Profiler::stageIndex(const char *stage, Kind kind)
+{
+    for(int i = 0; i < PROFILER_MAX_STAGES; i++) {
+        const char *known = names[i].load(std::memory_order_acquire);
+        if(!known && names[i].compare_exchange_strong(known, stage, std::memory_order_acq_rel)) {
+            kinds[i].store(kind, std::memory_order_relaxed);
+            return i;
+        }
+        if(known == stage || std::strcmp(known, stage) == 0)
+            return i;
+    }
+    return -1;
+}
+
+Profiler::Histogram &Profiler::histogram(int stage, int thread)
+{
+    return histograms[stage*PROFILER_THREADS + thread];
+}
+
+void Profiler::add(int stage, qint64 start, qint64 value)
+{
+    if(stage < 0)
+        return;
+    const int thread = threadIndex();
+    Histogram &h = histogram(stage, thread);
+    h.buckets[bucketOf(value)].fetch_add(1, std::memory_order_relaxed);
+    h.count.fetch_add(1, std::memory_order_relaxed);
+    h.total.fetch_add(value, std::memory_order_relaxed);
+    qint64 max = h.max.load(std::memory_order_relaxed);
+    while(value > max && !h.max.compare_exchange_weak(max, value, std::memory_order_relaxed)) {}
+
+    // Overwrites the oldest event, a dump running meanwhile may read it half written
+    TraceEvent &event = trace[traceHead.fetch_add(1, std::memory_order_relaxed) % PROFILER_TRACE_EVENTS];
+    event.thread.store(thread, std::memory_order_relaxed);
+    event.start.store(start, std::memory_order_relaxed);
+    event.value.store(value, std::memory_order_relaxed);
+    event.stage.store(stage, std::memory_order_release);
+}
+
+void Profiler::addSpan(const char *stage, qint64 start, qint64 nsecs)
+{
+    add(stageIndex(stage, Span), start, nsecs);
+}
+
+void Profiler::addValue(const char *stage, qint64 value)
+{
+    add(stageIndex(stage, Value), now(), value);
+}
+
+void Profiler::reset()
+{
+    for(int i = 0; i < PROFILER_MAX_STAGES*PROFILER_THREADS; i++) {
+        Histogram &h = histograms[i];
+        for(int b = 0; b < Buckets; b++)
+            h.buckets[b].store(0, std::memory_order_relaxed);
+        h.count.store(0, std::memory_order_relaxed);
+        h.total.store(0, std::memory_order_relaxed);
+        h.max.store(0, std::memory_order_relaxed);
+    }
+}
+
+int Profiler::stages()
+{
+    int n = 0;
+    while(n < PROFILER_MAX_STAGES && names[n].load(std::memory_order_acquire))
+        n++;
+    return n;
+}
+
+const char *Profiler::name(int stage)
+{
+    return names[stage].load(std::memory_order_acquire);
+}
+
+Profiler::Kind Profiler::kind(int stage)
+{
+    return (Kind)kinds[stage].load(std::memory_order_relaxed);
+}
+
+ProfileStats Profiler::stats(int stage, int thread)
+{
+    ProfileStats stats;
+    stats.count = 0;
+    stats.total = 0;
+    stats.max = 0;
+    quint64 buckets[Buckets] = {};
+    for(int t = 0; t < PROFILER_THREADS; t++) {
+        if(thread >= 0 && t != thread)
+            continue;
+        Histogram &h = histogram(stage, t);
+        for(int b = 0; b < Buckets; b++)
+            buckets[b] += h.buckets[b].load(std::memory_order_relaxed);
+        stats.count += h.count.load(std::memory_order_relaxed);
+        stats.total += h.total.load(std::memory_order_relaxed);
+        stats.max = std::max(stats.max, h.max.load(std::memory_order_relaxed));
+    }
+
+    // Upper bound of the bucket holding the percentile
+    stats.p50 = 0;
+    stats.p99 = 0;
+    quint64 sum = 0;
+    const quint64 n50 = (stats.count + 1)/2;
+    const quint64 n99 = stats.count - stats.count/100;
+    for(int b = 0; b < Buckets && sum < n99; b++) {
+        const bool below50 = sum < n50;
+        sum += buckets[b];
+        const qint64 upper = (qint64)std::min(bucketUpper(b), (quint64)stats.max);
+        if(below50 && sum >= n50)
+            stats.p50 = upper;
+        if(sum >= n99)
+            stats.p99 = upper;
+    }
+    return stats;
+}
+
+QString Profiler::summary()
+{
+    QString text;
+    for(int i = 0; i < stages(); i++) {
+        const ProfileStats s = stats(i);
+        if(s.count == 0)
+            continue;
+        if(!text.isEmpty())
+            text += "\n";
+        if(kind(i) == Span)
+            text += QString("%1: p50 %2 ms, p99 %3 ms, max %4 ms").arg(name(i))
+                    .arg(s.p50/1e6, 0, 'f', 2).arg(s.p99/1e6, 0, 'f', 2).arg(s.max/1e6, 0, 'f', 2);
+        else
+            text += QString("%1: p50 %2, p99 %3, max %4").arg(name(i)).arg(s.p50).arg(s.p99).arg(s.max);
+    }
+    return text;
+}
+
+QByteArray Profiler::toJson()
+{
+    QJsonArray stageArray;
+    for(int i = 0; i < stages(); i++) {
+        QJsonArray threadArray;
+        for(int t = 0; t < PROFILER_THREADS; t++) {
+            const ProfileStats s = stats(i, t);
+            if(s.count == 0)
+                continue;
+            QJsonObject thread;
+            thread.insert("thread", t);
+            thread.insert("count", (double)s.count);
+            thread.insert("p50", (double)s.p50);
+            thread.insert("p99", (double)s.p99);
+            thread.insert("max", (double)s.max);
+            threadArray.append(thread);
+        }
+        const ProfileStats s = stats(i);
+        QJsonObject stage;
+        stage.insert("name", QString(name(i)));
+        stage.insert("unit", QString(kind(i) == Span ? "ns" : "value"));
+        stage.insert("count", (double)s.count);
+        stage.insert("total", (double)s.total);
+        stage.insert("p50", (double)s.p50);
+        stage.insert("p99", (double)s.p99);
+        stage.insert("max", (double)s.max);
+        stage.insert("threads", threadArray);
+        stageArray.append(stage);
+    }
+    QJsonObject root;
+    root.insert("stages", stageArray);
+    return QJsonDocument(root).toJson();
+}
+
+QByteArray Profiler::toChromeTrace()
+{
+    QJsonArray events;
+    const qint64 head = traceHead.load(std::memory_order_acquire);
+    for(qint64 i = std::max(head - PROFILER_TRACE_EVENTS, (qint64)0); i < head; i++) {
+        const TraceEvent &event = trace[i % PROFILER_TRACE_EVENTS];
+        const int stage = event.stage.load(std::memory_order_acquire);
+        if(stage < 0)
+            continue;
+        QJsonObject e;
+        e.insert("name", QString(name(stage)));
+        e.insert("pid", 1);
+        e.insert("tid", event.thread.load(std::memory_order_relaxed));
+        // Timestamps in us
+        e.insert("ts", event.start.load(std::memory_order_relaxed)/1000.0);
+        if(kind(stage) == Span) {
+            e.insert("ph", QString("X"));
+            e.insert("dur", event.value.load(std::memory_order_relaxed)/1000.0);
+        }
+        else {
+            QJsonObject args;
+            args.insert("value", (double)event.value.load(std::memory_order_relaxed));
+            e.insert("ph", QString("C"));
+            e.insert("args", args);
+        }
+        events.append(e);
+    }
+    QJsonObject root;
+    root.insert("traceEvents", events);
+    root.insert("displayTimeUnit", QString("ms"));
+    return QJsonDocument(root).toJson(QJsonDocument::Compact);
+}
+
+StageClock::StageClock(Profiler *profiler) : profiler(profiler)
+{
+    last = profiler ? Profiler::now() : 0;
+}
+
+void StageClock::lap(const char *stage)
+{
+    if(profiler) {
+        const qint64 end = Profiler::now();
+        profiler->addSpan(stage, last, end - last);
+        last = end;
+    }
+}
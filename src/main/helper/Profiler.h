@@ -0,0 +1,122 @@
+/************************************************************************************/
+/* An OpenCV/Qt based realtime application to magnify motion and color              */
+/* Copyright (C) 2015  Jens Schindel <kontakt@jens-schindel.de>                     */
+/*                                                                                  */
+/* Based on the work of                                                             */
+/*      Joseph Pan      <https://github.com/wzpan/QtEVM>                            */
+/*      Nick D'Ademo    <https://github.com/nickdademo/qt-opencv-multithreaded>     */
+/*                                                                                  */
+/* Realtime-Video-Magnification->Profiler.h                                         */
+/*                                                                                  */
+/* This program is free software: you can redistribute it and/or modify             */
+/* it under the terms of the GNU General Public License as published by             */
+/* the Free Software Foundation, either version 3 of the License, or                */
+/* (at your option) any later version.                                              */
+/*                                                                                  */
+/* This program is distributed in the hope that it will be useful,                  */
+/* but WITHOUT ANY WARRANTY; without even the implied warranty of                   */
+/* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                    */
+/* GNU General Public License for more details.                                     */
+/*                                                                                  */
+/* You should have received a copy of the GNU General Public License                */
+/* along with this program.  If not, see <http://www.gnu.org/licenses/>.            */
+/************************************************************************************/
+
+#ifndef PROFILER_H
+#define PROFILER_H
+
+// Qt
+#include <QtCore/QByteArray>
+#include <QtCore/QString>
+// C++
+#include <atomic>
+// Local
+#include "main/other/Config.h"
+
+// Statistics of 1 stage, in ns for spans
+struct ProfileStats {
+    qint64 count;
+    qint64 total;
+    qint64 p50;
+    qint64 p99;
+    qint64 max;
+};
+
+// Histograms of the time spent in the stages of the magnification and of
+// values like queue depths. Stages are named by string literals and kept in
+// order of their first use. Every thread adds to its own histograms with
+// relaxed atomics, so adding takes no lock and doesn't allocate. Buckets
+// are 4 per power of 2, percentiles are exact to 25%.
+// The last PROFILER_TRACE_EVENTS samples are kept for a Chrome trace.
+class Profiler
+{
+    public:
+        enum Kind {
+            Span,   // Time in ns
+            Value   // Any other value, e.g. a queue depth
+        };
+        Profiler();
+        ~Profiler();
+        // ns of a monotonic clock shared by all profilers
+        static qint64 now();
+        // Adds a span of stage that started at start and took nsecs
+        void addSpan(const char *stage, qint64 start, qint64 nsecs);
+        void addValue(const char *stage, qint64 value);
+        // Zeroes every stage, samples added meanwhile may get lost
+        void reset();
+        int stages();
+        const char *name(int stage);
+        Kind kind(int stage);
+        // Merged statistics of all threads, or of the thread with index thread
+        ProfileStats stats(int stage, int thread = -1);
+        // 1 line per stage with p50/p99/max
+        QString summary();
+        // Statistics of every stage and thread
+        QByteArray toJson();
+        // Trace Event Format, for chrome://tracing or Perfetto
+        QByteArray toChromeTrace();
+
+    private:
+        Profiler(const Profiler&);
+        Profiler& operator=(const Profiler&);
+
+        enum { Buckets = 252 };
+        struct Histogram {
+            std::atomic<quint32> buckets[Buckets];
+            std::atomic<qint64> count;
+            std::atomic<qint64> total;
+            std::atomic<qint64> max;
+        };
+        struct TraceEvent {
+            std::atomic<int> stage;
+            std::atomic<int> thread;
+            std::atomic<qint64> start;
+            std::atomic<qint64> value;
+        };
+        static int threadIndex();
+        int stageIndex(const char *stage, Kind kind);
+        void add(int stage, qint64 start, qint64 value);
+        Histogram &histogram(int stage, int thread);
+
+        std::atomic<const char*> names[PROFILER_MAX_STAGES];
+        std::atomic<int> kinds[PROFILER_MAX_STAGES];
+        // [stage*PROFILER_THREADS + thread]
+        Histogram *histograms;
+        TraceEvent *trace;
+        std::atomic<qint64> traceHead;
+};
+
+// Times consecutive stages of 1 thread, lap() adds the time since the
+// last lap to stage. Does nothing without a profiler.
+class StageClock
+{
+    public:
+        StageClock(Profiler *profiler);
+        void lap(const char *stage);
+
+    private:
+        Profiler *profiler;
+        qint64 last;
+};
+
+#endif // PROFILER_H
@@ -33,7 +33,9 @@ Magnificator::Magnificator(std::vector<Mat> *pBuffer,
     processingBuffer(pBuffer),
     imgProcFlags(imageProcFlags),
     imgProcSettings(imageProcSettings),
-    currentFrame(0)
+    currentFrame(0),
+    outputPool(MAGNIFIED_POOL_MAX_SIZE),
+    profiler(0)
 {
     levels = 4;
     exaggeration_factor = 2.f;
@@ -76,50 +78,62 @@ void Magnificator:: colorMagnify() {
     //levels = DEFAULT_COL_MAG_LEVELS;
     levels = imgProcSettings->levels;
     Mat input, output, color, filteredFrame, downSampledFrame, filteredMat;
-    std::vector<Mat> inputFrames, inputPyramid;
+    std::vector<Mat> inputFrames;
+    StageClock clock(profiler);
 
     int offset = 0;
     int pChannels;
 
     // Process every frame in buffer that wasn't magnified yet
     while(currentFrame < pBufferElements) {
-        // Grab oldest frame from processingBuffer and delete it to save memory
-        input = processingBuffer->front().clone();
-        processingBuffer->erase(processingBuffer->begin());
-
-        // Convert input image to 32bit float
-        pChannels = input.channels();
+        // Convert oldest frame from processingBuffer to 32bit float and delete it to save memory
+        const Mat &frame = processingBuffer->front();
+        pChannels = frame.channels();
+        // New image, the last one is kept in inputFrames
+        input = Mat();
         if(!(imgProcFlags->grayscaleOn || pChannels <= 2))
-            input.convertTo(input, CV_32FC1);
+            frame.convertTo(input, CV_32FC1);
         else
-            input.convertTo(input, CV_32FC3);
+            frame.convertTo(input, CV_32FC3);
+        processingBuffer->erase(processingBuffer->begin());
 
         // Save input frame to add motion later
         inputFrames.push_back(input);
 
         /* 1. SPATIAL FILTER, BUILD GAUSS PYRAMID */
-        buildGaussPyrFromImg(input, levels, inputPyramid);
+        buildGaussPyrFromImg(input, levels, workspace);
 
-        /* 2. CONCAT EVERY SMALLEST FRAME FROM PYRAMID IN ONE LARGE MAT, 1COL = 1FRAME */
-        downSampledFrame = inputPyramid.at(levels-1);
-        img2tempMat(downSampledFrame, downSampledMat, getOptimalBufferSize(imgProcSettings->framerate));
+        /* 2. WRITE EVERY SMALLEST FRAME FROM PYRAMID IN TEMPORAL RING BUFFER, 1COL = 1FRAME */
+        downSampledFrame = workspace.down.at(levels-1);
+        bandpassFilter.slide(temporalBuffer, downSampledFrame);
+        temporalBuffer.push(downSampledFrame, getOptimalBufferSize(imgProcSettings->framerate));
 
         // Save how many frames we've currently downsampled
         ++currentFrame;
         ++offset;
     }
+    clock.lap("color.pyramid");
 
     /* 3. TEMPORAL FILTER */
-    idealFilter(downSampledMat, filteredMat, imgProcSettings->coLow, imgProcSettings->coHigh, imgProcSettings->framerate);
+    // Full window: update only the bins in the passband and filter the new frames,
+    // else filter whole window. Filter is circular, so the ring buffer can be filtered in storage order
+    int firstFrame = currentFrame-offset;
+    bool sliding = bandpassFilter.filter(temporalBuffer, filteredMat, firstFrame, currentFrame, bandpassMask,
+                                         imgProcSettings->coLow, imgProcSettings->coHigh, imgProcSettings->framerate);
+    if(!sliding)
+        idealFilter(temporalBuffer.window(), filteredMat, bandpassMask, imgProcSettings->coLow, imgProcSettings->coHigh, imgProcSettings->framerate);
+    clock.lap("color.temporal");
 
     /* 4. AMPLIFY */
     amplifyGaussian(filteredMat, filteredMat);
+    clock.lap("color.amplify");
 
     // Add amplified image (color) to every frame
-    for (int i = currentFrame-offset; i < currentFrame; ++i) {
+    for (int i = firstFrame; i < currentFrame; ++i) {
 
         /* 5. DE-CONCAT 1COL TO DOWNSAMPLED COLOR IMAGE */
-        tempMat2img(filteredMat, i, downSampledFrame.size(), filteredFrame);
+        int column = sliding ? i-firstFrame : temporalBuffer.column(i);
+        tempMat2img(filteredMat, column, downSampledFrame.size(), filteredFrame);
 
         /* 6. RECONSTRUCT COLOR IMAGE FROM PYRAMID */
         buildImgFromGaussPyr(filteredFrame, levels, color, input.size());
@@ -141,6 +155,7 @@ void Magnificator:: colorMagnify() {
         // Delete the currently processed input image
         inputFrames.erase(inputFrames.begin());
     }
+    clock.lap("color.reconstruct");
 }
 
 void Magnificator::laplaceMagnify() {
@@ -151,85 +166,24 @@ void Magnificator::laplaceMagnify() {
     // Number of levels in pyramid
 //    levels = DEFAULT_LAP_MAG_LEVELS;
     levels = imgProcSettings->levels;
-
-    Mat input, output, motion;
-    vector<Mat> inputPyramid;
-    int pChannels;
+    StageClock clock(profiler);
 
     // Process every frame in buffer that wasn't magnified yet
     while(currentFrame < pBufferElements) {
-        // Grab oldest frame from processingBuffer and delete it to save memory
-        input = processingBuffer->front().clone();
+        // Convert oldest frame from processingBuffer to 32bit float into the buffers of the decomposition
+        convertInput(processingBuffer->front(), false, spatialFrame);
+
+        // Delete it to save memory
         if(currentFrame > 0)
             processingBuffer->erase(processingBuffer->begin());
-
-        // Convert input image to 32bit float
-        pChannels = input.channels();
-        if(!(imgProcFlags->grayscaleOn || pChannels <= 2)) {
-            // Convert color images to YCrCb
-            input.convertTo(input, CV_32FC3, 1.0/255.0f);
-            cvtColor(input, input, cv::COLOR_BGR2YCrCb);
-        }
-        else
-            input.convertTo(input, CV_32FC1, 1.0/255.0f);
+        clock.lap("laplace.convert");
 
         /* 1. SPATIAL FILTER, BUILD LAPLACE PYRAMID */
-        buildLaplacePyrFromImg(input, levels, inputPyramid);
-
-        // If first frame ever, save unfiltered pyramid
-        if(currentFrame == 0) {
-            lowpassHi = inputPyramid;
-            lowpassLo = inputPyramid;
-            motionPyramid = inputPyramid;
-        } else {
-            /* 2. TEMPORAL FILTER EVERY LEVEL OF LAPLACE PYRAMID */
-            for (int curLevel = 0; curLevel < levels; ++curLevel) {
-                iirFilter(inputPyramid.at(curLevel), motionPyramid.at(curLevel), lowpassHi.at(curLevel), lowpassLo.at(curLevel),
-                          imgProcSettings->coLow, imgProcSettings->coHigh);
-            }
-
-            int w = input.size().width;
-            int h = input.size().height;
+        buildLaplacePyrFromImg(spatialFrame.workspace.input, levels, spatialFrame.workspace);
+        clock.lap("laplace.pyramid");
 
-            // Amplification variable
-            delta = imgProcSettings->coWavelength / (8.0 * (1.0 + imgProcSettings->amplification));
-
-            // Amplification Booster for better visualization
-            exaggeration_factor = DEFAULT_LAP_MAG_EXAGGERATION;
-
-            // compute representative wavelength, lambda
-            // reduces for every pyramid level
-            lambda = sqrt(w*w + h*h)/3.0;
-
-            /* 3. AMPLIFY EVERY LEVEL OF LAPLACE PYRAMID */
-            for (int curLevel = levels; curLevel >= 0; --curLevel) {
-                amplifyLaplacian(motionPyramid.at(curLevel), motionPyramid.at(curLevel), curLevel);
-                lambda /= 2.0;
-            }
-        }
-
-        /* 4. RECONSTRUCT MOTION IMAGE FROM PYRAMID */
-        buildImgFromLaplacePyr(motionPyramid, levels, motion);
-
-        /* 5. ATTENUATE (if not grayscale) */
-        attenuate(motion, motion);
-        /* 6. ADD MOTION TO ORIGINAL IMAGE */
-        if(currentFrame > 0)
-            output = input+motion;
-        else
-            output = input;
-
-        // Scale output image an convert back to 8bit unsigned
-        if(!(imgProcFlags->grayscaleOn || pChannels <= 2)) {
-            // Convert YCrCb image back to BGR
-            cvtColor(output, output, cv::COLOR_YCrCb2BGR);
-            output.convertTo(output, CV_8UC3, 255.0, 1.0/255.0);
-        }
-        else
-            output.convertTo(output, CV_8UC1, 255.0, 1.0/255.0);
-
-        // Fill internal buffer with magnified image
-        magnifiedBuffer.push_back(output);
+        /* 2.-5. */
+        filterLaplace(spatialFrame, currentFrame == 0, clock);
         ++currentFrame;
     }
 }
@@ -242,116 +196,275 @@ void Magnificator::rieszMagnify()
         return;
     // Number of levels in pyramid
     levels = imgProcSettings->levels;
-
-    Mat buffer_in, input, magnified, output;
-    std::vector<cv::Mat> channels;
-    int pChannels;
-    static const double PI_PERCENT = M_PI / 100.0;
+    StageClock clock(profiler);
 
     // Process every frame in buffer that wasn't magnified yet
     while(currentFrame < pBufferElements)
     {
-        // Grab oldest frame from processingBuffer and delete it to save memory
-        buffer_in = processingBuffer->front().clone();
+        // Convert oldest frame from processingBuffer to 32bit float into the buffers of the decomposition
+        convertInput(processingBuffer->front(), true, spatialFrame);
+
+        // Delete it to save memory
         if(currentFrame > 0)
         {
             processingBuffer->erase(processingBuffer->begin());
         }
+        clock.lap("riesz.convert");
 
-        // Convert input image to 32bit float
-        pChannels = buffer_in.channels();
-        if(!(imgProcFlags->grayscaleOn || pChannels <= 2))
-        {
-            // Convert color images to YCrCb
-            buffer_in.convertTo(buffer_in, CV_32FC3, 1.0/255.0);
-            cvtColor(buffer_in, buffer_in, COLOR_BGR2YCrCb);
-            cv::split(buffer_in, channels);
-            input = channels[0];
+        /* 1. BUILD RIESZ PYRAMID */
+        /* 2. UNWRAPE PHASE TO GET HORIZ&VERTICAL / SIN&COS */
+        // Against the frame before, which the pyramid of the filter holds
+        buildRieszPyramid(spatialFrame, curPyr.get());
+        clock.lap("riesz.pyramid");
+
+        /* 3.-6. */
+        filterRiesz(spatialFrame, currentFrame == 0, clock);
+        ++currentFrame;
+    }
+}
+
+void Magnificator::decompose(const Mat &frame, SpatialFrame &spatial)
+{
+    StageClock clock(profiler);
+    // Laplace before Riesz, like the callers of laplaceMagnify() and rieszMagnify()
+    const bool riesz = !imgProcFlags->laplaceMagnifyOn;
+    convertInput(frame, riesz, spatial);
+    clock.lap(riesz ? "riesz.convert" : "laplace.convert");
+
+    if(riesz) {
+        buildRieszPyramid(spatial, priorPyr.get());
+        // The filter swaps the frame out of spatial, so the prior of the next frame is a copy
+        if(!priorPyr)
+            priorPyr = std::make_shared<RieszPyramid>();
+        priorPyr->copyFrames(spatial.pyramid);
+        clock.lap("riesz.pyramid");
+    }
+    else {
+        buildLaplacePyrFromImg(spatial.workspace.input, spatial.levels, spatial.workspace);
+        clock.lap("laplace.pyramid");
+    }
+}
+
+void Magnificator::magnify(SpatialFrame &spatial)
+{
+    StageClock clock(profiler);
+    if(spatial.riesz)
+        filterRiesz(spatial, false, clock);
+    else
+        filterLaplace(spatial, lowpassHi.empty(), clock);
+}
+
+void Magnificator::convertInput(const Mat &frame, bool riesz, SpatialFrame &spatial)
+{
+    PyramidWorkspace &ws = spatial.workspace;
+    spatial.riesz = riesz;
+    spatial.levels = imgProcSettings->levels;
+    spatial.color = !(imgProcFlags->grayscaleOn || frame.channels() <= 2);
+    if(spatial.color) {
+        // Convert color images to YCrCb
+        frame.convertTo(ws.scratch, CV_32FC3, 1.0/255.0);
+        cvtColor(ws.scratch, ws.input, COLOR_BGR2YCrCb);
+    }
+    else
+        frame.convertTo(ws.input, CV_32FC1, 1.0/255.0);
+
+    if(!riesz)
+        return;
+    // The Riesz pyramid is built from the Y channel only
+    if(spatial.color) {
+        // Pointer version, the vector version allocates a vector of its own every call
+        spatial.channels.resize(3);
+        cv::split(ws.input, spatial.channels.data());
+        spatial.luma = spatial.channels[0];
+    }
+    else
+        spatial.luma = ws.input;
+}
+
+void Magnificator::buildRieszPyramid(SpatialFrame &spatial, const RieszPyramid *prior)
+{
+    RieszPyramid &pyramid = spatial.pyramid;
+    // Decompose the pyramid filters again if their tolerance was changed
+    if(pyramid.filterTolerance() != imgProcSettings->rieszFilterTolerance)
+        pyramid.setFilterTolerance(imgProcSettings->rieszFilterTolerance);
+    if(pyramid.numLevels != spatial.levels)
+        pyramid.setLevels(spatial.levels);
+
+    // Both done in parallel bands of every level
+    spatial.unwrapped = prior && prior->numLevels == spatial.levels;
+    if(spatial.unwrapped)
+        pyramid.buildPyramid(spatial.luma, *prior);
+    else
+        pyramid.buildPyramid(spatial.luma);
+}
+
+void Magnificator::filterLaplace(SpatialFrame &spatial, bool first, StageClock &clock)
+{
+    levels = spatial.levels;
+    Mat motion;
+    // Input image and pyramid are buffers of the decomposition, the reconstruction reuses them too
+    PyramidWorkspace &ws = spatial.workspace;
+    const Mat &input = ws.input;
+    const vector<Mat> &inputPyramid = ws.pyramid;
+
+    // If first frame ever, save unfiltered pyramid.
+    // Deep copies, iirFilter updates the lowpass pyramids in place
+    if(first) {
+        lowpassHi.resize(inputPyramid.size());
+        lowpassLo.resize(inputPyramid.size());
+        motionPyramid.resize(inputPyramid.size());
+        for (size_t curLevel = 0; curLevel < inputPyramid.size(); ++curLevel) {
+            inputPyramid.at(curLevel).copyTo(lowpassHi.at(curLevel));
+            inputPyramid.at(curLevel).copyTo(lowpassLo.at(curLevel));
+            inputPyramid.at(curLevel).copyTo(motionPyramid.at(curLevel));
         }
-        else
-        {
-            buffer_in.convertTo(input, CV_32FC1, 1.0/255.0);
+    } else {
+        /* 2. TEMPORAL FILTER EVERY LEVEL OF LAPLACE PYRAMID */
+        // Pixels are filtered independently, so all levels run in parallel bands of rows
+        levelRows.resize(levels);
+        for (int curLevel = 0; curLevel < levels; ++curLevel)
+            levelRows[curLevel] = inputPyramid.at(curLevel).rows;
+        parallelForLevels(levelRows, [&](int curLevel, const Range &rows) {
+            Mat filtered = motionPyramid.at(curLevel).rowRange(rows);
+            Mat hi = lowpassHi.at(curLevel).rowRange(rows);
+            Mat lo = lowpassLo.at(curLevel).rowRange(rows);
+            iirFilter(inputPyramid.at(curLevel).rowRange(rows), filtered, hi, lo,
+                      imgProcSettings->coLow, imgProcSettings->coHigh);
+        });
+        clock.lap("laplace.temporal");
+
+        int w = input.size().width;
+        int h = input.size().height;
+
+        // Amplification variable
+        delta = imgProcSettings->coWavelength / (8.0 * (1.0 + imgProcSettings->amplification));
+
+        // Amplification Booster for better visualization
+        exaggeration_factor = DEFAULT_LAP_MAG_EXAGGERATION;
+
+        // compute representative wavelength, lambda
+        // reduces for every pyramid level
+        lambda = sqrt(w*w + h*h)/3.0;
+
+        /* 3. AMPLIFICATION OF EVERY LEVEL OF LAPLACE PYRAMID */
+        motionGains.resize(levels+1);
+        for (int curLevel = levels; curLevel >= 0; --curLevel) {
+            motionGains.at(curLevel) = laplacianGain(curLevel);
+            lambda /= 2.0;
         }
 
-        // If first frame ever, init pointer and init class
-        if( !(curPyr && oldPyr && loCutoff && hiCutoff) )
-        {
-            curPyr.reset();
-            oldPyr.reset();
-            loCutoff.reset();
-            hiCutoff.reset();
-            // Pyramids
-            curPyr = std::shared_ptr<RieszPyramid>(new RieszPyramid());
-            oldPyr = std::shared_ptr<RieszPyramid>(new RieszPyramid());
-            curPyr->init(input, levels);
-            oldPyr->init(input, levels);
-            // Temporal Bandpass Filters, low and highpass (Butterworth)
-            loCutoff = std::shared_ptr<RieszTemporalFilter>(new RieszTemporalFilter(imgProcSettings->coLow, imgProcSettings->framerate));
-            hiCutoff = std::shared_ptr<RieszTemporalFilter>(new RieszTemporalFilter(imgProcSettings->coHigh, imgProcSettings->framerate));
-            loCutoff->computeCoefficients();
-            hiCutoff->computeCoefficients();
-        }
-        else
-        {
-            // Check if temporal filter setting was updated
-            // Update low and highpass butterworth filter coefficients if changed in GUI
-            if(loCutoff->itsFrequency != imgProcSettings->coLow)
-            {
-                loCutoff->updateFrequency(imgProcSettings->coLow);
-            }
-            if(hiCutoff->itsFrequency != imgProcSettings->coHigh)
-            {
-                hiCutoff->updateFrequency(imgProcSettings->coHigh);
-            }
+        /* 4. RECONSTRUCT AMPLIFIED MOTION IMAGE FROM PYRAMID */
+        buildImgFromLaplacePyr(motionPyramid, levels, motionGains, motion, ws);
+        clock.lap("laplace.amplify");
+    }
 
-            /* 1. BUILD RIESZ PYRAMID */
-            curPyr->buildPyramid(input);
-            /* 2. UNWRAPE PHASE TO GET HORIZ&VERTICAL / SIN&COS */
-            curPyr->unwrapOrientPhase(*oldPyr);
-            // 3. BANDPASS FILTER ON EACH LEVEL
-            for (int lvl = 0; lvl < curPyr->numLevels-1; ++lvl) {
-                loCutoff->pass(curPyr->pyrLevels[lvl].itsImagPass,
-                              curPyr->pyrLevels[lvl].itsPhase,
-                              oldPyr->pyrLevels[lvl].itsPhase);
-
-                hiCutoff->pass(curPyr->pyrLevels[lvl].itsRealPass,
-                              curPyr->pyrLevels[lvl].itsPhase,
-                              oldPyr->pyrLevels[lvl].itsPhase);
-            }
-            // Shift current to prior for next iteration
-            *oldPyr = *curPyr;
-            // 4. AMPLIFY MOTION
-            curPyr->amplify(imgProcSettings->amplification, imgProcSettings->coWavelength*PI_PERCENT);
-        }
+    /* 5. ATTENUATE (if not grayscale), ADD MOTION TO ORIGINAL IMAGE */
+    // Scale output image an convert back to 8bit unsigned, YCrCb images back to BGR
+    Mat &output = outputPool.acquire();
+    addMotion(input, first ? Mat() : motion, output, spatial.color);
+    clock.lap("laplace.output");
 
-        /* 6. ADD MOTION TO ORIGINAL IMAGE */
-        if(currentFrame > 0)
-        {
-            magnified = curPyr->collapsePyramid();
-        }
-        else
+    // Fill internal buffer with magnified image
+    magnifiedBuffer.push_back(output);
+}
+
+void Magnificator::filterRiesz(SpatialFrame &spatial, bool first, StageClock &clock)
+{
+    static const double PI_PERCENT = M_PI / 100.0;
+    levels = spatial.levels;
+    Mat magnified;
+
+    // If first frame ever, or the frame couldn't be unwrapped against the one before, init pointer and init class
+    if( !(curPyr && loCutoff && hiCutoff) || !spatial.unwrapped || curPyr->numLevels != levels )
+    {
+        curPyr.reset();
+        loCutoff.reset();
+        hiCutoff.reset();
+        // Pyramid of the filter
+        curPyr = std::shared_ptr<RieszPyramid>(new RieszPyramid());
+        curPyr->setFilterTolerance(imgProcSettings->rieszFilterTolerance);
+        curPyr->init(spatial.luma, levels);
+        // Temporal Bandpass Filters, low and highpass (Butterworth)
+        loCutoff = std::shared_ptr<RieszTemporalFilter>(new RieszTemporalFilter(imgProcSettings->coLow, imgProcSettings->framerate));
+        hiCutoff = std::shared_ptr<RieszTemporalFilter>(new RieszTemporalFilter(imgProcSettings->coHigh, imgProcSettings->framerate));
+        loCutoff->computeCoefficients();
+        hiCutoff->computeCoefficients();
+        first = true;
+    }
+    else
+    {
+        // Check if temporal filter setting was updated
+        // Update low and highpass butterworth filter coefficients if changed in GUI
+        if(loCutoff->itsFrequency != imgProcSettings->coLow)
         {
-            magnified = input;
+            loCutoff->updateFrequency(imgProcSettings->coLow);
         }
-
-        // Scale output image and convert back to 8bit unsigned
-        if(!(imgProcFlags->grayscaleOn || pChannels <= 2))
+        if(hiCutoff->itsFrequency != imgProcSettings->coHigh)
         {
-            // Convert YCrCb image back to BGR
-            channels[0] = magnified;
-            cv::merge(channels, output);
-            cvtColor(output, output, COLOR_YCrCb2BGR);
-            output.convertTo(output, CV_8UC3, 255.0, 1.0/255.0);
+            hiCutoff->updateFrequency(imgProcSettings->coHigh);
         }
-        else
+        // Decompose the collapse filters again if their tolerance was changed
+        if(curPyr->filterTolerance() != imgProcSettings->rieszFilterTolerance)
         {
-            magnified.convertTo(output, CV_8UC1, 255.0, 1.0/255.0);
+            curPyr->setFilterTolerance(imgProcSettings->rieszFilterTolerance);
         }
 
-        // Fill internal buffer with magnified image
-        magnifiedBuffer.push_back(output);
-        ++currentFrame;
+        // Shift the new frame into the filter pyramid, only the frame data is swapped,
+        // the filter state stays in curPyr. spatial gets the frame before, its phase is the prior.
+        curPyr->swapFrames(spatial.pyramid);
+        const RieszPyramid &oldPyr = spatial.pyramid;
+
+        // 3. BANDPASS FILTER ON EACH LEVEL, all levels in parallel bands of rows
+        levelRows.resize(curPyr->numLevels-1);
+        for (int lvl = 0; lvl < curPyr->numLevels-1; ++lvl)
+            levelRows[lvl] = curPyr->pyrLevels[lvl].itsLp.rows;
+        parallelForLevels(levelRows, [&](int lvl, const Range &rows) {
+            loCutoff->pass(curPyr->pyrLevels[lvl].itsImagPass,
+                          curPyr->pyrLevels[lvl].itsPhase,
+                          oldPyr.pyrLevels[lvl].itsPhase, rows);
+
+            hiCutoff->pass(curPyr->pyrLevels[lvl].itsRealPass,
+                          curPyr->pyrLevels[lvl].itsPhase,
+                          oldPyr.pyrLevels[lvl].itsPhase, rows);
+        });
+        clock.lap("riesz.temporal");
+        // 4. AMPLIFY MOTION (into separate images, curPyr stays the prior of the next frame)
+        curPyr->amplify(imgProcSettings->amplification, imgProcSettings->coWavelength*PI_PERCENT);
+        clock.lap("riesz.amplify");
+    }
+
+    /* 6. ADD MOTION TO ORIGINAL IMAGE */
+    if(!first)
+    {
+        magnified = curPyr->collapsePyramid();
+    }
+    else
+    {
+        magnified = spatial.luma;
     }
+
+    // Scale output image and convert back to 8bit unsigned
+    Mat &output = outputPool.acquire();
+    if(spatial.color)
+    {
+        // Convert YCrCb image back to BGR, the input buffers of the decomposition aren't needed anymore
+        PyramidWorkspace &ws = spatial.workspace;
+        rieszMerge.resize(3);
+        rieszMerge[0] = magnified;
+        rieszMerge[1] = spatial.channels[1];
+        rieszMerge[2] = spatial.channels[2];
+        cv::merge(rieszMerge.data(), rieszMerge.size(), ws.scratch);
+        cvtColor(ws.scratch, ws.input, COLOR_YCrCb2BGR);
+        ws.input.convertTo(output, CV_8UC3, 255.0, 1.0/255.0);
+    }
+    else
+    {
+        magnified.convertTo(output, CV_8UC1, 255.0, 1.0/255.0);
+    }
+    clock.lap("riesz.output");
+
+    // Fill internal buffer with magnified image
+    magnifiedBuffer.push_back(output);
 }
 
 ////////////////////////
@@ -370,8 +483,8 @@ Mat Magnificator::getFrameLast()
 
 Mat Magnificator::getFrameFirst()
 {
-    // Take oldest image
-    Mat img = this->magnifiedBuffer.front().clone();
+    // Take oldest image, it is deleted right after, so no copy is needed
+    Mat img = this->magnifiedBuffer.front();
     // Delete the oldest picture
     this->magnifiedBuffer.erase(magnifiedBuffer.begin());
     currentFrame = magnifiedBuffer.size();
@@ -412,9 +525,11 @@ void Magnificator::clearBuffer()
     this->lowpassHi.clear();
     this->lowpassLo.clear();
     this->motionPyramid.clear();
-    this->downSampledMat = Mat();
+    this->temporalBuffer.clear();
+    this->outputPool.clear();
+    this->bandpassFilter.clear();
     this->currentFrame = 0;
-    oldPyr.reset();
+    priorPyr.reset();
     curPyr.reset();
     loCutoff.reset();
     hiCutoff.reset();
@@ -422,6 +537,11 @@ void Magnificator::clearBuffer()
 
 
 
+void Magnificator::setProfiler(Profiler *profiler)
+{
+    this->profiler = profiler;
+}
+
 int Magnificator::getOptimalBufferSize(int fps)
 {
     // Calculate number of images needed to represent 2 seconds of film material
@@ -441,25 +561,53 @@ int Magnificator::getOptimalBufferSize(int fps)
 ////////////////////////
 ///Postprocessing //////
 ////////////////////////
-void Magnificator::amplifyLaplacian(const Mat &src, Mat &dst, int currentLevel)
+float Magnificator::laplacianGain(int currentLevel)
 {
     float currAlpha = (lambda/(delta*8.0) - 1.0) * exaggeration_factor;
     // Set lowpassed&downsampled image and difference image with highest resolution to 0,
     // amplify every other level
-    dst = (currentLevel == levels || currentLevel == 0) ? src * 0
-                                                        : src * std::min((float)imgProcSettings->amplification, currAlpha);
+    return (currentLevel == levels || currentLevel == 0) ? 0.0f
+                                                         : std::min((float)imgProcSettings->amplification, currAlpha);
 }
 
-void Magnificator::attenuate(const Mat &src, Mat &dst)
+void Magnificator::addMotion(const Mat &input, const Mat &motion, Mat &output, bool color)
 {
-    // Attenuate only if image is not grayscale
-    if(src.channels() > 2)
-    {
-        Mat planes[3];
-        split(src, planes);
-        planes[1] = planes[1] * imgProcSettings->chromAttenuation;
-        planes[2] = planes[2] * imgProcSettings->chromAttenuation;
-        merge(planes, 3, dst);
+    const int cn = input.channels();
+    const bool hasMotion = !motion.empty();
+    // Output is kept in magnifiedBuffer, a pooled image keeps its storage
+    output.create(input.size(), CV_MAKETYPE(CV_8U, cn));
+
+    // Same as convertTo(CV_8U, 255.0, 1.0/255.0)
+    const float scale = 255.0f;
+    const float shift = 1.0f/255.0f;
+    const float att = (float)imgProcSettings->chromAttenuation;
+
+    for (int y = 0; y < input.rows; ++y) {
+        const float *in = input.ptr<float>(y);
+        const float *m = hasMotion ? motion.ptr<float>(y) : 0;
+        uchar *out = output.ptr<uchar>(y);
+
+        if(color) {
+            for (int x = 0; x < input.cols*3; x += 3) {
+                float Y = in[x], Cr = in[x+1], Cb = in[x+2];
+                // Attenuate chroma of motion only
+                if(hasMotion) {
+                    Y  += m[x];
+                    Cr += att*m[x+1];
+                    Cb += att*m[x+2];
+                }
+                // YCrCb -> BGR, coefficients and delta of cvtColor() for float images
+                Cr -= 0.5f;
+                Cb -= 0.5f;
+                out[x]   = saturate_cast<uchar>((Y + 1.773f*Cb) * scale + shift);
+                out[x+1] = saturate_cast<uchar>((Y - 0.714f*Cr - 0.344f*Cb) * scale + shift);
+                out[x+2] = saturate_cast<uchar>((Y + 1.403f*Cr) * scale + shift);
+            }
+        }
+        else {
+            for (int x = 0; x < input.cols*cn; ++x)
+                out[x] = saturate_cast<uchar>((hasMotion ? in[x] + m[x] : in[x]) * scale + shift);
+        }
     }
 }
 
@@ -39,6 +39,9 @@
 #include "main/other/Structures.h"
 #include "main/other/Config.h"
 #include "main/magnification/RieszPyramid.h"
+#include "main/helper/FramePool.h"
+#include "main/helper/ParallelLevels.h"
+#include "main/helper/Profiler.h"
 // C++
 #include "cmath"
 #include "math.h"
@@ -47,6 +50,40 @@
 
 using namespace cv;
 using namespace std;
+/*!
+ * \brief The SpatialFrame struct Spatial decomposition of 1 frame for the Laplace or Riesz magnification.
+ *  Magnificator::decompose() builds it without the temporal state, so a pipeline can decompose the next
+ *  frame while Magnificator::magnify() filters this one. Its buffers are reused for every frame.
+ */
+struct SpatialFrame
+{
+    SpatialFrame() : riesz(false), color(false), unwrapped(false), levels(0) {}
+    /*!
+     * \brief workspace Input converted to 32bit float (YCrCb if it has color) in workspace.input,
+     *  Laplace pyramid in workspace.pyramid. The magnification reconstructs its output in it too.
+     */
+    PyramidWorkspace workspace;
+    /*!
+     * \brief channels (Riesz) YCrCb channels of the input, the merge replaces Y by the collapsed pyramid.
+     */
+    vector<Mat> channels;
+    /*!
+     * \brief luma (Riesz) Y channel or grayscale input, the pyramid is built from it.
+     */
+    Mat luma;
+    /*!
+     * \brief pyramid (Riesz) Riesz pyramid of luma. Once magnified, it holds the frame before.
+     */
+    RieszPyramid pyramid;
+    bool riesz;
+    bool color;
+    /*!
+     * \brief unwrapped (Riesz) True if the phase is unwrapped against the frame decomposed before.
+     */
+    bool unwrapped;
+    int levels;
+};
+
 /*!
  * \brief The Magnificator class Handles the motion and color magnification. The class also holds
  *  a Buffer with magnified images and variables describing the inner status of the magnification
@@ -92,6 +129,20 @@ public:
      * \brief waveletMagnify Haar Wavelet magnification. You can find detailed step by step description in .cpp
      */
     void rieszMagnify();
+    /*!
+     * \brief decompose Spatial part of laplaceMagnify() or rieszMagnify() (if the Laplace flag is off) for
+     *  1 frame: conversion to float and the pyramid, the Riesz phase unwrapped against the frame decomposed
+     *  before. It doesn't touch the temporal state, so a pipeline decomposes on a Magnificator of its own.
+     * \param frame Input frame, 8bit unsigned.
+     * \param spatial Decomposition of frame.
+     */
+    void decompose(const Mat &frame, SpatialFrame &spatial);
+    /*!
+     * \brief magnify Temporal part of laplaceMagnify() or rieszMagnify() for the next frame, decomposed in
+     *  order: temporal filter, amplification and reconstruction into the internal buffer.
+     * \param spatial Decomposition of the frame, the Riesz pyramid is swapped with the one of the filter.
+     */
+    void magnify(SpatialFrame &spatial);
 
     ////////////////////////
     ///Magnified Buffer ///
@@ -103,6 +154,7 @@ public:
     Mat getFrameLast();
     /*!
      * \brief getFrameFirst Returns the first/oldest magnified image. After that, this frame will be deleted.
+     *  The image is handed over without a copy, it goes back to the output pool once it isn't referenced anymore.
      * \return A Mat with the same size like the images in the provided processingBuffer.
      */
     Mat getFrameFirst();
@@ -135,6 +187,15 @@ public:
      */
     int getOptimalBufferSize(int fps);
 
+    ////////////////////////
+    ///Profiling ///////////
+    ////////////////////////
+    /*!
+     * \brief setProfiler Adds the time of every stage of the magnification to profiler.
+     * \param profiler Profiler that outlives this object, 0 disables profiling.
+     */
+    void setProfiler(Profiler *profiler);
+
 private:
     /*!
      * \brief processingBuffer Pointer to processing buffer, given in constructor. Holds images that have to
@@ -207,32 +268,100 @@ private:
      */
     vector<Mat> lowpassLo;
     /*!
-     * \brief downSampledMat (Color magnification) Holds 2*fps rounded to next power of 2
+     * \brief workspace (Color magnification) Buffers of the Gauss pyramid, reused as long as
+     *  ROI size and levels stay the same.
+     */
+    PyramidWorkspace workspace;
+    /*!
+     * \brief spatialFrame (Laplace and Riesz) Decomposition of laplaceMagnify() and rieszMagnify().
+     */
+    SpatialFrame spatialFrame;
+    /*!
+     * \brief outputPool (Laplace and Riesz) Output images, reused once the consumer released them.
+     */
+    FramePool outputPool;
+    /*!
+     * \brief rieszMerge (Riesz magnification) Channels of the merge of the output image.
+     */
+    vector<Mat> rieszMerge;
+    /*!
+     * \brief motionGains (Motion magnification) Amplification of every level of motionPyramid.
+     */
+    vector<float> motionGains;
+    /*!
+     * \brief levelRows (Laplace and Riesz) Rows of every level that is filtered in parallel bands,
+     *  kept so the temporal filter doesn't allocate every frame.
+     */
+    vector<int> levelRows;
+    /*!
+     * \brief temporalBuffer (Color magnification) Holds 2*fps rounded to next power of 2
      *  downsampled and to 1 column reshaped images.
      */
-    Mat downSampledMat;
+    TemporalRingBuffer temporalBuffer;
+    /*!
+     * \brief bandpassFilter (Color magnification) Streaming ideal bandpass of temporalBuffer.
+     */
+    SlidingBandpassFilter bandpassFilter;
+    /*!
+     * \brief bandpassMask (Color magnification) Mask of the ideal bandpass, rebuilt when
+     *  window length, cutoffs or framerate change.
+     */
+    IdealBandpassMask bandpassMask;
+    /*!
+     * \brief profiler (All) Receives the time of every stage, may be 0.
+     */
+    Profiler *profiler;
 
-    std::shared_ptr<RieszPyramid> oldPyr;
+    /*!
+     * \brief priorPyr (Riesz magnification) Copy of the last pyramid of decompose(), the prior of the next one.
+     */
+    std::shared_ptr<RieszPyramid> priorPyr;
     std::shared_ptr<RieszPyramid> curPyr;
     std::shared_ptr<RieszTemporalFilter> loCutoff;
     std::shared_ptr<RieszTemporalFilter> hiCutoff;
 
+    //////////////////////// 
+    ///Decomposition ///////
+    //////////////////////// 
+    /*!
+     * \brief convertInput (Laplace and Riesz) Converts frame to 32bit float, YCrCb if it has color, into spatial.
+     */
+    void convertInput(const Mat &frame, bool riesz, SpatialFrame &spatial);
+    /*!
+     * \brief buildRieszPyramid (Riesz magnification) Builds the pyramid of spatial, unwrapped against prior if
+     *  there is one with the same levels.
+     */
+    void buildRieszPyramid(SpatialFrame &spatial, const RieszPyramid *prior);
+    /*!
+     * \brief filterLaplace (Laplace magnification) Temporal filter, amplification and reconstruction of a
+     *  decomposed frame into the internal buffer.
+     * \param first Only initializes the filters and passes the frame on.
+     */
+    void filterLaplace(SpatialFrame &spatial, bool first, StageClock &clock);
+    /*!
+     * \brief filterRiesz (Riesz magnification) Same as filterLaplace(). The filters are initialized as well
+     *  if the phase of spatial isn't unwrapped.
+     */
+    void filterRiesz(SpatialFrame &spatial, bool first, StageClock &clock);
+
     //////////////////////// 
     ///Postprocessing //////
     //////////////////////// 
     /*!
-     * \brief amplifyLaplacian (Motion magnification) Amplifies a Laplacian image pyramid.
-     * \param src Source image.
-     * \param dst Destination image.
+     * \brief laplacianGain (Motion magnification) Amplification of 1 level of a Laplacian image pyramid.
+     *  The lowpassed&downsampled image and the difference image with highest resolution get a gain of 0.
      * \param currentLevel Level of image pyramid that is amplified.
      */
-    void amplifyLaplacian(const Mat &src, Mat &dst, int currentLevel);
+    float laplacianGain(int currentLevel);
     /*!
-     * \brief attenuate (Motion magnification) Attenuates the 2 last channels of a Lab-image.
-     * \param src Source image.
-     * \param dst Destination image.
+     * \brief addMotion (Motion magnification) Adds the motion image with attenuated chroma channels to the
+     *  input image, converts YCrCb back to BGR and scales to 8bit unsigned, all in 1 pass.
+     * \param input Input image, 32bit float YCrCb or grayscale in range [0,1].
+     * \param motion Motion image of the same size and type as input. If empty, only input is converted.
+     * \param output Output image, 8bit unsigned BGR or grayscale. Its storage is kept if size and type match.
+     * \param color True if input is YCrCb.
      */
-    void attenuate(const Mat &src, Mat &dst);
+    void addMotion(const Mat &input, const Mat &motion, Mat &output, bool color);
     /*!
      * \brief amplifyGaussian (Color magnification) Amplifies a Gaussian image pyramid.
      * \param src Source image.
@@ -2,6 +2,7 @@
 // From https://github.com/tbl3rd/Pyramids
 ///
 #include "RieszPyramid.h"
+#include "main/helper/FastMath.h"
 
 /////////////////////
 // Riesz Pyr Level //
@@ -30,16 +31,53 @@ RieszPyramidLevel& RieszPyramidLevel::operator=(const RieszPyramidLevel& other)
     return *this;
 }
 
+// This is the Riesz Band Filter, sometimes defined as [-0.5, 0 , 0.5], [-0.2,-0.48, 0, 0.48,0.2], [[-0.12,0,0.12],[-0.34, 0, 0.34],[-0.12,0,0.12]]
+// Applied as [-0.49, 0, 0.49] horizontally into re and vertically into im,
+// like filter2D with BORDER_REFLECT_101, but without its allocations.
+static const float rieszTap = 0.49f;
+
+// Rows of the Riesz transform of an image with height rows. band holds the
+// image rows from offset on, including the row above and below every given
+// row that exists in the image.
+static void rieszTransform(const cv::Mat &band, int offset, int height, const cv::Range &rows,
+                           cv::Mat &re, cv::Mat &im)
+{
+    const int cols = band.cols;
+    for (int y = rows.start; y < rows.end; ++y) {
+        const float *p  = band.ptr<float>(y - offset);
+        const float *up = band.ptr<float>(cv::borderInterpolate(y-1, height, cv::BORDER_REFLECT_101) - offset);
+        const float *dn = band.ptr<float>(cv::borderInterpolate(y+1, height, cv::BORDER_REFLECT_101) - offset);
+        float *r = re.ptr<float>(y);
+        float *i = im.ptr<float>(y);
+        for (int x = 0; x < cols; ++x)
+            i[x] = rieszTap * (dn[x] - up[x]);
+        // Both neighbours of the first and last column are the same reflected column
+        r[0] = 0.0f;
+        for (int x = 1; x < cols-1; ++x)
+            r[x] = rieszTap * (p[x+1] - p[x-1]);
+        r[cols-1] = 0.0f;
+    }
+}
+
 // Octave is a laplace pyr level. This applies x and yKernel
 void RieszPyramidLevel::build(const cv::Mat &octave) {
-    // This is the Riesz Band Filter, sometimes defined as [-0.5, 0 , 0.5], [-0.2,-0.48, 0, 0.48,0.2], [[-0.12,0,0.12],[-0.34, 0, 0.34],[-0.12,0,0.12]]
-    static const cv::Mat realK = (cv::Mat_<float>(1, 3) << -0.49, 0, 0.49);
-    static const cv::Mat imagK = realK.t();
+    CV_Assert(octave.type() == CV_32FC1);
     itsLp = octave;
-    cv::filter2D(itsLp, real(itsR), itsLp.depth(), realK, cv::Point(-1,-1), 0, cv::BORDER_REFLECT_101);
-    cv::filter2D(itsLp, imag(itsR), itsLp.depth(), imagK, cv::Point(-1,-1), 0, cv::BORDER_REFLECT_101);
+    real(itsR).create(itsLp.size(), CV_32F);
+    imag(itsR).create(itsLp.size(), CV_32F);
+    rieszTransform(itsLp, 0, itsLp.rows, cv::Range(0, itsLp.rows), real(itsR), imag(itsR));
 }
 
+// Same for the rows of a tile. The filters read the halo rows from band,
+// rows at the border of the octave are reflected like above.
+void RieszPyramidLevel::build(const cv::Mat &band, int offset, const cv::Range &rows) {
+    const cv::Mat inner = band.rowRange(rows.start - offset, rows.end - offset);
+    cv::Mat lp = itsLp.rowRange(rows);
+    inner.copyTo(lp);
+    rieszTransform(band, offset, itsLp.rows, rows, real(itsR), imag(itsR));
+}
+
+
 // Write into result the element-wise inverse cosine of X.
 void RieszPyramidLevel::arcCosX(const cv::Mat &X, cv::Mat &result) {
     assert(X.isContinuous() && result.isContinuous());
@@ -47,9 +85,14 @@ void RieszPyramidLevel::arcCosX(const cv::Mat &X, cv::Mat &result) {
     float *const pResult  = result.ptr<float>(0);
     const int count = X.rows * X.cols;
 
-    for (int i = 0; i < count; ++i)
+    int i = 0;
+#if CV_SIMD
+    for (; i <= count - cv::v_float32::nlanes; i += cv::v_float32::nlanes)
+        cv::v_store(pResult + i, v_fastArcCos(cv::vx_load(pX + i)));
+#endif
+    for (; i < count; ++i)
     {
-        pResult[i] = acos(pX[i]);
+        pResult[i] = fastArcCos(pX[i]);
     }
 }
 
@@ -57,45 +100,79 @@ void RieszPyramidLevel::arcCosX(const cv::Mat &X, cv::Mat &result) {
 // Cos (itsPhase.first) are vertical edges
 // Sin (itsPhase.second) are horizontal edges
 void RieszPyramidLevel::unwrapOrientPhase(const RieszPyramidLevel &prior) {
-    cv::Mat temp1
-        =      itsLp.mul(prior.itsLp)
-        + real(itsR).mul(real(prior.itsR))
-        + imag(itsR).mul(imag(prior.itsR));
-    cv::Mat temp2
-        =       real(itsR).mul(prior.itsLp)
-        - real(prior.itsR).mul(itsLp);
-    cv::Mat temp3
-        =       imag(itsR).mul(prior.itsLp)
-        - imag(prior.itsR).mul(itsLp);
-    cv::Mat tempP  = temp2.mul(temp2) + temp3.mul(temp3);
-    cv::Mat phi    = tempP            + temp1.mul(temp1);
-    cv::sqrt(phi, phi);
-    cv::divide(temp1, phi, temp1);
-    cv::patchNaNs(temp1, 0.0);
-    arcCosX(temp1, phi);
-    cv::sqrt(tempP, tempP);
-    cv::divide(temp2, tempP, temp2);
-    cv::patchNaNs(temp2, 0.0);
-    cv::divide(temp3, tempP, temp3);
-    cv::patchNaNs(temp3, 0.0);
-    cos(itsPhase) = temp2.mul(phi);
-    sin(itsPhase) = temp3.mul(phi);
+    cos(itsPhase).create(itsLp.size(), CV_32F);
+    sin(itsPhase).create(itsLp.size(), CV_32F);
+    unwrapOrientPhase(prior, cv::Range(0, itsLp.rows));
+}
+
+// Same for the rows of a tile. Fused per pixel: the quaternionic phase
+// difference to prior, the divides (0 instead of NaN) and acos.
+void RieszPyramidLevel::unwrapOrientPhase(const RieszPyramidLevel &prior, const cv::Range &rows) {
+    const int cols = itsLp.cols;
+    for (int y = rows.start; y < rows.end; ++y) {
+        const float *lp  = itsLp.ptr<float>(y);
+        const float *re  = real(itsR).ptr<float>(y);
+        const float *im  = imag(itsR).ptr<float>(y);
+        const float *plp = prior.itsLp.ptr<float>(y);
+        const float *pre = real(prior.itsR).ptr<float>(y);
+        const float *pim = imag(prior.itsR).ptr<float>(y);
+        float *phaseCos  = cos(itsPhase).ptr<float>(y);
+        float *phaseSin  = sin(itsPhase).ptr<float>(y);
+
+        int x = 0;
+#if CV_SIMD
+        for (; x <= cols - cv::v_float32::nlanes; x += cv::v_float32::nlanes) {
+            const cv::v_float32 vLp  = cv::vx_load(lp + x);
+            const cv::v_float32 vRe  = cv::vx_load(re + x);
+            const cv::v_float32 vIm  = cv::vx_load(im + x);
+            const cv::v_float32 vPlp = cv::vx_load(plp + x);
+            const cv::v_float32 vPre = cv::vx_load(pre + x);
+            const cv::v_float32 vPim = cv::vx_load(pim + x);
+            const cv::v_float32 temp1 = cv::v_muladd(vIm, vPim, cv::v_muladd(vRe, vPre, vLp * vPlp));
+            const cv::v_float32 temp2 = vRe * vPlp - vPre * vLp;
+            const cv::v_float32 temp3 = vIm * vPlp - vPim * vLp;
+            const cv::v_float32 tempP = cv::v_muladd(temp3, temp3, temp2 * temp2);
+            const cv::v_float32 phi = v_fastArcCos(v_safeDivide(temp1, cv::v_sqrt(cv::v_muladd(temp1, temp1, tempP))));
+            const cv::v_float32 scale = v_safeDivide(phi, cv::v_sqrt(tempP));
+            cv::v_store(phaseCos + x, temp2 * scale);
+            cv::v_store(phaseSin + x, temp3 * scale);
+        }
+#endif
+        for (; x < cols; ++x) {
+            const float temp1 = lp[x] * plp[x] + re[x] * pre[x] + im[x] * pim[x];
+            const float temp2 = re[x] * plp[x] - pre[x] * lp[x];
+            const float temp3 = im[x] * plp[x] - pim[x] * lp[x];
+            const float tempP = temp2 * temp2 + temp3 * temp3;
+            const float phi = fastArcCos(safeDivide(temp1, std::sqrt(tempP + temp1 * temp1)));
+            const float scale = safeDivide(phi, std::sqrt(tempP));
+            phaseCos[x] = temp2 * scale;
+            phaseSin[x] = temp3 * scale;
+        }
+    }
 }
 
 // Write into result the element-wise cosines and sines of X.
 void RieszPyramidLevel::cosSinX(const cv::Mat &X, CompExpMat &result)
 {
     assert(X.isContinuous());
-    cos(result) = cv::Mat::zeros(X.size(), CV_32F);
-    sin(result) = cv::Mat::zeros(X.size(), CV_32F);
+    cos(result).create(X.size(), CV_32F);
+    sin(result).create(X.size(), CV_32F);
     assert(cos(result).isContinuous() && sin(result).isContinuous());
     const float *const pX =           X.ptr<float>(0);
     float *const pCosX    = cos(result).ptr<float>(0);
     float *const pSinX    = sin(result).ptr<float>(0);
     const int count = X.rows * X.cols;
-    for (int i = 0; i < count; ++i) {
-        pCosX[i] = cos(pX[i]);
-        pSinX[i] = sin(pX[i]);
+    int i = 0;
+#if CV_SIMD
+    for (; i <= count - cv::v_float32::nlanes; i += cv::v_float32::nlanes) {
+        cv::v_float32 vCos, vSin;
+        v_fastCosSin(cv::vx_load(pX + i), vCos, vSin);
+        cv::v_store(pCosX + i, vCos);
+        cv::v_store(pSinX + i, vSin);
+    }
+#endif
+    for (; i < count; ++i) {
+        fastCosSin(pX[i], pCosX[i], pSinX[i]);
     }
 }
 
@@ -105,49 +182,442 @@ cv::Mat RieszPyramidLevel::rms() {
     return result;
 }
 
-// Normalize the phase change of this level into result.
-void RieszPyramidLevel::normalize(CompExpMat &result) {
+// Blurred phase change weighted by amplitude into sums, blurred amplitude
+// into amplitude. normalize() is the quotient of both.
+void RieszPyramidLevel::normalizedSums(CompExpMat &sums, cv::Mat &amplitude) {
+    const cv::Range rows(0, itsLp.rows);
+    allocateSums();
+    weightSums(rows);
+    blurSums(rows);
+    sums = itsBlurredSums;
+    amplitude = itsBlurredAmplitude;
+}
+
+void RieszPyramidLevel::allocateSums() {
+    const cv::Size size = itsLp.size();
+    cos(itsSums).create(size, CV_32F);
+    sin(itsSums).create(size, CV_32F);
+    itsAmplitude.create(size, CV_32F);
+    cos(itsBlurredSums).create(size, CV_32F);
+    sin(itsBlurredSums).create(size, CV_32F);
+    itsBlurredAmplitude.create(size, CV_32F);
+}
+
+// Phase change weighted by amplitude into itsSums, amplitude into
+// itsAmplitude for the rows of a band.
+void RieszPyramidLevel::weightSums(const cv::Range &rows) {
+    const int cols = itsLp.cols;
+
+    // Like the CompExpMat operator- (which works on a shallow copy), the
+    // change is left in itsRealPass.
+    for (int y = rows.start; y < rows.end; ++y) {
+        const float *lp = itsLp.ptr<float>(y);
+        const float *re = real(itsR).ptr<float>(y);
+        const float *im = imag(itsR).ptr<float>(y);
+        float *realCos  = cos(itsRealPass).ptr<float>(y);
+        float *realSin  = sin(itsRealPass).ptr<float>(y);
+        const float *imagCos = cos(itsImagPass).ptr<float>(y);
+        const float *imagSin = sin(itsImagPass).ptr<float>(y);
+        float *sumCos = cos(itsSums).ptr<float>(y);
+        float *sumSin = sin(itsSums).ptr<float>(y);
+        float *amp    = itsAmplitude.ptr<float>(y);
+
+        int x = 0;
+#if CV_SIMD
+        for (; x <= cols - cv::v_float32::nlanes; x += cv::v_float32::nlanes) {
+            const cv::v_float32 vLp = cv::vx_load(lp + x);
+            const cv::v_float32 vRe = cv::vx_load(re + x);
+            const cv::v_float32 vIm = cv::vx_load(im + x);
+            const cv::v_float32 vCos = cv::vx_load(realCos + x) - cv::vx_load(imagCos + x);
+            const cv::v_float32 vSin = cv::vx_load(realSin + x) - cv::vx_load(imagSin + x);
+            const cv::v_float32 vAmp = cv::v_sqrt(cv::v_muladd(vLp, vLp, cv::v_muladd(vIm, vIm, vRe * vRe)));
+            cv::v_store(realCos + x, vCos);
+            cv::v_store(realSin + x, vSin);
+            cv::v_store(sumCos + x, vCos * vAmp);
+            cv::v_store(sumSin + x, vSin * vAmp);
+            cv::v_store(amp + x, vAmp);
+        }
+#endif
+        for (; x < cols; ++x) {
+            realCos[x] -= imagCos[x];
+            realSin[x] -= imagSin[x];
+            amp[x] = std::sqrt(re[x] * re[x] + im[x] * im[x] + lp[x] * lp[x]);
+            sumCos[x] = realCos[x] * amp[x];
+            sumSin[x] = realSin[x] * amp[x];
+        }
+    }
+}
+
+// Helpers of the separable filters below
+static void verticalPass(const cv::Mat &src, int y, const std::vector<float> &taps, float *out);
+static void reflectBorders(float *padded, int width, int radius);
+static void horizontalPass(const float *padded, const std::vector<float> &taps, float *out, int count, int step, bool accumulate);
+
+// Gaussian blur of the rows of a band, separable like sepFilter2D with
+// BORDER_REFLECT_101 but without its allocations. The blur reads its halo
+// rows from the whole images, so every row of itsSums and itsAmplitude has
+// to be weighted before.
+void RieszPyramidLevel::blurSums(const cv::Range &rows) {
     static const double sigma = 3.0;
     static const int aperture = static_cast<int>(1.0 + 4.0 * sigma);
-    static const cv::Mat kernel
-        = cv::getGaussianKernel(aperture, sigma, CV_32F);
-    cv::Mat amplitude = rms();
-    const CompExpMat change = itsRealPass - itsImagPass;
-    cos(result) = cos(change).mul(amplitude);
-    sin(result) = sin(change).mul(amplitude);
-    cv::sepFilter2D(cos(result), cos(result), -1, kernel, kernel, cv::Point(-1,-1), 0, cv::BORDER_REFLECT_101);
-    cv::sepFilter2D(sin(result), sin(result), -1, kernel, kernel, cv::Point(-1,-1), 0, cv::BORDER_REFLECT_101);
-    cv::Mat temp;
-    cv::sepFilter2D(amplitude, temp, -1, kernel, kernel, cv::Point(-1,-1), 0, cv::BORDER_REFLECT_101);
-    cv::divide(cos(result), temp, cos(result));
-    cv::patchNaNs(cos(result), 0.0);
-    cv::divide(sin(result), temp, sin(result));
-    cv::patchNaNs(sin(result), 0.0);
+    static const cv::Mat kernel = cv::getGaussianKernel(aperture, sigma, CV_32F);
+    static const std::vector<float> taps(kernel.begin<float>(), kernel.end<float>());
+    const int radius = aperture/2;
+    const int cols = itsLp.cols;
+    float *padded = rowScratch(0, cols + 2*radius);
+
+    const cv::Mat *src[3] = { &cos(itsSums), &sin(itsSums), &itsAmplitude };
+    cv::Mat *dst[3] = { &cos(itsBlurredSums), &sin(itsBlurredSums), &itsBlurredAmplitude };
+    for (int i = 0; i < 3; ++i) {
+        for (int y = rows.start; y < rows.end; ++y) {
+            verticalPass(*src[i], y, taps, padded + radius);
+            reflectBorders(padded, cols, radius);
+            horizontalPass(padded, taps, dst[i]->ptr<float>(y), cols, 1, false);
+        }
+    }
+}
+
+// Normalize the phase change of this level into result.
+void RieszPyramidLevel::normalize(CompExpMat &result) {
+    cv::Mat amplitude;
+    normalizedSums(result, amplitude);
+    for (int y = 0; y < amplitude.rows; ++y) {
+        const float *amp = amplitude.ptr<float>(y);
+        float *resultCos = cos(result).ptr<float>(y);
+        float *resultSin = sin(result).ptr<float>(y);
+        for (int x = 0; x < amplitude.cols; ++x) {
+            resultCos[x] = safeDivide(resultCos[x], amp[x]);
+            resultSin[x] = safeDivide(resultSin[x], amp[x]);
+        }
+    }
 }
 
 // Multipy the phase difference in this level by alpha but only up to
 // some ceiling threshold.
 void RieszPyramidLevel::amplify(double alpha, double threshold) {
-    CompExpMat temp;
-    normalize(temp);
+    const cv::Range rows(0, itsLp.rows);
+    allocateSums();
+    itsAmplified.create(itsLp.size(), CV_32F);
+    weightSums(rows);
+    blurSums(rows);
+    amplify(alpha, threshold, rows);
+}
+
+// Same for the rows of a band after blurSums(). Fused per pixel: the
+// divides (0 instead of NaN), the truncation and the rotation of itsLp
+// into itsAmplified.
+void RieszPyramidLevel::amplify(double alpha, double threshold, const cv::Range &rows) {
+    const float fAlpha = static_cast<float>(alpha);
+    const float fThreshold = static_cast<float>(threshold);
+    for (int y = rows.start; y < rows.end; ++y) {
+        const float *lp = itsLp.ptr<float>(y);
+        float *result = itsAmplified.ptr<float>(y);
+        const float *re = real(itsR).ptr<float>(y);
+        const float *im = imag(itsR).ptr<float>(y);
+        const float *sumCos = cos(itsBlurredSums).ptr<float>(y);
+        const float *sumSin = sin(itsBlurredSums).ptr<float>(y);
+        const float *amp = itsBlurredAmplitude.ptr<float>(y);
+
+        int x = 0;
+#if CV_SIMD
+        const cv::v_float32 vAlpha = cv::vx_setall_f32(fAlpha);
+        const cv::v_float32 vThreshold = cv::vx_setall_f32(fThreshold);
+        for (; x <= itsLp.cols - cv::v_float32::nlanes; x += cv::v_float32::nlanes) {
+            const cv::v_float32 vAmp = cv::vx_load(amp + x);
+            const cv::v_float32 vCos = v_safeDivide(cv::vx_load(sumCos + x), vAmp);
+            const cv::v_float32 vSin = v_safeDivide(cv::vx_load(sumSin + x), vAmp);
+            const cv::v_float32 mag = cv::v_sqrt(cv::v_muladd(vSin, vSin, vCos * vCos));
+            cv::v_float32 diffCos, diffSin;
+            v_fastCosSin(cv::v_min(mag * vAlpha, vThreshold), diffCos, diffSin);
+            const cv::v_float32 pair = v_safeDivide(cv::v_muladd(cv::vx_load(im + x), vSin, cv::vx_load(re + x) * vCos), mag);
+            cv::v_store(result + x, cv::vx_load(lp + x) * diffCos - pair * diffSin);
+        }
+#endif
+        for (; x < itsLp.cols; ++x) {
+            const float c = safeDivide(sumCos[x], amp[x]);
+            const float s = safeDivide(sumSin[x], amp[x]);
+            const float mag = std::sqrt(c * c + s * s);
+            float diffCos, diffSin;
+            fastCosSin(std::min(mag * fAlpha, fThreshold), diffCos, diffSin);
+            const float pair = safeDivide(re[x] * c + im[x] * s, mag);
+            result[x] = lp[x] * diffCos - pair * diffSin;
+        }
+    }
+}
+
+const cv::Mat &RieszPyramidLevel::output() const {
+    return itsAmplified.empty() ? itsLp : itsAmplified;
+}
+
+
+/////////////////////
+// Separable Filter //
+//////////////////////
+// Rows x cols scratch image of the calling thread on a buffer that only
+// grows. Each slot can be used by 1 image at a time. The header has no
+// parent, so filters reflect at its borders instead of reading the rest
+// of the buffer like they would for a ROI.
+static cv::Mat tileScratch(int slot, int rows, int cols)
+{
+    static thread_local std::vector<float> scratch[2];
+    std::vector<float> &buffer = scratch[slot];
+    if(buffer.size() < (size_t)rows*cols)
+        buffer.resize((size_t)rows*cols);
+    return cv::Mat(rows, cols, CV_32F, &buffer[0]);
+}
+
+// Weighted sum of the rows around y into out, rows outside of src are reflected.
+static void verticalPass(const cv::Mat &src, int y, const std::vector<float> &taps, float *out)
+{
+    const int taps_n = static_cast<int>(taps.size());
+    const int radius = taps_n/2;
+    std::fill(out, out + src.cols, 0.0f);
+    for (int k = 0; k < taps_n; ++k) {
+        const float *p = src.ptr<float>(cv::borderInterpolate(y + k - radius, src.rows, cv::BORDER_REFLECT_101));
+        const float w = taps[k];
+        for (int x = 0; x < src.cols; ++x)
+            out[x] += w * p[x];
+    }
+}
+
+// Fill the radius entries in front of and behind the width values of a
+// padded row (starting at padded[radius]) by reflection.
+static void reflectBorders(float *padded, int width, int radius)
+{
+    for (int i = 1; i <= radius; ++i) {
+        padded[radius - i]             = padded[radius + cv::borderInterpolate(-i, width, cv::BORDER_REFLECT_101)];
+        padded[radius + width - 1 + i] = padded[radius + cv::borderInterpolate(width - 1 + i, width, cv::BORDER_REFLECT_101)];
+    }
+}
+
+// Weighted sum of every step-th window of a padded row into out.
+static void horizontalPass(const float *padded, const std::vector<float> &taps, float *out, int count, int step, bool accumulate)
+{
+    const int taps_n = static_cast<int>(taps.size());
+    for (int i = 0; i < count; ++i) {
+        const float *p = padded + i*step;
+        float sum = 0.0f;
+        for (int k = 0; k < taps_n; ++k)
+            sum += taps[k] * p[k];
+        out[i] = accumulate ? out[i] + sum : sum;
+    }
+}
+
+SeparableFilter::SeparableFilter(): itsDelta(0.0f), itsError(0.0) { }
+
+void SeparableFilter::init(const cv::Mat &kernel, double tolerance, double delta)
+{
+    CV_Assert(kernel.rows == kernel.cols && kernel.rows % 2 == 1);
+    CV_Assert(kernel.channels() == 1);
+    const int n = kernel.rows;
+    const int radius = n/2;
+
+    // Never write into a kernel that a copy of this filter still shares
+    itsKernel.release();
+    kernel.convertTo(itsKernel, CV_32F);
+    itsCols.clear();
+    itsRows.clear();
+    itsDelta = 0.0f;
+    itsError = 0.0;
+    if(tolerance <= 0.0)
+        return;
+
+    cv::Mat exact;
+    kernel.convertTo(exact, CV_64F);
+    const double norm = cv::norm(exact, cv::NORM_L2);
+    if(norm <= 0.0)
+        return;
+    cv::Mat smooth = exact.clone();
+    smooth.at<double>(radius, radius) += delta;
+
+    cv::Mat w, u, vt;
+    cv::SVD::compute(smooth, w, u, vt);
+
+    // Fewest terms whose dropped singular values stay within tolerance
+    int rank = n;
+    double error = 0.0;
+    for (int r = 1; r <= n; ++r) {
+        double residual = 0.0;
+        for (int i = r; i < n; ++i)
+            residual += w.at<double>(i) * w.at<double>(i);
+        if(std::sqrt(residual) <= tolerance * norm) {
+            rank = r;
+            error = std::sqrt(residual) / norm;
+            break;
+        }
+    }
+    // 2 passes of n taps per term, not cheaper than n*n taps at that rank
+    if(2*rank >= n)
+        return;
+
+    // The dropped terms also change the DC gain, which adds up over the
+    // levels to an offset of the collapsed image. Scale the rows so the
+    // approximation keeps the DC gain of the kernel.
+    double dcExact = cv::sum(smooth)[0];
+    double dcApprox = 0.0;
+    for (int i = 0; i < rank; ++i)
+        dcApprox += w.at<double>(i) * cv::sum(u.col(i))[0] * cv::sum(vt.row(i))[0];
+    const double dcScale = (dcApprox != 0.0) ? dcExact / dcApprox : 1.0;
+
+    for (int i = 0; i < rank; ++i) {
+        const double scale = std::sqrt(w.at<double>(i));
+        std::vector<float> col(n), row(n);
+        for (int k = 0; k < n; ++k) {
+            col[k] = static_cast<float>(scale * u.at<double>(k, i));
+            row[k] = static_cast<float>(scale * dcScale * vt.at<double>(i, k));
+        }
+        itsCols.push_back(col);
+        itsRows.push_back(row);
+    }
+    itsDelta = static_cast<float>(delta);
+    itsError = error;
+}
+
+int SeparableFilter::rank() const {
+    return static_cast<int>(itsCols.size());
+}
+
+double SeparableFilter::error() const {
+    return itsError;
+}
 
-    cv::Mat MagV = square(temp);
-    cv::sqrt(MagV, MagV);
-    cv::Mat MagV2 = MagV * alpha;
-    cv::threshold(MagV2, MagV2, threshold, 0, cv::THRESH_TRUNC);
-    CompExpMat phaseDiff;
-    cosSinX(MagV2, phaseDiff);
-    cv::Mat pair = real(itsR).mul(cos(temp)) + imag(itsR).mul(sin(temp));
-    cv::divide(pair, MagV, pair);
-    cv::patchNaNs(pair, 0.0);
-    itsLp = itsLp.mul(cos(phaseDiff)) - pair.mul(sin(phaseDiff));
+// src is the whole image, rows outside of the given ones are read as halo
+void SeparableFilter::filter(const cv::Mat &src, cv::Mat &dst, const cv::Range &rows) const
+{
+    CV_Assert(src.type() == CV_32FC1);
+    if(itsCols.empty()) {
+        cv::filter2D(src.rowRange(rows), dst, CV_32F, itsKernel, cv::Point(-1,-1), 0, cv::BORDER_REFLECT_101);
+        return;
+    }
+
+    dst.create(rows.size(), src.cols, CV_32F);
+    const int radius = itsKernel.rows/2;
+    float *padded = rowScratch(0, src.cols + 2*radius);
+    for (int y = rows.start; y < rows.end; ++y) {
+        float *out = dst.ptr<float>(y - rows.start);
+        for (size_t t = 0; t < itsCols.size(); ++t) {
+            verticalPass(src, y, itsCols[t], padded + radius);
+            reflectBorders(padded, src.cols, radius);
+            horizontalPass(padded, itsRows[t], out, src.cols, 1, t > 0);
+        }
+        if(itsDelta != 0.0f) {
+            const float *p = src.ptr<float>(y);
+            for (int x = 0; x < src.cols; ++x)
+                out[x] -= itsDelta * p[x];
+        }
+    }
+}
+
+// Only the even rows and columns of the filtered image are computed
+void SeparableFilter::decimate(const cv::Mat &src, cv::Mat &dst, const cv::Range &rows) const
+{
+    CV_Assert(src.type() == CV_32FC1);
+    const int cols = (src.cols + 1)/2;
+    dst.create(rows.size(), cols, CV_32F);
+
+    if(itsCols.empty()) {
+        const cv::Range fine(2*rows.start, std::min(2*rows.end, src.rows));
+        cv::Mat band = tileScratch(1, fine.size(), src.cols);
+        cv::filter2D(src.rowRange(fine), band, CV_32F, itsKernel, cv::Point(-1,-1), 0, cv::BORDER_REFLECT_101);
+        for (int y = 0; y < dst.rows; ++y) {
+            const float *p = band.ptr<float>(2*y);
+            float *out = dst.ptr<float>(y);
+            for (int x = 0; x < cols; ++x)
+                out[x] = p[2*x];
+        }
+        return;
+    }
+
+    const int radius = itsKernel.rows/2;
+    float *padded = rowScratch(0, src.cols + 2*radius);
+    for (int y = rows.start; y < rows.end; ++y) {
+        float *out = dst.ptr<float>(y - rows.start);
+        for (size_t t = 0; t < itsCols.size(); ++t) {
+            verticalPass(src, 2*y, itsCols[t], padded + radius);
+            reflectBorders(padded, src.cols, radius);
+            horizontalPass(padded, itsRows[t], out, cols, 2, t > 0);
+        }
+        if(itsDelta != 0.0f) {
+            const float *p = src.ptr<float>(2*y);
+            for (int x = 0; x < cols; ++x)
+                out[x] -= itsDelta * p[2*x];
+        }
+    }
+}
+
+// The upsampled image holds src on its even rows and columns and zeros
+// elsewhere. Reflection keeps the parity of an index, so for an output
+// pixel only the taps with the parity of the pixel hit a sample of src.
+void SeparableFilter::interpolate(const cv::Mat &src, const cv::Size &size, cv::Mat &dst, const cv::Range &rows) const
+{
+    CV_Assert(src.type() == CV_32FC1);
+    CV_Assert(src.rows == (size.height + 1)/2 && src.cols == (size.width + 1)/2);
+    const int radius = itsKernel.rows/2;
+
+    if(itsCols.empty()) {
+        // Inject zeros into the rows of the tile and its halo only
+        const cv::Range halo(std::max(rows.start - radius, 0), std::min(rows.end + radius, size.height));
+        cv::Mat band = tileScratch(1, halo.size(), size.width);
+        for (int y = halo.start; y < halo.end; ++y) {
+            float *p = band.ptr<float>(y - halo.start);
+            std::fill(p, p + size.width, 0.0f);
+            if(y % 2)
+                continue;
+            const float *s = src.ptr<float>(y/2);
+            for (int x = 0; x < size.width; x += 2)
+                p[x] = s[x/2];
+        }
+        cv::filter2D(band.rowRange(rows.start - halo.start, rows.end - halo.start), dst, CV_32F,
+                     itsKernel, cv::Point(-1,-1), 0, cv::BORDER_REFLECT_101);
+        return;
+    }
+
+    dst.create(rows.size(), size.width, CV_32F);
+    const int taps_n = itsKernel.rows;
+    // Rows of the calling thread, filters run in parallel tiles
+    float *coarse = rowScratch(0, src.cols);
+    float *padded = rowScratch(1, size.width + 2*radius);
+    for (int y = rows.start; y < rows.end; ++y) {
+        float *out = dst.ptr<float>(y - rows.start);
+        for (size_t t = 0; t < itsCols.size(); ++t) {
+            // Vertical pass on the columns of src, skipping the zero rows
+            const std::vector<float> &col = itsCols[t];
+            std::fill(coarse, coarse + src.cols, 0.0f);
+            for (int k = (y + radius) & 1; k < taps_n; k += 2) {
+                const int fine = cv::borderInterpolate(y + k - radius, size.height, cv::BORDER_REFLECT_101);
+                const float *p = src.ptr<float>(fine/2);
+                const float w = col[k];
+                for (int x = 0; x < src.cols; ++x)
+                    coarse[x] += w * p[x];
+            }
+            // Spread onto the even columns, horizontal pass skipping the zero columns
+            float *row = padded + radius;
+            for (int x = 0; x < size.width; ++x)
+                row[x] = (x % 2) ? 0.0f : coarse[x/2];
+            reflectBorders(padded, size.width, radius);
+            const std::vector<float> &taps = itsRows[t];
+            for (int x = 0; x < size.width; ++x) {
+                const float *p = padded + x;
+                float sum = 0.0f;
+                for (int k = (x + radius) & 1; k < taps_n; k += 2)
+                    sum += taps[k] * p[k];
+                out[x] = t ? out[x] + sum : sum;
+            }
+        }
+        if(itsDelta != 0.0f && y % 2 == 0) {
+            const float *p = src.ptr<float>(y/2);
+            for (int x = 0; x < size.width; x += 2)
+                out[x] -= itsDelta * p[x/2];
+        }
+    }
 }
 
 
 /////////////////
 // Riesz Pyr  //
 ////////////////
-RieszPyramid::RieszPyramid()
+RieszPyramid::RieszPyramid() :
+    numLevels(0)
 {
     // Init low and highpass filter for pyramid construction/collapse
     this->lowPassFilter = (cv::Mat_<float>(9,9)<< -0.0001,   -0.0007,  -0.0023,  -0.0046,  -0.0057,  -0.0046,  -0.0023,  -0.0007,  -0.0001,
@@ -169,6 +639,8 @@ RieszPyramid::RieszPyramid()
                                              0.0011,    0.0059,   0.0151,   0.0249,   0.0292,   0.0249,   0.0151,   0.0059,   0.0011,
                                              0.0003,    0.0020,   0.0059,   0.0103,   0.0123,   0.0103,   0.0059,   0.0020,   0.0003,
                                              0.0000,    0.0003,   0.0011,   0.0022,   0.0027,   0.0022,   0.0011,   0.0003,   0.0000);
+
+    setFilterTolerance(DEFAULT_RIESZ_FILTER_TOLERANCE);
 }
 RieszPyramid::~RieszPyramid() { }
 RieszPyramid::RieszPyramid(const RieszPyramid& other)
@@ -177,6 +649,9 @@ RieszPyramid::RieszPyramid(const RieszPyramid& other)
     this->pyrLevels.resize(other.pyrLevels.size());
     other.lowPassFilter.copyTo(this->lowPassFilter);
     other.highPassFilter.copyTo(this->highPassFilter);
+    this->lowPass = other.lowPass;
+    this->highPass = other.highPass;
+    this->itsTolerance = other.itsTolerance;
     for (int i = 0; i < this->numLevels; ++i)
     {
         this->pyrLevels[i] = other.pyrLevels[i];
@@ -190,6 +665,9 @@ RieszPyramid& RieszPyramid::operator=(const RieszPyramid& other)
         this->pyrLevels.resize(other.pyrLevels.size());
         other.lowPassFilter.copyTo(this->lowPassFilter);
         other.highPassFilter.copyTo(this->highPassFilter);
+        this->lowPass = other.lowPass;
+        this->highPass = other.highPass;
+        this->itsTolerance = other.itsTolerance;
         for (int i = 0; i < this->numLevels; ++i)
         {
             this->pyrLevels[i] = other.pyrLevels[i];
@@ -199,6 +677,20 @@ RieszPyramid& RieszPyramid::operator=(const RieszPyramid& other)
     return *this;
 }
 
+// The highpass is 1 impulse minus a smooth kernel, only the smooth part is
+// decomposed.
+void RieszPyramid::setFilterTolerance(double tolerance)
+{
+    itsTolerance = tolerance;
+    lowPass.init(2.0*lowPassFilter, tolerance);
+    highPass.init(highPassFilter, tolerance, 1.0);
+}
+
+double RieszPyramid::filterTolerance() const
+{
+    return itsTolerance;
+}
+
 void RieszPyramid::init(cv::Mat &frame, int levels)
 {
     this->pyrLevels.resize(levels);
@@ -208,6 +700,7 @@ void RieszPyramid::init(cv::Mat &frame, int levels)
     for (int i = 0; i < this->numLevels; ++i) {
         RieszPyramidLevel &rpl = pyrLevels[i];
         const cv::Size size = rpl.itsLp.size();
+        rpl.itsAmplified.release();
         cos(rpl.itsPhase)    = cv::Mat::zeros(size, CV_32F);
         sin(rpl.itsPhase)    = cv::Mat::zeros(size, CV_32F);
         cos(rpl.itsRealPass) = cv::Mat::zeros(size, CV_32F);
@@ -217,24 +710,74 @@ void RieszPyramid::init(cv::Mat &frame, int levels)
     }
 }
 
+void RieszPyramid::setLevels(int levels)
+{
+    this->pyrLevels.resize(levels);
+    numLevels = levels;
+}
+
 // This builds a Riesz pyramid
 void RieszPyramid::buildPyramid(const cv::Mat &frame) {
-    const int max = this->numLevels-1;
-    cv::Mat octave = frame;
-
-    for (int i = 0; i < max; ++i) {
-        cv::Mat hp, lp, down;
+    buildLevels(frame, 0);
+}
 
-        // Highpass undergoes riesz transform
-        cv::filter2D(octave, hp, CV_32F, highPassFilter, cv::Point(-1,-1), 0, cv::BORDER_REFLECT_101);
-        pyrLevels[i].build(hp);
+// This builds a Riesz pyramid and unwraps the phase against prior
+void RieszPyramid::buildPyramid(const cv::Mat &frame, const RieszPyramid &prior) {
+    buildLevels(frame, &prior);
+}
 
-        // Lowpass is passed onto the next level
-        cv::filter2D(octave, lp, CV_32F, 2.0*lowPassFilter, cv::Point(-1,-1), 0, cv::BORDER_REFLECT_101);
-        octave = subsample(lp);
+void RieszPyramid::buildLevels(const cv::Mat &frame, const RieszPyramid *prior) {
+    CV_Assert(RIESZ_TILE_ROWS > 0 && RIESZ_TILE_ROWS % 2 == 0);
+    const int max = this->numLevels-1;
+    cv::Mat octave = frame;
+    itsOctaves.resize(this->numLevels);
+
+    for (int i = 0; i <= max; ++i) {
+        RieszPyramidLevel &level = pyrLevels[i];
+        const cv::Size size = octave.size();
+        const bool last = (i == max);
+        const bool unwrap = prior && !last;
+
+        level.itsLp.create(size, CV_32F);
+        real(level.itsR).create(size, CV_32F);
+        imag(level.itsR).create(size, CV_32F);
+        if(unwrap) {
+            cos(level.itsPhase).create(size, CV_32F);
+            sin(level.itsPhase).create(size, CV_32F);
+        }
+        cv::Mat &next = itsOctaves[i];
+        if(!last)
+            next.create(size.height/2 + (size.height%2), size.width/2 + (size.width%2), CV_32F);
+
+        // Bands are independent, ROIs of octave read their halo rows from octave
+        const int tiles = (size.height + RIESZ_TILE_ROWS - 1) / RIESZ_TILE_ROWS;
+        parallelFor(cv::Range(0, tiles), [&](const cv::Range &range) {
+            for (int t = range.start; t < range.end; ++t) {
+                const cv::Range rows(t*RIESZ_TILE_ROWS, std::min((t+1)*RIESZ_TILE_ROWS, size.height));
+
+                // Lowpass residual undergoes riesz transform only
+                if(last) {
+                    level.build(octave, 0, rows);
+                    continue;
+                }
+
+                // Highpass undergoes riesz transform, computed with 1 halo row for the vertical kernel
+                const cv::Range halo(std::max(rows.start-1, 0), std::min(rows.end+1, size.height));
+                cv::Mat hp = tileScratch(0, halo.size(), size.width);
+                highPass.filter(octave, hp, halo);
+                level.build(hp, halo.start, rows);
+                if(unwrap)
+                    level.unwrapOrientPhase(prior->pyrLevels[i], rows);
+
+                // Lowpass is subsampled and passed onto the next level
+                const cv::Range coarse(rows.start/2, (rows.end+1)/2);
+                cv::Mat lp = next.rowRange(coarse);
+                lowPass.decimate(octave, lp, coarse);
+            }
+        });
+
+        octave = next;
     }
-
-    pyrLevels[max].build(octave);
 }
 
 void RieszPyramid::unwrapOrientPhase(const RieszPyramid &prior) {
@@ -246,86 +789,87 @@ void RieszPyramid::unwrapOrientPhase(const RieszPyramid &prior) {
     }
 }
 
-// Amplify motion by alpha up to threshold using filtered phase data.
-void RieszPyramid::amplify(double alpha, double threshold)
+void RieszPyramid::swapFrames(RieszPyramid &other)
 {
-    for(int i = this->numLevels-1; i >= 0; i--) {
-        pyrLevels[i].amplify(alpha, threshold);
+    CV_Assert(numLevels == other.numLevels);
+    for (int i = 0; i < numLevels; ++i) {
+        RieszPyramidLevel &level = pyrLevels[i];
+        RieszPyramidLevel &otherLevel = other.pyrLevels[i];
+        std::swap(level.itsLp, otherLevel.itsLp);
+        std::swap(level.itsR, otherLevel.itsR);
+        std::swap(level.itsPhase, otherLevel.itsPhase);
     }
 }
 
-const cv::Mat RieszPyramid::subsample(cv::Mat &img) {
-    // accept only grayscale float type matrices
-    CV_Assert(img.depth() == CV_32F);
-    CV_Assert(img.channels() == 1);
-    CV_Assert(img.isContinuous());
-
-    int nRowsBig = img.rows;
-    int nColsBig = img.cols;
-
-    cv::Mat tmp = cv::Mat::zeros(img.rows/2 + (img.rows%2), img.cols/2 + (img.cols%2), CV_32F);
-
-    float *p = img.ptr<float>(0);
-    float *tmp_p = tmp.ptr<float>(0);
-
-    for (int y = 0; y < nRowsBig; y += 2) {
-        for (int x = 0; x < nColsBig; x += 2) {
-            int subIdx = x/2 + (y/2)*tmp.cols;
-            int bigIdx = x + y*nColsBig;
-
-            tmp_p[subIdx] = p[bigIdx];
-        }
+void RieszPyramid::copyFrames(const RieszPyramid &other)
+{
+    setLevels(other.numLevels);
+    for (int i = 0; i < numLevels; ++i) {
+        RieszPyramidLevel &level = pyrLevels[i];
+        const RieszPyramidLevel &otherLevel = other.pyrLevels[i];
+        otherLevel.itsLp.copyTo(level.itsLp);
+        real(otherLevel.itsR).copyTo(real(level.itsR));
+        imag(otherLevel.itsR).copyTo(imag(level.itsR));
     }
-
-    return tmp.clone();
 }
 
-const cv::Mat RieszPyramid::injectZerosEven(cv::Mat &img) {
-    // accept only grayscale float type matrices
-    CV_Assert(img.depth() == CV_32F);
-    CV_Assert(img.channels() == 1);
-    CV_Assert(img.isContinuous());
-
-    int nRows = img.rows;
-    int nCols = img.cols;
-
-    cv::Mat tmp = cv::Mat::zeros(nRows, nCols, CV_32F);
-
-    float *p = img.ptr<float>(0);
-    float *tmp_p = tmp.ptr<float>(0);
-
-    for (int y = 0; y < nRows; y += 2) {
-        for (int x = 0; x < nCols; x += 2) {
-
-            int idx = x + y*nCols;
-            tmp_p[idx] = p[idx];
-        }
+// Amplify motion by alpha up to threshold using filtered phase data.
+void RieszPyramid::amplify(double alpha, double threshold)
+{
+    itsLevelRows.resize(this->numLevels);
+    for(int i = 0; i < this->numLevels; i++) {
+        pyrLevels[i].allocateSums();
+        pyrLevels[i].itsAmplified.create(pyrLevels[i].itsLp.size(), CV_32F);
+        itsLevelRows[i] = pyrLevels[i].itsLp.rows;
     }
 
-    return tmp.clone();
+    // The blur needs every row of its level, so the passes run one after the other
+    parallelForLevels(itsLevelRows, [&](int level, const cv::Range &rows) {
+        pyrLevels[level].weightSums(rows);
+    });
+    parallelForLevels(itsLevelRows, [&](int level, const cv::Range &rows) {
+        pyrLevels[level].blurSums(rows);
+    });
+    parallelForLevels(itsLevelRows, [&](int level, const cv::Range &rows) {
+        pyrLevels[level].amplify(alpha, threshold, rows);
+    });
 }
 
 // Return the frame resulting from the collapse of this pyramid.
 //
 const cv::Mat RieszPyramid::collapsePyramid() {
+    CV_Assert(RIESZ_TILE_ROWS > 0);
     const int count = pyrLevels.size() - 1;
-    cv::Mat result = pyrLevels[count].itsLp;
+    cv::Mat result = pyrLevels[count].output();
+    itsCollapsed.resize(pyrLevels.size());
 
     for (int i = count - 1; i >= 0; --i) {
-       const cv::Mat &octave = pyrLevels[i].itsLp;
-        cv::Mat lp, hp, up, up_zero;
-
-        // Upsample with image without interpolation (= inject zeros on 3 of 4 pixels in every 4x4 neighborhood)
-        // Filter with lowpass after upsampling (2.0*lpFilter) to make up for energy lost during upsampling
-        cv::resize(result, up, octave.size(), 0, 0, cv::INTER_NEAREST);
-        up_zero = injectZerosEven(up);
-        cv::filter2D(up_zero, lp, CV_32F, 2.0*lowPassFilter, cv::Point(-1,-1), 0, cv::BORDER_REFLECT_101);
-
-        // Highpass on current levels img
-        cv::filter2D(octave, hp, CV_32F, highPassFilter, cv::Point(-1,-1), 0, cv::BORDER_REFLECT_101);
-
-        // Reconstruct image adding LP and HP
-        result = lp + hp;
+        const cv::Mat &octave = pyrLevels[i].output();
+        const cv::Size size = octave.size();
+        const int tiles = (size.height + RIESZ_TILE_ROWS - 1) / RIESZ_TILE_ROWS;
+        cv::Mat &collapsed = itsCollapsed[i];
+        collapsed.create(size, CV_32F);
+
+        // Bands are independent, they read their halo rows from the whole images
+        parallelFor(cv::Range(0, tiles), [&](const cv::Range &range) {
+            for (int t = range.start; t < range.end; ++t) {
+                const cv::Range rows(t*RIESZ_TILE_ROWS, std::min((t+1)*RIESZ_TILE_ROWS, size.height));
+                cv::Mat lp = collapsed.rowRange(rows);
+                cv::Mat hp = tileScratch(0, rows.size(), size.width);
+
+                // Upsample by injecting zeros and filter with lowpass (2.0*lpFilter)
+                // to make up for energy lost during upsampling
+                lowPass.interpolate(result, size, lp, rows);
+
+                // Highpass on current levels img
+                highPass.filter(octave, hp, rows);
+
+                // Reconstruct image adding LP and HP
+                lp += hp;
+            }
+        });
+
+        result = collapsed;
     }
     return result;
 }
@@ -6,9 +6,17 @@
 #define RIESZPYRAMID_H
 
 #include "main/helper/ComplexMat.h"
+#include "main/helper/ParallelLevels.h"
+#include "main/other/Config.h"
 
 #include <opencv2/core.hpp>
 #include <opencv2/imgproc.hpp>
+#include <opencv2/core/hal/intrin.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <utility>
+#include <vector>
 
 class RieszPyramidLevel {
 
@@ -20,22 +28,36 @@ public:
 
     cv::Mat itsLp;                     // the frame scaled to this octave
     ComplexMat itsR;                   // the transform
-    CompExpMat itsPhase;               // the amplified result
+    CompExpMat itsPhase;               // the phase difference to the prior frame
     CompExpMat itsRealPass;            // per-level filter state maintained
     CompExpMat itsImagPass;            // across frames
+    cv::Mat itsAmplified;              // the amplified result, itsLp stays
+                                       // the prior of the next frame
+    CompExpMat itsSums;                // scratch of amplify(), weighted
+    cv::Mat itsAmplitude;              // phase change and amplitude before
+    CompExpMat itsBlurredSums;         // and after the blur
+    cv::Mat itsBlurredAmplitude;
 
     // Octave is a laplace pyr level. This applies x and yKernel
     void build(const cv::Mat &octave);
+    // Same for the rows of a tile. Band holds the octave rows starting at
+    // offset, with 1 halo row above and below rows if inside the octave.
+    // itsLp and itsR have to be allocated.
+    void build(const cv::Mat &band, int offset, const cv::Range &rows);
 
-    // Write into result the element-wise inverse cosine of X.
+    // Write into result the element-wise inverse cosine of X
+    // (polynomial, error below 5e-7).
     static void arcCosX(const cv::Mat &X, cv::Mat &result);
 
     // This calculates movements separated by edges.
     // Cos (itsPhase.first) are vertical edges
     // Sin (itsPhase.second) are horizontal edges
     void unwrapOrientPhase(const RieszPyramidLevel &prior);
+    // Same for the rows of a tile, itsPhase has to be allocated.
+    void unwrapOrientPhase(const RieszPyramidLevel &prior, const cv::Range &rows);
 
-    // Write into result the element-wise cosines and sines of X.
+    // Write into result the element-wise cosines and sines of X
+    // (polynomial, error about 1e-7).
     static void cosSinX(const cv::Mat &X, CompExpMat &result);
 
     // Used to get amplitude. Square sin&cos of phase, add lowpass, square resulting mat
@@ -43,10 +65,65 @@ public:
 
     // Normalize the phase change of this level into result.
     void normalize(CompExpMat &result);
+    // Numerators and denominator of normalize() after the blur.
+    void normalizedSums(CompExpMat &sums, cv::Mat &amplitude);
 
     // Multipy the phase difference in this level by alpha but only up to
-    // some ceiling threshold.
+    // some ceiling threshold. Writes itsAmplified.
     void amplify(double alpha, double threshold);
+
+    // amplify() split in 3 passes over the rows of a band, each pass has
+    // to be done for all bands before the next one starts:
+    // weighted phase change, blur and amplification.
+    void allocateSums();
+    void weightSums(const cv::Range &rows);
+    void blurSums(const cv::Range &rows);
+    void amplify(double alpha, double threshold, const cv::Range &rows);
+
+    // Amplified result if there is one, else itsLp.
+    const cv::Mat &output() const;
+};
+
+
+// Separable Filter
+//
+// Low rank approximation of a 9x9 filter kernel by SVD,
+// kernel ~ sum(column_i * row_i) - delta * impulse, applied as 2
+// 1D passes per term. Borders are reflected like BORDER_REFLECT_101.
+class SeparableFilter {
+
+public:
+    SeparableFilter();
+
+    // Decompose kernel, keeping the fewest terms with a relative
+    // (Frobenius) kernel error up to tolerance, scaled to the DC gain of
+    // the kernel. Tolerance <= 0 keeps the exact kernel, which is
+    // applied with filter2D. delta is the
+    // weight of a centre impulse that is split off before the
+    // decomposition, e.g. for highpass = smooth lowpass - impulse.
+    void init(const cv::Mat &kernel, double tolerance, double delta = 0.0);
+
+    // Number of separable terms, 0 if the exact kernel is used
+    int rank() const;
+    // Relative error of the approximated kernel
+    double error() const;
+
+    // Filter src into dst, which holds the given rows of the result.
+    void filter(const cv::Mat &src, cv::Mat &dst, const cv::Range &rows) const;
+    // Filter src and keep every second row and column (subsample)
+    // into dst, which holds the given rows of the result.
+    void decimate(const cv::Mat &src, cv::Mat &dst, const cv::Range &rows) const;
+    // Filter src upsampled to size by injecting zeros on odd rows and
+    // columns into dst, which holds the given rows of the result. The
+    // separable path never multiplies the injected zeros.
+    void interpolate(const cv::Mat &src, const cv::Size &size, cv::Mat &dst, const cv::Range &rows) const;
+
+private:
+    cv::Mat itsKernel;                          // exact kernel
+    std::vector< std::vector<float> > itsCols;  // vertical taps per term
+    std::vector< std::vector<float> > itsRows;  // horizontal taps per term
+    float itsDelta;
+    double itsError;
 };
 
 
@@ -69,30 +146,58 @@ public:
 
     // Initialize filter and levels
     void init(cv::Mat &frame, int levels);
+    // Number of levels only, buildPyramid() allocates their frame data
+    void setLevels(int levels);
 
     // This builds a Riesz pyramid
     void buildPyramid(const cv::Mat &frame);
+    // This builds a Riesz pyramid and unwraps the phase against prior.
+    // Each level is split in bands of RIESZ_TILE_ROWS rows that run in
+    // parallel, highpass, Riesz transform and unwrap are done per band.
+    void buildPyramid(const cv::Mat &frame, const RieszPyramid &prior);
     // Return the frame resulting from the collapse of this pyramid.
     const cv::Mat collapsePyramid();
 
+    // Swap the frame data (itsLp, itsR, itsPhase) of every level with
+    // other without copying. The filter state of both pyramids stays
+    // in place, so a pair of pyramids can be double buffered.
+    void swapFrames(RieszPyramid &other);
+    // Copy what buildPyramid() reads of a prior (itsLp, itsR) of every
+    // level of other, so this can be the prior while other is in use.
+    void copyFrames(const RieszPyramid &other);
+
     // This calculates movements separated by edges.
     // Cos (itsPhase.first) are vertical edges
     // Sin (itsPhase.second) are horizontal edges
     void unwrapOrientPhase(const RieszPyramid &prior);
 
     // Amplify motion by alpha up to threshold using filtered phase data.
+    // All levels run in parallel bands of LEVEL_TILE_ROWS rows.
     void amplify(double alpha, double threshold);
 
+    // Maximal relative error of the separable approximation of the
+    // low and highpass filter, 0 uses the exact 9x9 kernels.
+    void setFilterTolerance(double tolerance);
+    double filterTolerance() const;
+
 private:
     // 9x9 Lowpass and Highpass filter for pyramid construction
     // Used before phase unwrapping
     cv::Mat lowPassFilter;
     cv::Mat highPassFilter;
-    // Neeed to collapse te Pyramid.
-    // Upsample without interpolation
-    const cv::Mat injectZerosEven(cv::Mat &img);
-    // Subsample image without interpolation
-    const cv::Mat subsample(cv::Mat &img);
+    // Filters applied to the pyramid: 2*lowpass (make up for energy
+    // lost during up/downsampling) and highpass
+    SeparableFilter lowPass;
+    SeparableFilter highPass;
+    double itsTolerance;
+    // Lowpass passed onto the next level and collapsed image of every
+    // level, reused for every frame
+    std::vector<cv::Mat> itsOctaves;
+    std::vector<cv::Mat> itsCollapsed;
+    // Rows of every level for the parallel amplification
+    std::vector<int> itsLevelRows;
+    // Build levels in parallel bands, unwrap phase if prior is given
+    void buildLevels(const cv::Mat &frame, const RieszPyramid *prior);
 };
 
 #endif // RIESZPYRAMID_H
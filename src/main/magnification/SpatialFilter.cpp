@@ -24,6 +24,59 @@
 
 #include "main/magnification/SpatialFilter.h"
 
+// Local
+#include "main/helper/ParallelLevels.h"
+#include "main/other/Config.h"
+
+////////////////////////
+/// Workspace //////////
+////////////////////////
+PyramidWorkspace::PyramidWorkspace() :
+    imgType(-1),
+    nLevels(-1)
+{
+}
+
+bool PyramidWorkspace::prepare(Size size, int type, int levels)
+{
+    if(size == imgSize && type == imgType && levels == nLevels)
+        return false;
+
+    imgSize = size;
+    imgType = type;
+    nLevels = levels;
+
+    // Fresh buffers, the top level of the last layout shares its data with another buffer
+    pyramid.assign(levels+1, Mat());
+    down.assign(levels, Mat());
+    up.assign(levels+1, Mat());
+
+    Size current = size;
+    for (int level = 0; level < levels; ++level) {
+        Size half((current.width+1)/2, (current.height+1)/2);
+        pyramid[level].create(current, type);
+        up[level].create(current, type);
+        down[level].create(half, type);
+        current = half;
+    }
+    up[levels].create(current, type);
+    pyramid[levels] = levels > 0 ? down[levels-1] : up[levels];
+
+    return true;
+}
+
+void PyramidWorkspace::release()
+{
+    input.release();
+    scratch.release();
+    pyramid.clear();
+    down.clear();
+    up.clear();
+    imgSize = Size();
+    imgType = -1;
+    nLevels = -1;
+}
+
 ////////////////////////
 /// Downsampling ///////
 ////////////////////////
@@ -57,6 +110,146 @@ void buildLaplacePyrFromImg(const Mat &img, const int levels, vector<Mat> &pyr)
     pyr.push_back(currentLevel);
 }
 
+// Same as cv::pyrDown and cv::pyrUp for 32bit float images, but without the row buffers
+// OpenCV allocates for wide images on every call. Rows are filtered in parallel bands, the
+// intermediate row is a scratch row of the thread.
+// Source column/row i of pyrUp, reflected at the start and replicated at the end like OpenCV
+static inline int upIndex(int i, int n)
+{
+    return std::min(i < 0 ? -i : i, n-1);
+}
+
+static void pyrDownFloat(const Mat &src, Mat &dst)
+{
+    CV_Assert(src.depth() == CV_32F && dst.type() == src.type() && dst.data != src.data);
+    const int cn = src.channels();
+    const int w = src.cols;
+    const int h = src.rows;
+    const int dw = dst.cols;
+
+    parallelFor(Range(0, dst.rows), [&](const Range &range) {
+        float *row = rowScratch(0, (size_t)w*cn);
+        for (int y = range.start; y < range.end; ++y) {
+            // Vertical [1 4 6 4 1]
+            const float *r0 = src.ptr<float>(borderInterpolate(2*y-2, h, BORDER_REFLECT_101));
+            const float *r1 = src.ptr<float>(borderInterpolate(2*y-1, h, BORDER_REFLECT_101));
+            const float *r2 = src.ptr<float>(borderInterpolate(2*y,   h, BORDER_REFLECT_101));
+            const float *r3 = src.ptr<float>(borderInterpolate(2*y+1, h, BORDER_REFLECT_101));
+            const float *r4 = src.ptr<float>(borderInterpolate(2*y+2, h, BORDER_REFLECT_101));
+            for (int x = 0; x < w*cn; ++x)
+                row[x] = r0[x] + r4[x] + 4.0f*(r1[x] + r3[x]) + 6.0f*r2[x];
+
+            // Horizontal [1 4 6 4 1], all taps inside the row besides the borders
+            float *out = dst.ptr<float>(y);
+            for (int x = 0; x < dw; ++x) {
+                const int sx = 2*x;
+                if(sx-2 >= 0 && sx+2 < w) {
+                    const float *p = row + sx*cn;
+                    for (int c = 0; c < cn; ++c)
+                        out[x*cn+c] = (p[c-2*cn] + p[c+2*cn] + 4.0f*(p[c-cn] + p[c+cn]) + 6.0f*p[c]) * (1.0f/256.0f);
+                }
+                else {
+                    const int x0 = borderInterpolate(sx-2, w, BORDER_REFLECT_101)*cn;
+                    const int x1 = borderInterpolate(sx-1, w, BORDER_REFLECT_101)*cn;
+                    const int x3 = borderInterpolate(sx+1, w, BORDER_REFLECT_101)*cn;
+                    const int x4 = borderInterpolate(sx+2, w, BORDER_REFLECT_101)*cn;
+                    for (int c = 0; c < cn; ++c)
+                        out[x*cn+c] = (row[x0+c] + row[x4+c] + 4.0f*(row[x1+c] + row[x3+c]) + 6.0f*row[sx*cn+c]) * (1.0f/256.0f);
+                }
+            }
+        }
+    }, std::max(1, dst.rows/LEVEL_TILE_ROWS));
+}
+
+static void pyrUpFloat(const Mat &src, Mat &dst)
+{
+    CV_Assert(src.depth() == CV_32F && dst.type() == src.type() && dst.data != src.data &&
+              dst.cols <= 2*src.cols && dst.rows <= 2*src.rows);
+    const int cn = src.channels();
+    const int w = src.cols;
+    const int h = src.rows;
+    const int dw = dst.cols;
+
+    parallelFor(Range(0, dst.rows), [&](const Range &range) {
+        float *row = rowScratch(0, (size_t)w*cn);
+        for (int y = range.start; y < range.end; ++y) {
+            // Vertical [1 6 1] for even rows, [4 4] for odd rows
+            const int i = y/2;
+            if(y % 2 == 0) {
+                const float *r0 = src.ptr<float>(upIndex(i-1, h));
+                const float *r1 = src.ptr<float>(i);
+                const float *r2 = src.ptr<float>(upIndex(i+1, h));
+                for (int x = 0; x < w*cn; ++x)
+                    row[x] = r0[x] + 6.0f*r1[x] + r2[x];
+            }
+            else {
+                const float *r1 = src.ptr<float>(i);
+                const float *r2 = src.ptr<float>(upIndex(i+1, h));
+                for (int x = 0; x < w*cn; ++x)
+                    row[x] = 4.0f*(r1[x] + r2[x]);
+            }
+
+            // Horizontal the same, both filters sum up to 8
+            float *out = dst.ptr<float>(y);
+            for (int x = 0; x < dw; ++x) {
+                const int j = x/2;
+                const int j1 = upIndex(j+1, w)*cn;
+                if(x % 2 == 0) {
+                    const int j0 = upIndex(j-1, w)*cn;
+                    for (int c = 0; c < cn; ++c)
+                        out[x*cn+c] = (row[j0+c] + 6.0f*row[j*cn+c] + row[j1+c]) * (1.0f/64.0f);
+                }
+                else {
+                    for (int c = 0; c < cn; ++c)
+                        out[x*cn+c] = (row[j*cn+c] + row[j1+c]) * (4.0f/64.0f);
+                }
+            }
+        }
+    }, std::max(1, dst.rows/LEVEL_TILE_ROWS));
+}
+
+// The workspace buffers have their size already, float images use the versions without allocations
+static void pyrDownInto(const Mat &src, Mat &dst)
+{
+    if(src.depth() == CV_32F)
+        pyrDownFloat(src, dst);
+    else
+        pyrDown(src, dst, dst.size());
+}
+
+static void pyrUpInto(const Mat &src, Mat &dst)
+{
+    if(src.depth() == CV_32F)
+        pyrUpFloat(src, dst);
+    else
+        pyrUp(src, dst, dst.size());
+}
+
+void buildGaussPyrFromImg(const Mat &img, const int levels, PyramidWorkspace &ws)
+{
+    ws.prepare(img.size(), img.type(), levels);
+    Mat currentLevel = img;
+
+    for (int level = 0; level < levels; ++level) {
+        pyrDownInto(currentLevel, ws.down[level]);
+        currentLevel = ws.down[level];
+    }
+}
+
+void buildLaplacePyrFromImg(const Mat &img, const int levels, PyramidWorkspace &ws)
+{
+    ws.prepare(img.size(), img.type(), levels);
+    Mat currentLevel = img;
+
+    for (int level = 0; level < levels; ++level) {
+        pyrDownInto(currentLevel, ws.down[level]);
+        pyrUpInto(ws.down[level], ws.up[level]);
+        subtract(currentLevel, ws.up[level], ws.pyramid[level]);
+        currentLevel = ws.down[level];
+    }
+    ws.pyramid[levels] = currentLevel;
+}
+
 void buildWaveletPyrFromImg(const Mat &img, const int levels, vector<vector<Mat> > &pyr, int SHRINK_TYPE, float SHRINK_T)
 {
     float c,dh,dv,dd;
@@ -157,6 +350,33 @@ void buildImgFromLaplacePyr(const vector<Mat> &pyr, const int levels, Mat &dst)
     dst = currentLevel.clone();
 }
 
+void buildImgFromLaplacePyr(const vector<Mat> &pyr, const int levels, const vector<float> &gains, Mat &dst,
+                            PyramidWorkspace &ws)
+{
+    ws.prepare(pyr[0].size(), pyr[0].type(), levels);
+
+    // Levels above the coarsest level with a gain only add 0
+    int top = levels;
+    while(top >= 0 && gains[top] == 0.0f)
+        --top;
+
+    if(top < 0) {
+        ws.up[0].setTo(Scalar::all(0));
+        dst = ws.up[0];
+        return;
+    }
+
+    pyr[top].convertTo(ws.up[top], -1, gains[top]);
+
+    for (int level = top-1; level >= 0; --level) {
+        pyrUpInto(ws.up[level+1], ws.up[level]);
+        // up = gain*level + up
+        if(gains[level] != 0.0f)
+            scaleAdd(pyr[level], gains[level], ws.up[level], ws.up[level]);
+    }
+    dst = ws.up[0];
+}
+
 void buildImgFromWaveletPyr(const vector<vector<Mat> > &pyr, Mat &dst, Size origSize, int SHRINK_TYPE, float SHRINK_T)
 {
     int levels = pyr.size();
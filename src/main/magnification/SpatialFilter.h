@@ -42,6 +42,58 @@ using namespace cv;
 #define SOFT 2  // soft shrinkage
 #define GARROT 3  // garrot filter
 
+//////////////////////// 
+/// Workspace //////////
+//////////////////////// 
+/*!
+ * \brief The PyramidWorkspace class Preallocated buffers for every level of a Gauss/Laplace Pyramid. The
+ *  buffers are allocated for 1 image size, type and number of levels and reused for every frame, so building
+ *  and reconstructing a pyramid of the same layout doesn't allocate memory.
+ */
+class PyramidWorkspace {
+public:
+    PyramidWorkspace();
+
+    /*!
+     * \brief prepare Allocates every buffer, if size, type or levels differ from the last call.
+     * \param size Size of the full resolution image.
+     * \param type Type of the full resolution image.
+     * \param levels Number of times the image is downsampled.
+     * \return True if buffers were (re)allocated.
+     */
+    bool prepare(Size size, int type, int levels);
+    /*!
+     * \brief release Frees every buffer.
+     */
+    void release();
+
+    /*!
+     * \brief input Full resolution input image (converted to 32bit float).
+     */
+    Mat input;
+    /*!
+     * \brief scratch Full resolution intermediate image, e.g. before color conversion.
+     */
+    Mat scratch;
+    /*!
+     * \brief pyramid Levels of the Laplace Pyramid, levels+1 elements.
+     */
+    vector<Mat> pyramid;
+    /*!
+     * \brief down Downsampled image of every level (Gauss Pyramid), levels elements.
+     */
+    vector<Mat> down;
+    /*!
+     * \brief up Image with the size of every level, levels+1 elements. Used for upsampling.
+     */
+    vector<Mat> up;
+
+private:
+    Size imgSize;
+    int imgType;
+    int nLevels;
+};
+
 //////////////////////// 
 /// Downsampling ///////
 //////////////////////// 
@@ -62,6 +114,20 @@ void buildGaussPyrFromImg(const Mat &img, const int levels, vector<Mat> &pyr);
  * \param pyr Vector that holds every level of the pyramid. Last element is smallest image (not the difference).
  */
 void buildLaplacePyrFromImg(const Mat &img, const int levels, vector<Mat> &pyr);
+/*!
+ * \brief buildGaussPyrFromImg Builds a Gauss Pyramid in the buffers of a workspace.
+ * \param img Source image.
+ * \param levels Number of times the image is downsampled.
+ * \param ws Workspace, the levels are saved in ws.down. Last element is smallest image.
+ */
+void buildGaussPyrFromImg(const Mat &img, const int levels, PyramidWorkspace &ws);
+/*!
+ * \brief buildLaplacePyrFromImg Builds a Laplace Pyramid in the buffers of a workspace.
+ * \param img Source image, must not be a buffer of ws besides ws.input.
+ * \param levels Number of times the image is downsampled.
+ * \param ws Workspace, the levels are saved in ws.pyramid. Last element is smallest image (not the difference).
+ */
+void buildLaplacePyrFromImg(const Mat &img, const int levels, PyramidWorkspace &ws);
 /*!
  * \brief buildWaveletPyrFromImg Computes the discrete wavelet transform (DWT) with a Haar Wavelet as base.
  * \param img Source image.
@@ -91,6 +157,17 @@ void buildImgFromGaussPyr(const Mat &pyr, const int levels, Mat &dst, Size size)
  * \param dst Destination Mat for upsampled image.
  */
 void buildImgFromLaplacePyr(const vector<Mat> &pyr, const int levels, Mat &dst);
+/*!
+ * \brief buildImgFromLaplacePyr Reconstructs an image from a given Laplace Pyramid with every level multiplied
+ *  by a gain. Levels with a gain of 0 are skipped, each other level is added to the upsampled image in 1 pass.
+ * \param pyr Vector that holds the image levels of the Pyramid, must not be ws.up.
+ * \param levels Number of levels that are used to reconstruct the image. Should be < pyr.size.
+ * \param gains Gain of every level, levels+1 values.
+ * \param dst Destination Mat for upsampled image, shares its data with ws.up[0].
+ * \param ws Workspace that holds the upsampled images.
+ */
+void buildImgFromLaplacePyr(const vector<Mat> &pyr, const int levels, const vector<float> &gains, Mat &dst,
+                            PyramidWorkspace &ws);
 /*!
  * \brief buildImgFromWaveletPyr Reconstructs an image from a DWT.
  * \param pyr The pyramid, holding the levels on the 1st dimension and coefficients on the 2nd dimension.
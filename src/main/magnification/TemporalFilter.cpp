@@ -39,52 +39,80 @@ void iirFilter(const Mat &src, Mat &dst, Mat &lowpassHi, Mat &lowpassLo,
      * more than the old ones (= \param lowpass*), so long lasting movements are faded out fast.
      * The other way, a low cutoff evens out fast movements ocurring only in a few number of src images. */
 
-    Mat tmp1 = (1-cutoffHi)*lowpassHi + cutoffHi*src;
-    Mat tmp2 = (1-cutoffLo)*lowpassLo + cutoffLo*src;
-    lowpassHi = tmp1;
-    lowpassLo = tmp2;
+    CV_Assert(src.depth() == CV_32F);
+    CV_Assert(lowpassHi.size() == src.size() && lowpassHi.type() == src.type());
+    CV_Assert(lowpassLo.size() == src.size() && lowpassLo.type() == src.type());
+    dst.create(src.size(), src.type());
+
+    // Treat continuous images as 1 long row
+    int rows = src.rows;
+    int cols = src.cols * src.channels();
+    if(src.isContinuous() && dst.isContinuous() && lowpassHi.isContinuous() && lowpassLo.isContinuous()) {
+        cols *= rows;
+        rows = 1;
+    }
 
-    dst = lowpassHi - lowpassLo;
+    // lowpass = (1-cutoff)*lowpass + cutoff*src = lowpass + cutoff*(src-lowpass),
+    // both lowpass images are updated in place in the same pass that writes dst = lowpassHi - lowpassLo
+    const float alphaHi = (float)cutoffHi;
+    const float alphaLo = (float)cutoffLo;
+    for (int y = 0; y < rows; ++y) {
+        const float *s = src.ptr<float>(y);
+        float *hi = lowpassHi.ptr<float>(y);
+        float *lo = lowpassLo.ptr<float>(y);
+        float *d = dst.ptr<float>(y);
+        int x = 0;
+#if CV_SIMD
+        const v_float32 vAlphaHi = vx_setall_f32(alphaHi);
+        const v_float32 vAlphaLo = vx_setall_f32(alphaLo);
+        for (; x <= cols - v_float32::nlanes; x += v_float32::nlanes) {
+            v_float32 vs = vx_load(s + x);
+            v_float32 vHi = vx_load(hi + x);
+            v_float32 vLo = vx_load(lo + x);
+            vHi = v_muladd(vs - vHi, vAlphaHi, vHi);
+            vLo = v_muladd(vs - vLo, vAlphaLo, vLo);
+            v_store(hi + x, vHi);
+            v_store(lo + x, vLo);
+            v_store(d + x, vHi - vLo);
+        }
+#endif
+        for (; x < cols; ++x) {
+            hi[x] += alphaHi * (s[x] - hi[x]);
+            lo[x] += alphaLo * (s[x] - lo[x]);
+            d[x] = hi[x] - lo[x];
+        }
+    }
 }
 
 void iirWaveletFilter(const vector<Mat> &src, vector<Mat> &dst, vector<Mat> &lowpassHi, vector<Mat> &lowpassLo,
                       double cutoffLo, double cutoffHi)
 {
-    // Set minimum for cutoff, so low cutoff gets faded out
-    if(cutoffLo == 0)
-        cutoffLo = 0.01;
-
-    /* The higher cutoff*, the faster the lowpass* image of the lowpass* pyramid gets faded out.
-     * That means, a high cutoff weights new images (= \param src)
-     * more than the old ones (= \param lowpass*), so long lasting movements are faded out fast.
-     * The other way, a low cutoff evens out fast movements ocurring only in a few number of src images. */
-
     // Do this for every detail/coefficient image
-    for(int dims = 0; dims < 3; dims++) {
-        Mat tmp1 = (1-cutoffHi)*lowpassHi[dims] + cutoffHi*src[dims];
-        Mat tmp2 = (1-cutoffLo)*lowpassLo[dims] + cutoffLo*src[dims];
-        lowpassHi[dims] = tmp1;
-        lowpassLo[dims] = tmp2;
-
-        dst[dims] = lowpassHi[dims] - lowpassLo[dims];
-    }
+    for(int dims = 0; dims < 3; dims++)
+        iirFilter(src[dims], dst[dims], lowpassHi[dims], lowpassLo[dims], cutoffLo, cutoffHi);
 }
 
 void idealFilter(const Mat &src, Mat &dst , double cutoffLo, double cutoffHi, double framerate)
 {
-    if(cutoffLo == 0.00)
-        cutoffLo += 0.01;
+    IdealBandpassMask mask;
+    idealFilter(src, dst, mask, cutoffLo, cutoffHi, framerate);
+}
 
+void idealFilter(const Mat &src, Mat &dst, IdealBandpassMask &mask, double cutoffLo, double cutoffHi, double framerate)
+{
     int channelNrs = src.channels();
     Mat *channels = new Mat[channelNrs];
     split(src, channels);
 
+    // construct Filter, 1 row that is used for every row of the spectrum
+    int width = src.cols;
+    const float *filter = mask.get(width, cutoffLo, cutoffHi, framerate).ptr<float>(0);
+
     // Apply filter on each channel individually
     for (int curChannel = 0; curChannel < channelNrs; ++curChannel) {
         Mat current = channels[curChannel];
         Mat tempImg;
 
-        int width = current.cols;
         int height = getOptimalDFTSize(current.rows);
 
         copyMakeBorder(current, tempImg,
@@ -95,12 +123,21 @@ void idealFilter(const Mat &src, Mat &dst , double cutoffLo, double cutoffHi, do
         // DFT
         dft(tempImg, tempImg, DFT_ROWS | DFT_SCALE);
 
-        // construct Filter
-        Mat filter = tempImg.clone();
-        createIdealBandpassFilter(filter, cutoffLo, cutoffHi, framerate);
-
-        // apply
-        mulSpectrums(tempImg, filter, tempImg, DFT_ROWS);
+        // apply, same as mulSpectrums() with the mask in every row: Re0, (Re, Im) pairs, Re(N/2) if even.
+        // Padded rows are zero and get cropped, so they are skipped
+        for (int y = 0; y < current.rows; ++y) {
+            float *row = tempImg.ptr<float>(y);
+            row[0] *= filter[0];
+            int x = 1;
+            for (; x + 1 < width; x += 2) {
+                float re = row[x];
+                float im = row[x+1];
+                row[x]   = re*filter[x] - im*filter[x+1];
+                row[x+1] = re*filter[x+1] + im*filter[x];
+            }
+            if(x < width)
+                row[x] *= filter[x];
+        }
 
         // inverse
         idft(tempImg, tempImg, DFT_ROWS | DFT_SCALE);
@@ -116,59 +153,386 @@ void idealFilter(const Mat &src, Mat &dst , double cutoffLo, double cutoffHi, do
 void createIdealBandpassFilter(Mat &filter, double cutoffLo, double cutoffHi, double framerate)
 {
     float width = filter.cols;
-    float height = filter.rows;
 
     // Calculate frequencies according to framerate and size
     double fl = 2 * cutoffLo * width / framerate;
     double fh = 2 * cutoffHi * width / framerate;
 
-    double response;
+    // Create the filtermask, every row is the same
+    float *first = filter.ptr<float>(0);
+    for (int x = 0; x < filter.cols; ++x)
+        first[x] = (x >= fl && x <= fh) ? 1.0f : 0.0f;
+    for(int y = 1; y < filter.rows; ++y)
+        filter.row(0).copyTo(filter.row(y));
+}
 
-    // Create the filtermask, looks like the quarter of a circle
-    for(int y = 0; y < height; ++y) {
-        for (int x = 0; x < width; ++x) {
-            if(x >= fl && x <= fh)
-                response = 1.0f;
-            else
-                response = 0.0f;
+////////////////////////
+///Bandpass Mask ///////
+////////////////////////
+IdealBandpassMask::IdealBandpassMask() :
+    length(0),
+    cutoffLo(-1),
+    cutoffHi(-1),
+    framerate(-1),
+    rebuilds(0)
+{
+}
 
-            filter.at<float>(y,x) = response;
-        }
+const Mat &IdealBandpassMask::get(int windowLength, double cutoffLo, double cutoffHi, double framerate)
+{
+    if(mask.empty() || windowLength != length || cutoffLo != this->cutoffLo
+            || cutoffHi != this->cutoffHi || framerate != this->framerate) {
+        length = windowLength;
+        this->cutoffLo = cutoffLo;
+        this->cutoffHi = cutoffHi;
+        this->framerate = framerate;
+
+        // Set minimum for cutoff, so low cutoff gets faded out
+        mask.create(1, length, CV_32FC1);
+        createIdealBandpassFilter(mask, cutoffLo == 0.00 ? 0.01 : cutoffLo, cutoffHi, framerate);
+        ++rebuilds;
     }
+    return mask;
+}
+
+int IdealBandpassMask::revision() const
+{
+    return rebuilds;
+}
+
+void IdealBandpassMask::clear()
+{
+    mask.release();
+    length = 0;
 }
 
 ////////////////////////
 ///Helper //////////////
 ////////////////////////
-void img2tempMat(const Mat &frame, Mat &dst, int maxImages)
+void tempMat2img(const Mat &src, int position, const Size &frameSize, Mat &frame)
 {
-    // Reshape in 1 column
-    Mat reshaped = frame.reshape(frame.channels(), frame.cols*frame.rows).clone();
+    Mat line = src.col(position).clone();
+    frame = line.reshape(line.channels(), frameSize.height).clone();
+}
 
-    if(frame.channels() == 1)
-        reshaped.convertTo(reshaped, CV_32FC1);
-    else
-        reshaped.convertTo(reshaped, CV_32FC3);
+////////////////////////
+///Temporal Buffer /////
+////////////////////////
+TemporalRingBuffer::TemporalRingBuffer() :
+    cursor(0),
+    count(0)
+{
+}
 
-    // First frame
-    if(dst.cols == 0) {
-        reshaped.copyTo(dst);
+void TemporalRingBuffer::push(const Mat &frame, int maxImages)
+{
+    maxImages = std::max(maxImages, 1);
+    const int rows = frame.cols*frame.rows;
+    const int type = CV_MAKETYPE(CV_32F, frame.channels());
+
+    // First frame or frame layout changed, allocate storage for all frames at once
+    if(data.empty() || data.rows != rows || data.type() != type) {
+        data.create(rows, maxImages, type);
+        cursor = 0;
+        count = 0;
     }
-    // Later frames
-    else {
-        hconcat(dst,reshaped,dst);
+    // Capacity changed (depends on framerate)
+    else if(data.cols != maxImages) {
+        resize(maxImages);
     }
 
-    // If dst reaches maximum, delete the first column (eg the oldest image)
-    if(dst.cols > maxImages && maxImages != 0) {
-        dst.colRange(1,dst.cols).copyTo(dst);
+    // Reshape in 1 column and write it over the oldest frame
+    Mat reshaped = frame.isContinuous() ? frame.reshape(frame.channels(), rows)
+                                        : frame.clone().reshape(frame.channels(), rows);
+    Mat dst = data.col(cursor);
+    reshaped.convertTo(dst, type);
+
+    cursor = (cursor + 1) % data.cols;
+    count = std::min(count + 1, data.cols);
+}
+
+void TemporalRingBuffer::resize(int maxImages)
+{
+    Mat resized(data.rows, maxImages, data.type());
+    int keep = std::min(count, maxImages);
+
+    // Copy the newest frames in temporal order to the beginning of the new storage
+    for(int i = 0; i < keep; ++i) {
+        Mat dst = resized.col(i);
+        data.col(column(count-keep+i)).copyTo(dst);
     }
+
+    data = resized;
+    count = keep;
+    cursor = keep % maxImages;
 }
 
-void tempMat2img(const Mat &src, int position, const Size &frameSize, Mat &frame)
+Mat TemporalRingBuffer::window() const
 {
-    Mat line = src.col(position).clone();
-    frame = line.reshape(line.channels(), frameSize.height).clone();
+    // While filling up, the storage is in temporal order
+    return data.colRange(0, count);
+}
+
+int TemporalRingBuffer::column(int position) const
+{
+    int cap = data.cols;
+    return ((cursor - count + position) % cap + cap) % cap;
+}
+
+int TemporalRingBuffer::size() const
+{
+    return count;
+}
+
+int TemporalRingBuffer::capacity() const
+{
+    return data.cols;
+}
+
+bool TemporalRingBuffer::isFull() const
+{
+    return count > 0 && count == data.cols;
+}
+
+void TemporalRingBuffer::clear()
+{
+    data.release();
+    cursor = 0;
+    count = 0;
+}
+
+////////////////////////
+///Sliding Bandpass ////
+////////////////////////
+SlidingBandpassFilter::SlidingBandpassFilter() :
+    length(0),
+    rows(0),
+    type(-1),
+    maskRevision(-1),
+    samples(0),
+    anchored(false),
+    slides(0)
+{
+}
+
+void SlidingBandpassFilter::setBandpass(const Mat &mask)
+{
+    length = mask.cols;
+    const float *m = mask.ptr<float>(0);
+
+    // mulSpectrums() reads the mask as CCS packed spectrum: Re0, Re1, Im1, ..., Re(N/2).
+    // dft and idft are both scaled by 1/N.
+    double scale = 1.0 / ((double)length*length);
+    bins.clear();
+    gainRe.clear();
+    gainIm.clear();
+    for (int k = 0; k <= length/2; ++k) {
+        double re, im = 0.0;
+        if(k == 0)
+            re = m[0];
+        else if(2*k == length)
+            re = m[length-1];
+        else {
+            re = m[2*k-1];
+            im = m[2*k];
+        }
+        if(re == 0.0 && im == 0.0)
+            continue;
+
+        // Besides DC and Nyquist, every bin of a real signal has a complex conjugate partner
+        double weight = (k == 0 || 2*k == length) ? scale : 2.0*scale;
+        bins.push_back(k);
+        gainRe.push_back(re*weight);
+        gainIm.push_back(im*weight);
+    }
+
+    twiddleRe.resize(length);
+    twiddleIm.resize(length);
+    for (int n = 0; n < length; ++n) {
+        twiddleRe[n] = cos(2.0*M_PI*n/length);
+        twiddleIm[n] = sin(2.0*M_PI*n/length);
+    }
+
+    anchored = false;
+}
+
+void SlidingBandpassFilter::anchor(const TemporalRingBuffer &buffer)
+{
+    Mat window = buffer.window();
+    int cn = window.channels();
+    rows = window.rows;
+    type = window.type();
+    samples = rows*cn;
+
+    const size_t nBins = bins.size();
+    binRe.assign(nBins*samples, 0.0);
+    binIm.assign(nBins*samples, 0.0);
+
+    // S_k = sum(x_t * w^-kt), t = 0 is the oldest frame
+    for (int t = 0; t < length; ++t) {
+        Mat frame = window.col(buffer.column(t));
+        for (size_t b = 0; b < nBins; ++b) {
+            int n = (bins[b]*t) % length;
+            double c = twiddleRe[n];
+            double s = -twiddleIm[n];
+            double *re = &binRe[b*samples];
+            double *im = &binIm[b*samples];
+            for (int r = 0; r < rows; ++r) {
+                const float *x = frame.ptr<float>(r);
+                for (int ch = 0; ch < cn; ++ch) {
+                    re[r*cn+ch] += x[ch]*c;
+                    im[r*cn+ch] += x[ch]*s;
+                }
+            }
+        }
+    }
+
+    anchored = true;
+    slides = 0;
+}
+
+void SlidingBandpassFilter::slide(const TemporalRingBuffer &buffer, const Mat &frame)
+{
+    // Only a full window with unchanged layout slides, anything else gets recomputed by filter()
+    int cn = frame.channels();
+    if(!anchored || !buffer.isFull() || buffer.capacity() != length
+            || frame.cols*frame.rows != rows || CV_MAKETYPE(CV_32F, cn) != type) {
+        anchored = false;
+        return;
+    }
+
+    Mat newest = frame.isContinuous() ? frame.reshape(cn, rows) : frame.clone().reshape(cn, rows);
+    if(newest.depth() != CV_32F)
+        newest.convertTo(newest, type);
+    Mat oldest = buffer.window().col(buffer.column(0));
+
+    delta.resize(samples);
+    for (int r = 0; r < rows; ++r) {
+        const float *o = oldest.ptr<float>(r);
+        const float *n = newest.ptr<float>(r);
+        for (int ch = 0; ch < cn; ++ch)
+            delta[r*cn+ch] = (double)n[ch] - o[ch];
+    }
+
+    // S_k' = w^k * (S_k - oldest + newest)
+    for (size_t b = 0; b < bins.size(); ++b) {
+        double c = twiddleRe[bins[b]];
+        double s = twiddleIm[bins[b]];
+        double *re = &binRe[b*samples];
+        double *im = &binIm[b*samples];
+        for (int p = 0; p < samples; ++p) {
+            double sr = re[p] + delta[p];
+            double si = im[p];
+            re[p] = sr*c - si*s;
+            im[p] = sr*s + si*c;
+        }
+    }
+    ++slides;
+}
+
+bool SlidingBandpassFilter::filter(const TemporalRingBuffer &buffer, Mat &dst, int firstPosition, int lastPosition,
+                                   IdealBandpassMask &mask, double cutoffLo, double cutoffHi, double framerate)
+{
+    if(!buffer.isFull()) {
+        anchored = false;
+        return false;
+    }
+
+    const Mat &bandpass = mask.get(buffer.capacity(), cutoffLo, cutoffHi, framerate);
+    if(mask.revision() != maskRevision || bandpass.cols != length) {
+        setBandpass(bandpass);
+        maskRevision = mask.revision();
+    }
+
+    Mat window = buffer.window();
+    if(!anchored || slides >= length || window.rows != rows || window.type() != type)
+        anchor(buffer);
+
+    const int cn = CV_MAT_CN(type);
+    const size_t nBins = bins.size();
+
+    // Filtered spectrum Y_k = H_k * S_k and the bound sum(|Y_k|) >= |y_t| of every sample
+    filteredRe.resize(nBins*samples);
+    filteredIm.resize(nBins*samples);
+    bound.assign(samples, 0.0);
+    for (size_t b = 0; b < nBins; ++b) {
+        const double *re = &binRe[b*samples];
+        const double *im = &binIm[b*samples];
+        double *fr = &filteredRe[b*samples];
+        double *fi = &filteredIm[b*samples];
+        for (int p = 0; p < samples; ++p) {
+            fr[p] = gainRe[b]*re[p] - gainIm[b]*im[p];
+            fi[p] = gainRe[b]*im[p] + gainIm[b]*re[p];
+        }
+        for (int p = 0; p < samples; ++p)
+            bound[p] += std::sqrt(fr[p]*fr[p] + fi[p]*fi[p]);
+    }
+
+    // y_t = sum(Re(Y_k * w^kt)), rounded to float like the output of idft
+    auto synthesize = [&](int p, int t) -> float {
+        double y = 0.0;
+        for (size_t b = 0; b < nBins; ++b) {
+            int n = (bins[b]*t) % length;
+            y += filteredRe[b*samples+p]*twiddleRe[n] - filteredIm[b*samples+p]*twiddleIm[n];
+        }
+        return (float)y;
+    };
+
+    /* Requested frames, their values are the first estimate of the range */
+    double minVal = DBL_MAX;
+    double maxVal = -DBL_MAX;
+    dst.create(rows, lastPosition-firstPosition, type);
+    for (int r = 0; r < rows; ++r) {
+        float *out = dst.ptr<float>(r);
+        for (int t = firstPosition; t < lastPosition; ++t) {
+            for (int ch = 0; ch < cn; ++ch) {
+                float y = synthesize(r*cn+ch, t);
+                out[(t-firstPosition)*cn+ch] = y;
+                minVal = std::min(minVal, (double)y);
+                maxVal = std::max(maxVal, (double)y);
+            }
+        }
+    }
+
+    /* Range of the whole window. Every frame changes all filtered values of the window, so it can't be
+       carried over. Only samples whose bound exceeds the current range are synthesized, the margin covers
+       the rounding to float. */
+    for (int p = 0; p < samples; ++p) {
+        double b = bound[p] * (1.0 + 1e-6);
+        if(b <= maxVal && -b >= minVal)
+            continue;
+        for (int t = 0; t < length; ++t) {
+            float y = synthesize(p, t);
+            minVal = std::min(minVal, (double)y);
+            maxVal = std::max(maxVal, (double)y);
+        }
+    }
+
+    // Same as normalize(dst, dst, 0, 1, NORM_MINMAX) over the whole window
+    double scale = (maxVal - minVal > DBL_EPSILON) ? 1.0/(maxVal - minVal) : 0.0;
+    dst.convertTo(dst, -1, scale, -minVal*scale);
+
+    return true;
+}
+
+void SlidingBandpassFilter::clear()
+{
+    bins.clear();
+    gainRe.clear();
+    gainIm.clear();
+    binRe.clear();
+    binIm.clear();
+    filteredRe.clear();
+    filteredIm.clear();
+    bound.clear();
+    delta.clear();
+    length = 0;
+    rows = 0;
+    type = -1;
+    maskRevision = -1;
+    samples = 0;
+    anchored = false;
+    slides = 0;
 }
 
 ////////////////////////
@@ -451,3 +815,26 @@ void RieszTemporalFilter::pass(CompExpMat &result,
     passEach(cos(result), cos(phase), cos(prior));
     passEach(sin(result), sin(phase), sin(prior));
 }
+void RieszTemporalFilter::pass(CompExpMat &result,
+          const CompExpMat &phase,
+          const CompExpMat &prior,
+          const cv::Range &rows) {
+    // Same as passEach() per pixel, NaNs are patched to 0
+    const float b0 = static_cast<float>(itsB[0] / itsA[0]);
+    const float b1 = static_cast<float>(itsB[1] / itsA[0]);
+    const float a1 = static_cast<float>(itsA[1] / itsA[0]);
+    for (int part = 0; part < 2; ++part) {
+        cv::Mat &res = part ? sin(result) : cos(result);
+        const cv::Mat &cur = part ? sin(phase) : cos(phase);
+        const cv::Mat &old = part ? sin(prior) : cos(prior);
+        for (int y = rows.start; y < rows.end; ++y) {
+            float *r = res.ptr<float>(y);
+            const float *p = cur.ptr<float>(y);
+            const float *q = old.ptr<float>(y);
+            for (int x = 0; x < res.cols; ++x) {
+                const float value = b0 * p[x] + b1 * q[x] - a1 * r[x];
+                r[x] = cvIsNaN(value) ? 0.0f : value;
+            }
+        }
+    }
+}
@@ -27,8 +27,12 @@
 
 // Project
 #include "main/helper/ComplexMat.h"
+// C++
+#include <cfloat>
+#include <vector>
 // OpenCV
 #include "opencv2/core/core.hpp"
+#include "opencv2/core/hal/intrin.hpp"
 #include "opencv2/imgproc/imgproc.hpp"
 #include "opencv2/highgui/highgui.hpp"
 
@@ -40,15 +44,6 @@ using namespace std;
 ////////////////////////
 ///Helper //////////////
 ////////////////////////
-/*!
- * \brief img2tempMat (Color Magnification) Takes a Mat, reshapes it in 1 column with width*height rows & concatenates it
- *  on the right side of dst.
- * \param frame Input frame.
- * \param dst Matrice of concatenated reshaped frames, 1 column = 1 frame. Most right frame is most actual frame.
- * \param maxImages Maximum number of images hold in dst. If columns of dst > maxImages, the most
- *  left column is deleted. Value should be a power of 2 for fast DFT.
- */
-void img2tempMat(const Mat &frame, Mat &dst, int maxImages);
 /*!
  * \brief tempMat2img (Color Magnification) Takes a Mat of line-concatenated frames and reshapes 1 column back into a frame.
  * \param src Mat of concatenated frames.
@@ -59,19 +54,183 @@ void img2tempMat(const Mat &frame, Mat &dst, int maxImages);
 void tempMat2img(const Mat &src, int position, const Size &frameSize, Mat &frame);
 /*!
  * \brief createIdealBandpassFilter (Color Magnification) Creates a filter mask for an ideal filter.
- * \param filter Filter mask.
+ * \param filter Filter mask, every row gets the same mask. Has to be allocated as 32bit float.
  * \param cutoffLo Lower cutoff frequency.
  * \param cutoffHi Upper cutoff frequency.
  * \param framerate Framerate of processed video.
  */
 void createIdealBandpassFilter(Mat &filter, double cutoffLo, double cutoffHi, double framerate);
 
+////////////////////////
+///Bandpass Mask ///////
+////////////////////////
+/*!
+ * \brief The IdealBandpassMask class (Color Magnification) Caches the 1 row mask of createIdealBandpassFilter().
+ *  The mask only depends on window length, cutoffs and framerate, it is rebuilt when one of them changes and
+ *  applied to every row of a spectrum.
+ */
+class IdealBandpassMask {
+public:
+    IdealBandpassMask();
+
+    /*!
+     * \brief get Returns the mask for the parameters, rebuilds it only if one of them changed.
+     * \param windowLength Number of frames in the temporal window.
+     * \param cutoffLo Lower cutoff frequency.
+     * \param cutoffHi Upper cutoff frequency.
+     * \param framerate Framerate of processed video.
+     */
+    const Mat &get(int windowLength, double cutoffLo, double cutoffHi, double framerate);
+    /*!
+     * \brief revision Number that changes whenever the mask is rebuilt.
+     */
+    int revision() const;
+    void clear();
+
+private:
+    Mat mask;
+    int length;
+    double cutoffLo;
+    double cutoffHi;
+    double framerate;
+    int rebuilds;
+};
+
+////////////////////////
+///Temporal Buffer /////
+////////////////////////
+/*!
+ * \brief The TemporalRingBuffer class (Color Magnification) Fixed-capacity circular store of frames that
+ *  are reshaped to 1 column with width*height rows, 1 column = 1 frame. The storage is allocated once and a
+ *  new frame overwrites the column of the oldest one, so adding a frame never reallocates or moves the
+ *  other frames.
+ *  Once the buffer is full, the storage order of the columns is a rotation of the temporal order. Filters
+ *  working on the whole window with circular convolution (like idealFilter()) can therefore read window()
+ *  directly and map the frames afterwards with column().
+ */
+class TemporalRingBuffer {
+public:
+    TemporalRingBuffer();
+
+    /*!
+     * \brief push Reshapes frame to 1 column, converts it to 32bit float and writes it on the position of
+     *  the oldest frame.
+     * \param frame Input frame.
+     * \param maxImages Capacity of the buffer. Value should be a power of 2 for fast DFT. If the capacity
+     *  changes, the newest frames are kept.
+     */
+    void push(const Mat &frame, int maxImages);
+    /*!
+     * \brief window Filled columns of the buffer in storage order, without copying.
+     */
+    Mat window() const;
+    /*!
+     * \brief column Maps the temporal position of a frame to its column in window().
+     * \param position Position of the frame, 0 is the oldest, size()-1 the newest frame.
+     */
+    int column(int position) const;
+    int size() const;
+    int capacity() const;
+    bool isFull() const;
+    /*!
+     * \brief clear Deletes every frame and releases the storage.
+     */
+    void clear();
+
+private:
+    void resize(int maxImages);
+
+    // width*height rows x capacity columns
+    Mat data;
+    // Column that is written by the next push
+    int cursor;
+    // Number of frames held
+    int count;
+};
+
+////////////////////////
+///Sliding Bandpass ////
+////////////////////////
+/*!
+ * \brief The SlidingBandpassFilter class (Color Magnification) Streaming version of idealFilter() for a full
+ *  TemporalRingBuffer. Only the DFT bins that pass the ideal bandpass are held per pixel and channel. They are
+ *  updated with a sliding DFT, S_k' = w^k * (S_k - oldest + newest), so adding a frame costs O(bins) instead of
+ *  a complete dft/idft of the window.
+ *  The filtered frames match idealFilter(). To bound the numerical drift of the recurrence, the bins are
+ *  recomputed from the buffer after every window length of slides and whenever the window or the filter
+ *  parameters change.
+ *  The min/max normalization over the whole window only synthesizes the samples whose bound sum(|Y_k|) may
+ *  exceed the range of the requested frames.
+ */
+class SlidingBandpassFilter {
+public:
+    SlidingBandpassFilter();
+
+    /*!
+     * \brief slide Updates the bins with frame, which replaces the oldest frame of buffer.
+     *  Has to be called right before buffer.push(frame).
+     * \param buffer Temporal buffer that frame is pushed into.
+     * \param frame Input frame, the smallest level of the Gauss pyramid.
+     */
+    void slide(const TemporalRingBuffer &buffer, const Mat &frame);
+    /*!
+     * \brief filter Filters the window of buffer and normalizes it like idealFilter().
+     * \param buffer Temporal buffer with the frames to filter.
+     * \param dst Filtered frames firstPosition to lastPosition-1, 1 column = 1 frame.
+     * \param firstPosition Temporal position of the first frame written to dst, 0 is the oldest frame.
+     * \param lastPosition Temporal position behind the last frame written to dst.
+     * \param mask Cached mask of the ideal bandpass.
+     * \param cutoffLo Lower cutoff frequency.
+     * \param cutoffHi Upper cutoff frequency.
+     * \param framerate Framerate of processed video.
+     * \return False if buffer isn't full yet, dst is untouched and idealFilter() has to be used.
+     */
+    bool filter(const TemporalRingBuffer &buffer, Mat &dst, int firstPosition, int lastPosition,
+                IdealBandpassMask &mask, double cutoffLo, double cutoffHi, double framerate);
+    /*!
+     * \brief clear Deletes the bins, the next call of filter() recomputes them.
+     */
+    void clear();
+
+private:
+    void setBandpass(const Mat &mask);
+    void anchor(const TemporalRingBuffer &buffer);
+
+    // Parameters the bins were computed for
+    int length;
+    int rows;
+    int type;
+    int maskRevision;
+
+    // Indices k of the bins that pass the filter and their gains (CCS packed mask of idealFilter)
+    vector<int> bins;
+    vector<double> gainRe;
+    vector<double> gainIm;
+    // w^n = exp(j*2*pi*n/length), n = 0..length-1
+    vector<double> twiddleRe;
+    vector<double> twiddleIm;
+    // Bins of every pixel channel, [bin*samples + sample]
+    vector<double> binRe;
+    vector<double> binIm;
+    int samples;
+
+    // Per frame scratch, filtered bins Y_k = H_k * S_k, |Y_k| bound per sample and newest - oldest
+    vector<double> filteredRe;
+    vector<double> filteredIm;
+    vector<double> bound;
+    vector<double> delta;
+
+    bool anchored;
+    int slides;
+};
+
 ////////////////////////
 ///Filter //////////////
 ////////////////////////
 /*!
  * \brief iirFilter (Euler Magnification) Applies an iirFilter (in space domain) on 1 level of a Laplace Pyramid.
- * \param src Newest input image of a level of a Laplace Pyramid.
+ *  Both lowpass images are updated in place, they must not share their data with src or dst.
+ * \param src Newest input image of a level of a Laplace Pyramid (32bit float).
  * \param dst Iir filtered level of a Laplace Pyramid.
  * \param lowpassHi Holding the informations about the previous (high) lowpass filtered images of a level.
  * \param lowpassLo Holding the informations about the previous (low) lowpass filtered images of a level.
@@ -98,6 +257,16 @@ void iirWaveletFilter(const vector<Mat> &src, vector<Mat> &dst, vector<Mat> &low
  * \param framerate
  */
 void idealFilter(const Mat &src, Mat &dst, double cutoffLo, double cutoffHi, double framerate);
+/*!
+ * \brief idealFilter (Color Magnification) Same as above, but takes the filter mask from a cache.
+ * \param src
+ * \param dst
+ * \param mask Cached mask of the ideal bandpass.
+ * \param cutoffLo
+ * \param cutoffHi
+ * \param framerate
+ */
+void idealFilter(const Mat &src, Mat &dst, IdealBandpassMask &mask, double cutoffLo, double cutoffHi, double framerate);
 
 ///
 // From https://github.com/tbl3rd/Pyramids
@@ -131,6 +300,12 @@ public:
     void pass(CompExpMat &result,
               const CompExpMat &phase,
               const CompExpMat &prior);
+
+    // Same for the rows of a band, result has to be allocated.
+    void pass(CompExpMat &result,
+              const CompExpMat &phase,
+              const CompExpMat &prior,
+              const cv::Range &rows);
 };
 
 #endif // TEMPORALFILTER_H
@@ -27,136 +27,283 @@
 
 // Qt
 #include <QMutex>
-#include <QQueue>
-#include <QSemaphore>
-#include <QByteArray>
-#include <QDebug>
+#include <QWaitCondition>
+// C++
+#include <atomic>
+#include <cstddef>
+#include <thread>
+// Local
+#include "main/helper/Profiler.h"
 
+// Behaviour of Buffer::add() if the buffer is full
+enum BufferFullPolicy {
+    BlockIfFull,        // Wait until an item is taken
+    DropNewestIfFull,   // Discard the added item
+    DropOldestIfFull    // Discard the oldest item and add the new one
+};
+
+// Bounded lock-free ring (sequence numbered slots), built for 1 producer and
+// 1 consumer. Slots are claimed with compare-and-swap, so a producer that
+// drops the oldest item and clear() may take items concurrently to the
+// consumer. Threads only sleep on the wait conditions if the buffer is
+// empty (get) or full (blocking add), the fast path takes no lock.
 template<class T> class Buffer
 {
     public:
         Buffer(int size);
-        void add(const T& data, bool dropIfFull=false);
+        ~Buffer();
+        // Returns false if an item was dropped
+        bool add(const T& data, bool dropIfFull=false);
+        bool add(const T& data, BufferFullPolicy policy);
         T get();
+        // Non-blocking get, returns false if the buffer is empty
+        bool tryGet(T& data);
         int size();
         int maxSize();
         bool clear();
         bool isFull();
         bool isEmpty();
+        // Adds the wait of get() and of a blocking add() and the depth after every
+        // add() to profiler (0 = off). Has to be set before the buffer is used.
+        void setProfiler(Profiler *profiler, const char *getWaitStage, const char *addWaitStage,
+                         const char *depthStage);
 
     private:
-        QMutex queueProtect;
-        QQueue<T> queue;
-        QSemaphore *freeSlots;
-        QSemaphore *usedSlots;
-        QSemaphore *clearBuffer_add;
-        QSemaphore *clearBuffer_get;
+        Buffer(const Buffer&);
+        Buffer& operator=(const Buffer&);
+
+        struct Slot {
+            // pos+1: holds the item of position pos, pos+bufferSize: free for position pos+bufferSize
+            std::atomic<size_t> sequence;
+            T data;
+        };
+        bool push(const T& data);
+        bool pop(T& data);
+        void wakeConsumers();
+        void wakeProducers();
+
+        enum { CacheLineSize = 64 };
+        // Next position to write, on its own cache line
+        std::atomic<size_t> head;
+        char headPadding[CacheLineSize - sizeof(std::atomic<size_t>)];
+        // Next position to read, on its own cache line
+        std::atomic<size_t> tail;
+        char tailPadding[CacheLineSize - sizeof(std::atomic<size_t>)];
+        Slot *slots;
         int bufferSize;
+        // Sleeping threads
+        std::atomic<int> waitingConsumers;
+        std::atomic<int> waitingProducers;
+        QMutex waitMutex;
+        QWaitCondition notEmpty;
+        QWaitCondition notFull;
+        // Instrumentation
+        Profiler *profiler;
+        const char *getWaitStage;
+        const char *addWaitStage;
+        const char *depthStage;
 };
 
 template<class T> Buffer<T>::Buffer(int size)
 {
     // Save buffer size
-    bufferSize = size;
-    // Create semaphores
-    freeSlots = new QSemaphore(bufferSize);
-    usedSlots = new QSemaphore(0);
-    clearBuffer_add = new QSemaphore(1);
-    clearBuffer_get = new QSemaphore(1);
+    bufferSize = size > 0 ? size : 1;
+    // Create slots, slot i is free for position i
+    slots = new Slot[bufferSize];
+    for(int i = 0; i < bufferSize; i++)
+        slots[i].sequence.store(i, std::memory_order_relaxed);
+    head.store(0, std::memory_order_relaxed);
+    tail.store(0, std::memory_order_relaxed);
+    waitingConsumers.store(0);
+    waitingProducers.store(0);
+    profiler = 0;
+}
+
+template<class T> Buffer<T>::~Buffer()
+{
+    delete[] slots;
+}
+
+template<class T> bool Buffer<T>::push(const T& data)
+{
+    size_t pos = head.load(std::memory_order_relaxed);
+    Slot *slot;
+    for(;;)
+    {
+        slot = &slots[pos % bufferSize];
+        const size_t seq = slot->sequence.load(std::memory_order_acquire);
+        const std::ptrdiff_t diff = static_cast<std::ptrdiff_t>(seq - pos);
+        // Slot is free, claim it
+        if(diff == 0)
+        {
+            if(head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                break;
+        }
+        // Slot still holds (or is being read of) the item of 1 lap before
+        else if(diff < 0)
+            return false;
+        else
+            pos = head.load(std::memory_order_relaxed);
+    }
+    slot->data = data;
+    slot->sequence.store(pos + 1, std::memory_order_release);
+    return true;
 }
 
-template<class T> void Buffer<T>::add(const T& data, bool dropIfFull)
+template<class T> bool Buffer<T>::pop(T& data)
 {
-    // Acquire semaphore
-    clearBuffer_add->acquire();
-    // If dropping is enabled, do not block if buffer is full
-    if(dropIfFull)
+    size_t pos = tail.load(std::memory_order_relaxed);
+    Slot *slot;
+    for(;;)
     {
-        // Try and acquire semaphore to add item
-        if(freeSlots->tryAcquire())
+        slot = &slots[pos % bufferSize];
+        const size_t seq = slot->sequence.load(std::memory_order_acquire);
+        const std::ptrdiff_t diff = static_cast<std::ptrdiff_t>(seq - (pos + 1));
+        // Slot holds an item, claim it
+        if(diff == 0)
         {
-            // Add item to queue
-            queueProtect.lock();
-            queue.enqueue(data);
-            queueProtect.unlock();
-            // Release semaphore
-            usedSlots->release();
+            if(tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                break;
         }
+        // Slot isn't written yet
+        else if(diff < 0)
+            return false;
+        else
+            pos = tail.load(std::memory_order_relaxed);
     }
-    // If buffer is full, wait on semaphore
-    else
+    data = slot->data;
+    // Do not keep a reference to the item in the ring
+    slot->data = T();
+    slot->sequence.store(pos + bufferSize, std::memory_order_release);
+    return true;
+}
+
+// A sleeping thread registers itself and checks the buffer again under
+// waitMutex, the fences make sure that either it sees the item or the
+// other side sees it waiting.
+template<class T> void Buffer<T>::wakeConsumers()
+{
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if(waitingConsumers.load(std::memory_order_relaxed) > 0)
     {
-        // Acquire semaphore
-        freeSlots->acquire();
-        // Add item to queue
-        queueProtect.lock();
-        queue.enqueue(data);
-        queueProtect.unlock();
-        // Release semaphore
-        usedSlots->release();
+        QMutexLocker locker(&waitMutex);
+        notEmpty.wakeAll();
     }
-    // Release semaphore
-    clearBuffer_add->release();
 }
 
-template<class T> T Buffer<T>::get()
+template<class T> void Buffer<T>::wakeProducers()
 {
-    // Local variable(s)
-    T data;
-    // Acquire semaphores
-    clearBuffer_get->acquire();
-    usedSlots->acquire();
-    // Take item from queue
-    queueProtect.lock();
-    data=queue.dequeue();
-    queueProtect.unlock();
-    // Release semaphores
-    freeSlots->release();
-    clearBuffer_get->release();
-    // Return item to caller
-    return data;
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if(waitingProducers.load(std::memory_order_relaxed) > 0)
+    {
+        QMutexLocker locker(&waitMutex);
+        notFull.wakeAll();
+    }
 }
 
-template<class T> bool Buffer<T>::clear()
+template<class T> bool Buffer<T>::add(const T& data, bool dropIfFull)
+{
+    return add(data, dropIfFull ? DropNewestIfFull : BlockIfFull);
+}
+
+template<class T> bool Buffer<T>::add(const T& data, BufferFullPolicy policy)
 {
-    // Check if buffer contains items
-    if(queue.size()>0)
+    bool dropped = false;
+    qint64 waitStart = -1;
+    while(!push(data))
     {
-        // Stop adding items to buffer (will return false if an item is currently being added to the buffer)
-        if(clearBuffer_add->tryAcquire())
+        if(policy == DropNewestIfFull)
+            return false;
+
+        if(policy == DropOldestIfFull)
         {
-            // Stop taking items from buffer (will return false if an item is currently being taken from the buffer)
-            if(clearBuffer_get->tryAcquire())
+            // Make room, if the consumer is just taking the oldest item let it finish
+            T oldest;
+            if(pop(oldest))
             {
-                // Release all remaining slots in queue
-                freeSlots->release(queue.size());
-                // Acquire all queue slots
-                freeSlots->acquire(bufferSize);
-                // Reset usedSlots to zero
-                usedSlots->acquire(queue.size());
-                // Clear buffer
-                queue.clear();
-                // Release all slots
-                freeSlots->release(bufferSize);
-                // Allow get method to resume
-                clearBuffer_get->release();
+                dropped = true;
+                wakeProducers();
             }
             else
-                return false;
-            // Allow add method to resume
-            clearBuffer_add->release();
-            return true;
+                std::this_thread::yield();
+            continue;
         }
-        else
-            return false;
+
+        // Wait until the consumer takes an item
+        if(profiler && waitStart < 0)
+            waitStart = Profiler::now();
+        QMutexLocker locker(&waitMutex);
+        waitingProducers.fetch_add(1);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if(!isFull())
+        {
+            waitingProducers.fetch_sub(1);
+            continue;
+        }
+        notFull.wait(&waitMutex);
+        waitingProducers.fetch_sub(1);
+    }
+    wakeConsumers();
+    if(profiler) {
+        if(waitStart >= 0)
+            profiler->addSpan(addWaitStage, waitStart, Profiler::now() - waitStart);
+        profiler->addValue(depthStage, size());
     }
-    else
+    return !dropped;
+}
+
+template<class T> bool Buffer<T>::tryGet(T& data)
+{
+    if(!pop(data))
         return false;
+    wakeProducers();
+    return true;
+}
+
+template<class T> T Buffer<T>::get()
+{
+    // Local variable(s)
+    T data;
+    const qint64 waitStart = profiler ? Profiler::now() : 0;
+    while(!tryGet(data))
+    {
+        // Wait until the producer adds an item
+        QMutexLocker locker(&waitMutex);
+        waitingConsumers.fetch_add(1);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if(!isEmpty())
+        {
+            waitingConsumers.fetch_sub(1);
+            continue;
+        }
+        notEmpty.wait(&waitMutex);
+        waitingConsumers.fetch_sub(1);
+    }
+    if(profiler)
+        profiler->addSpan(getWaitStage, waitStart, Profiler::now() - waitStart);
+    // Return item to caller
+    return data;
+}
+
+template<class T> bool Buffer<T>::clear()
+{
+    // Take all items, concurrent add() and get() stay possible
+    T data;
+    bool cleared = false;
+    while(pop(data))
+        cleared = true;
+    if(cleared)
+        wakeProducers();
+    return cleared;
 }
 
 template<class T> int Buffer<T>::size()
 {
-    return queue.size();
+    // Read tail first, so that a concurrent add cannot make the result negative
+    const size_t first = tail.load(std::memory_order_acquire);
+    const size_t last = head.load(std::memory_order_acquire);
+    const std::ptrdiff_t count = static_cast<std::ptrdiff_t>(last - first);
+    return count < 0 ? 0 : (count > bufferSize ? bufferSize : static_cast<int>(count));
 }
 
 template<class T> int Buffer<T>::maxSize()
@@ -166,12 +313,21 @@ template<class T> int Buffer<T>::maxSize()
 
 template<class T> bool Buffer<T>::isFull()
 {
-    return queue.size()==bufferSize;
+    return size()==bufferSize;
 }
 
 template<class T> bool Buffer<T>::isEmpty()
 {
-    return queue.size()==0;
+    return size()==0;
+}
+
+template<class T> void Buffer<T>::setProfiler(Profiler *profiler, const char *getWaitStage,
+                                              const char *addWaitStage, const char *depthStage)
+{
+    this->profiler = profiler;
+    this->getWaitStage = getWaitStage;
+    this->addWaitStage = addWaitStage;
+    this->depthStage = depthStage;
 }
 
 #endif // BUFFER_H
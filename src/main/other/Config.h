@@ -31,8 +31,29 @@
 
 // Image buffer size
 #define DEFAULT_IMAGE_BUFFER_SIZE           1
+// Maximum number of captured frames kept for reuse
+#define FRAME_POOL_MAX_SIZE                 64
+// Maximum number of magnified frames a Magnificator keeps for reuse
+#define MAGNIFIED_POOL_MAX_SIZE             8
+// Maximum number of scaled frames kept for the display: the one in the mailbox,
+// the one shown and the one being scaled
+#define DISPLAY_POOL_MAX_SIZE               4
+// Frames shown per second if the refresh rate of the screen is unknown
+#define DISPLAY_DEFAULT_REFRESH_RATE        60
+// Frames queued between the stages of the processing pipeline
+#define PIPELINE_QUEUE_SIZE                 2
+// Frames the player decodes ahead of the playback
+#define PLAYER_LOOKAHEAD_FRAMES             8
+// Frames queued for the encoder of a recording
+#define RECORD_QUEUE_SIZE                   32
+// Behaviour of a recording if the encoder can't keep up (EncoderBlock, EncoderDrop, EncoderSpill)
+#define DEFAULT_RECORD_QUEUE_POLICY         EncoderSpill
+// Weight of the newest frame in the smoothed stage latencies
+#define PIPELINE_LATENCY_SMOOTHING          0.1
 // Drop frame if image/frame buffer is full
 #define DEFAULT_DROP_FRAMES                 false
+// Drop the oldest instead of the newest frame (lowest latency), if frames are dropped
+#define DEFAULT_DROP_OLDEST_FRAMES          true
 // Thread priorities
 #define DEFAULT_CAP_THREAD_PRIO             QThread::NormalPriority
 #define DEFAULT_PROC_THREAD_PRIO            QThread::HighPriority
@@ -44,6 +65,39 @@
 #define DEFAULT_LAP_MAG_EXAGGERATION        2.0
 #define DEFAULT_LAP_MAG_LEVELS              4
 
+// Cores shared by the magnification of all streams (0 = all cores)
+#define DEFAULT_MAGNIFICATION_CORES         0
+// Framerate of streams that don't know theirs yet, sets the deadline of their frames
+#define DEFAULT_EXECUTOR_FRAMERATE          30.0
+// Workers of the parallel export (0 = cores of the executor, 1 = serial export)
+#define DEFAULT_EXPORT_WORKERS              0
+// Frames every chunk of the parallel export is magnified ahead of its start at least
+#define DEFAULT_EXPORT_PREROLL_FRAMES       30
+// Maximal difference of parallel to serial export in 8 bit gray values
+#define DEFAULT_EXPORT_TOLERANCE            0.5
+// Frames of 1 chunk of the parallel export, grows to twice the pre-roll
+#define EXPORT_CHUNK_FRAMES                 240
+// Magnified frames the parallel export holds ahead of the writer at most
+#define EXPORT_BUFFER_BYTES                 (size_t(256) << 20)
+// Export serially if the filters need a longer pre-roll to converge
+#define EXPORT_MAX_PREROLL_FRAMES           300
+// Rows of 1 band of the per-level work of the magnification, which runs all levels in parallel
+#define LEVEL_TILE_ROWS                     32
+// Scratch rows per thread of the tiled filters, see rowScratch()
+#define ROW_SCRATCH_SLOTS                   2
+// Rows of 1 band of the multi-threaded Riesz pyramid (has to be even)
+#define RIESZ_TILE_ROWS                     32
+// Relative error of the separable Riesz pyramid filters (0 = exact 9x9 kernels)
+#define DEFAULT_RIESZ_FILTER_TOLERANCE      0.01
+
+// Stages and threads with own histograms per Profiler, further threads share them
+#define PROFILER_MAX_STAGES                 32
+#define PROFILER_THREADS                    8
+// Samples per Profiler kept for the Chrome trace
+#define PROFILER_TRACE_EVENTS               8192
+// Interval of the percentiles in the tooltip of the processing rate in ms
+#define PROFILER_SUMMARY_INTERVAL           1000
+
 // General Default on Startup
 #define DEFAULT_GRAYSCALE                   false
 #define DEFAULT_MAGNIFY_TYPE                0 // Options: [NONE=0,-1;COLOR=1;LAPLACE=2;RIESZ=3]
@@ -69,5 +123,37 @@
 #define DEFAULT_PB_COWAVELENGTH             25
 #define DEFAULT_PB_COLOW                    0.1
 #define DEFAULT_PB_COHIGH                   1.0
+// Benchmark rvm-bench, measured and unmeasured frames per run, seed of the synthetic clip
+#define BENCH_FRAMES                        100
+#define BENCH_WARMUP_FRAMES                 10
+#define BENCH_SEED                          0x52564d
+// Checks of rvm-test, seed of the test frames and maximal errors of the separable Riesz pyramid
+// filters against the exact kernels in the range [0,1], for smooth frames and for hard edges
+#define TEST_SEED                           0x52564d
+#define TEST_RIESZ_MAX_ERROR                0.01
+#define TEST_RIESZ_MEAN_ERROR               0.0025
+#define TEST_RIESZ_EDGES_MAX_ERROR          0.025
+#define TEST_RIESZ_EDGES_MEAN_ERROR         0.008
+// Window of the sliding bandpass check, windows it runs and maximal error in the range [0,1]
+#define TEST_SLIDING_LENGTH                 32
+#define TEST_SLIDING_WINDOWS                4
+#define TEST_SLIDING_MAX_ERROR              1e-4
+// Frames of the PNG sequence exported serially and by TEST_EXPORT_WORKERS in chunks
+#define TEST_EXPORT_FRAMES                  600
+#define TEST_EXPORT_WORKERS                 4
+// Frames of the allocation check after the frames that allocate the buffers, and maximal
+// error of the Laplace pyramid of the workspace against pyrDown/pyrUp in the range [0,1]
+#define TEST_ALLOCATION_WARMUP              10
+#define TEST_ALLOCATION_FRAMES              30
+#define TEST_PYRAMID_MAX_ERROR              1e-5
+// Frames magnified in one piece and decomposed and filtered by 2 Magnificators like the pipeline
+#define TEST_SPLIT_FRAMES                   30
+// Maximal errors of the polynomial acos and cos/sin of the Riesz kernels against the C++ library,
+// cos/sin swept over [-TEST_FAST_MATH_RANGE, TEST_FAST_MATH_RANGE], and of the amplification of a
+// Riesz level against the former cv::Mat expressions with std::cos/sin in the range [-0.5,0.5]
+#define TEST_FAST_ACOS_MAX_ERROR            1e-6
+#define TEST_FAST_COSSIN_MAX_ERROR          1e-6
+#define TEST_FAST_MATH_RANGE                20.0
+#define TEST_AMPLIFY_MAX_ERROR              1e-5
 
 #endif // CONFIG_H
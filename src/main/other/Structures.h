@@ -27,6 +27,8 @@
 
 // Qt
 #include <QtCore/QRect>
+// Local
+#include "main/other/Config.h"
 
 struct ImageProcessingSettings{
     double amplification;
@@ -38,6 +40,8 @@ struct ImageProcessingSettings{
     int frameHeight;
     double framerate;
     int levels;
+    // Relative error of the separable Riesz pyramid filters, 0 uses the exact kernels
+    double rieszFilterTolerance;
 
     ImageProcessingSettings() :
         amplification(0.0),
@@ -48,7 +52,8 @@ struct ImageProcessingSettings{
         frameWidth(0),
         frameHeight(0),
         framerate(0.0),
-        levels(4)
+        levels(4),
+        rieszFilterTolerance(DEFAULT_RIESZ_FILTER_TOLERANCE)
     {
     }
 };
@@ -78,6 +83,26 @@ struct ThreadStatisticsData{
     int averageFPS;
     double nFramesProcessed;
     double averageVidProcessingFPS;
+    double nFramesDropped;
+    double bytesCopiedPerFrame;
+    // Smoothed latencies of the processing pipeline stages in ms
+    double prepareLatency;
+    double decomposeLatency;
+    double magnifyLatency;
+    double outputLatency;
+
+    ThreadStatisticsData() :
+        averageFPS(0),
+        nFramesProcessed(0),
+        averageVidProcessingFPS(0),
+        nFramesDropped(0),
+        bytesCopiedPerFrame(0),
+        prepareLatency(0),
+        decomposeLatency(0),
+        magnifyLatency(0),
+        outputLatency(0)
+    {
+    }
 };
 
 #endif // STRUCTURES_H
@@ -0,0 +1,654 @@
+/************************************************************************************/
+/* An OpenCV/Qt based realtime application to magnify motion and color              */
+/* Copyright (C) 2015  Jens Schindel <kontakt@jens-schindel.de>                     */
+/*                                                                                  */
+/* Based on the work of                                                             */
+/*      Joseph Pan      <https://github.com/wzpan/QtEVM>                            */
+/*      Nick D'Ademo    <https://github.com/nickdademo/qt-opencv-multithreaded>     */
+/*                                                                                  */
+/* Realtime-Video-Magnification->test.cpp                                           */
+/*                                                                                  */
+/* This program is free software: you can redistribute it and/or modify             */
+/* it under the terms of the GNU General Public License as published by             */
+/* the Free Software Foundation, either version 3 of the License, or                */
+/* (at your option) any later version.                                              */
+/*                                                                                  */
+/* This program is distributed in the hope that it will be useful,                  */
+/* but WITHOUT ANY WARRANTY; without even the implied warranty of                   */
+/* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                    */
+/* GNU General Public License for more details.                                     */
+/*                                                                                  */
+/* You should have received a copy of the GNU General Public License                */
+/* along with this program.  If not, see <http://www.gnu.org/licenses/>.            */
+/************************************************************************************/
+
+// Qt
+#include <QCoreApplication>
+#include <QDir>
+#include <QTemporaryDir>
+#include <QTextStream>
+// OpenCV
+#include <opencv2/core.hpp>
+#include <opencv2/imgcodecs.hpp>
+#include <opencv2/imgproc.hpp>
+// C++
+#include <algorithm>
+#include <cmath>
+#include <limits>
+// Local
+#include "main/helper/AllocationCounter.h"
+#include "main/helper/FastMath.h"
+#include "main/helper/MagnificationExecutor.h"
+#include "main/magnification/Magnificator.h"
+#include "main/magnification/RieszPyramid.h"
+#include "main/magnification/SpatialFilter.h"
+#include "main/magnification/TemporalFilter.h"
+#include "main/other/Config.h"
+#include "main/threads/SavingThread.h"
+
+using namespace cv;
+
+// Checks of the magnification that need no display and no video files,
+// run with rvm-test. Videos are written as PNG sequences to a temporary
+// directory, so no codec changes the frames. Every check prints its measured values and returns
+// false if they exceed its bound.
+
+static bool check(bool passed, const QString &name, const QString &values)
+{
+    QTextStream(stderr) << (passed ? "PASS " : "FAIL ") << name << ": " << values << "\n";
+    return passed;
+}
+
+// Smooth noise scaled to [0,1] like the synthetic clip of rvm-bench, or hard
+// edges of a checkerboard
+static Mat testFrame(Size size, bool edges)
+{
+    Mat frame(size, CV_32F);
+    if(edges) {
+        for(int y = 0; y < size.height; y++)
+            for(int x = 0; x < size.width; x++)
+                frame.at<float>(y, x) = ((x/7 + y/5) % 2) ? 1.0f : 0.0f;
+        return frame;
+    }
+    RNG rng(TEST_SEED);
+    rng.fill(frame, RNG::UNIFORM, 0.0, 1.0);
+    GaussianBlur(frame, frame, Size(0, 0), 2.0);
+    normalize(frame, frame, 0.0, 1.0, NORM_MINMAX);
+    return frame;
+}
+
+// Builds and collapses a Riesz pyramid of frame with the given filter tolerance
+static Mat rieszRoundTrip(Mat frame, int levels, double tolerance)
+{
+    RieszPyramid pyramid;
+    pyramid.setFilterTolerance(tolerance);
+    pyramid.init(frame, levels);
+    return pyramid.collapsePyramid().clone();
+}
+
+// The separable filters of DEFAULT_RIESZ_FILTER_TOLERANCE against the exact
+// 9x9 kernels, in the range [0,1] of the image
+static bool testRieszFilterTolerance()
+{
+    struct Case {
+        const char *name;
+        Size size;
+        int levels;
+        bool edges;
+        double maxError;
+        double meanError;
+    };
+    const Case cases[] = {
+        { "noise 320x240", Size(320, 240), 5, false, TEST_RIESZ_MAX_ERROR, TEST_RIESZ_MEAN_ERROR },
+        { "noise 333x251", Size(333, 251), 4, false, TEST_RIESZ_MAX_ERROR, TEST_RIESZ_MEAN_ERROR },
+        { "edges 320x240", Size(320, 240), 5, true, TEST_RIESZ_EDGES_MAX_ERROR, TEST_RIESZ_EDGES_MEAN_ERROR }
+    };
+
+    bool passed = true;
+    for(const Case &c : cases) {
+        const Mat frame = testFrame(c.size, c.edges);
+        const Mat exact = rieszRoundTrip(frame, c.levels, 0.0);
+        const Mat approx = rieszRoundTrip(frame, c.levels, DEFAULT_RIESZ_FILTER_TOLERANCE);
+        Mat difference;
+        absdiff(exact, approx, difference);
+        double maxError;
+        minMaxLoc(difference, 0, &maxError);
+        const double meanError = mean(difference)[0];
+        passed &= check(maxError <= c.maxError && meanError <= c.meanError,
+                        QString("riesz filter tolerance, ") + c.name,
+                        QString("max %1 (bound %2), mean %3 (bound %4)")
+                        .arg(maxError).arg(c.maxError).arg(meanError).arg(c.meanError));
+    }
+    return passed;
+}
+
+// The sliding DFT of the color magnification against idealFilter() of the same window, for the newest
+// frame like Magnificator::colorMagnify(). A spike leaves the window, so its range has to shrink again
+static bool testSlidingBandpass()
+{
+    const int length = TEST_SLIDING_LENGTH;
+    const double framerate = DEFAULT_EXECUTOR_FRAMERATE;
+    const double cutoffLo = 0.5, cutoffHi = 2.0;
+
+    TemporalRingBuffer buffer;
+    SlidingBandpassFilter sliding;
+    IdealBandpassMask slidingMask, idealMask;
+    RNG rng(TEST_SEED);
+    Mat frame(6, 8, CV_32FC3), filtered, ideal;
+
+    int frames = 0;
+    double maxError = 0;
+    for(int i = 0; i < TEST_SLIDING_WINDOWS*length; i++) {
+        rng.fill(frame, RNG::UNIFORM, 0.0, 0.1);
+        frame += Scalar::all(0.5 + 0.2*std::sin(2.0*M_PI*1.0*i/framerate));
+        if(i == length + 3)
+            frame *= 10.0;
+        sliding.slide(buffer, frame);
+        buffer.push(frame, length);
+        if(!sliding.filter(buffer, filtered, length-1, length, slidingMask, cutoffLo, cutoffHi, framerate))
+            continue;
+
+        idealFilter(buffer.window(), ideal, idealMask, cutoffLo, cutoffHi, framerate);
+        Mat difference;
+        absdiff(filtered.col(0), ideal.col(buffer.column(length-1)), difference);
+        double frameMax;
+        minMaxLoc(difference.reshape(1), 0, &frameMax);
+        maxError = std::max(maxError, frameMax);
+        frames++;
+    }
+    return check(frames > 2*length && maxError <= TEST_SLIDING_MAX_ERROR, "sliding bandpass",
+                 QString("%1 frames, max %2 (bound %3)").arg(frames).arg(maxError).arg(TEST_SLIDING_MAX_ERROR));
+}
+
+// Exports the PNG sequence input to output like rvm-cli, false if it failed
+static bool exportSequence(MagnificationExecutor &executor, const QString &input, const QString &output,
+                           int workers, ImageProcessingFlags flags, ImageProcessingSettings settings)
+{
+    SavingThread saver(&executor);
+    if(!saver.loadFile(input.toStdString()))
+        return false;
+    const QRect frame = saver.getVideoDimensions();
+    settings.frameWidth = frame.width();
+    settings.frameHeight = frame.height();
+    saver.savingCodec = 0;
+    saver.settings(flags, settings);
+    saver.setParallelExport(workers, DEFAULT_EXPORT_PREROLL_FRAMES, DEFAULT_EXPORT_TOLERANCE);
+    if(!saver.saveFile(output.toStdString(), settings.framerate, frame, false))
+        return false;
+    saver.start();
+    saver.wait();
+    return !saver.hasFailed();
+}
+
+// The chunked export of several workers against the serial one, which may differ by
+// DEFAULT_EXPORT_TOLERANCE plus the rounding to 8 bit
+static bool testParallelExport()
+{
+    QTemporaryDir dir;
+    if(!dir.isValid() || !QDir(dir.path()).mkpath("in"))
+        return check(false, "parallel export", "no temporary directory");
+
+    // Texture swaying by 2 pixels at 0.5 Hz, long enough for 3 chunks
+    const Size size(160, 120);
+    Mat texture = testFrame(size + Size(8, 8), false);
+    texture.convertTo(texture, CV_8U, 255.0);
+    cvtColor(texture, texture, COLOR_GRAY2BGR);
+    for(int i = 0; i < TEST_EXPORT_FRAMES; i++) {
+        const double shift = 4.0 + 2.0*std::sin(M_PI*i/DEFAULT_EXECUTOR_FRAMERATE);
+        Mat warp = (Mat_<double>(2, 3) << 1, 0, -shift, 0, 1, -4);
+        Mat frame;
+        warpAffine(texture, frame, warp, size, INTER_LINEAR);
+        imwrite(QString("%1/in/%2.png").arg(dir.path()).arg(i, 4, 10, QChar('0')).toStdString(), frame);
+    }
+    const QString input = dir.path() + "/in/%04d.png";
+
+    struct Case {
+        const char *name;
+        bool riesz;
+        double low;
+        double high;
+        double amplification;
+    };
+    // Cutoffs of the Riesz case are high enough for its filters to settle within the pre-roll
+    const Case cases[] = {
+        { "laplace", false, DEFAULT_MM_COLOW/100.0, DEFAULT_MM_COHIGH/100.0, DEFAULT_MM_AMPLIFICATION },
+        { "riesz", true, 1.0, 3.0, DEFAULT_PB_AMPLIFICATION }
+    };
+
+    MagnificationExecutor executor(DEFAULT_MAGNIFICATION_CORES);
+    bool passed = true;
+    for(const Case &c : cases) {
+        ImageProcessingFlags flags;
+        flags.laplaceMagnifyOn = !c.riesz;
+        flags.rieszMagnifyOn = c.riesz;
+        ImageProcessingSettings settings;
+        settings.amplification = c.amplification;
+        settings.coWavelength = c.riesz ? DEFAULT_PB_COWAVELENGTH : DEFAULT_MM_COWAVELENGTH*10.0;
+        settings.coLow = c.low;
+        settings.coHigh = c.high;
+        settings.levels = 3;
+        settings.framerate = DEFAULT_EXECUTOR_FRAMERATE;
+
+        const QString serial = QString("%1/%2-serial").arg(dir.path()).arg(c.name);
+        const QString chunked = QString("%1/%2-chunked").arg(dir.path()).arg(c.name);
+        QDir(dir.path()).mkpath(serial);
+        QDir(dir.path()).mkpath(chunked);
+        if(!exportSequence(executor, input, serial + "/%04d.png", 1, flags, settings) ||
+           !exportSequence(executor, input, chunked + "/%04d.png", TEST_EXPORT_WORKERS, flags, settings)) {
+            passed &= check(false, QString("parallel export, ") + c.name, "export failed");
+            continue;
+        }
+
+        int frames = 0;
+        double maxError = 0, meanError = 0;
+        for(int i = 0; i < TEST_EXPORT_FRAMES; i++) {
+            const QString name = QString("/%1.png").arg(i, 4, 10, QChar('0'));
+            const Mat a = imread((serial + name).toStdString());
+            const Mat b = imread((chunked + name).toStdString());
+            if(a.empty() || b.empty() || a.size() != b.size())
+                break;
+            Mat difference;
+            absdiff(a, b, difference);
+            double frameMax;
+            minMaxLoc(difference.reshape(1), 0, &frameMax);
+            maxError = std::max(maxError, frameMax);
+            meanError += mean(difference.reshape(1))[0];
+            frames++;
+        }
+        meanError /= std::max(frames, 1);
+        const double bound = std::ceil(DEFAULT_EXPORT_TOLERANCE);
+        passed &= check(frames == TEST_EXPORT_FRAMES && maxError <= bound,
+                        QString("parallel export, ") + c.name,
+                        QString("%1 of %2 frames, max %3 (bound %4), mean %5")
+                        .arg(frames).arg(TEST_EXPORT_FRAMES).arg(maxError).arg(bound).arg(meanError));
+    }
+    return passed;
+}
+
+// The Laplace pyramid of the workspace against the one of pyrDown/pyrUp, and both collapsed
+static bool testLaplacePyramid()
+{
+    const int levels = 4;
+    // 3 different channels of odd size
+    const Mat noise = testFrame(Size(333, 251), false);
+    Mat channels[3], frame;
+    channels[0] = noise;
+    flip(noise, channels[1], 0);
+    flip(noise, channels[2], 1);
+    merge(channels, 3, frame);
+
+    vector<Mat> reference;
+    buildLaplacePyrFromImg(frame, levels, reference);
+    PyramidWorkspace workspace;
+    buildLaplacePyrFromImg(frame, levels, workspace);
+    double maxError = 0;
+    for(int level = 0; level <= levels; level++)
+        maxError = std::max(maxError, norm(reference[level], workspace.pyramid[level], NORM_INF));
+
+    // Collapsed with a gain of 1, which has to give back the frame
+    Mat collapsedReference, collapsed;
+    buildImgFromLaplacePyr(reference, levels, collapsedReference);
+    const vector<float> gains(levels+1, 1.0f);
+    const vector<Mat> pyramid = workspace.pyramid;
+    buildImgFromLaplacePyr(pyramid, levels, gains, collapsed, workspace);
+    const double collapseError = norm(collapsedReference, collapsed, NORM_INF);
+    return check(maxError <= TEST_PYRAMID_MAX_ERROR && collapseError <= TEST_PYRAMID_MAX_ERROR, "laplace pyramid",
+                 QString("levels max %1, collapsed max %2 (bound %3)")
+                 .arg(maxError).arg(collapseError).arg(TEST_PYRAMID_MAX_ERROR));
+}
+
+// Vector of values padded with its last one to whole SIMD registers
+static vector<float> padToLanes(const vector<float> &values)
+{
+    vector<float> padded(values);
+#if CV_SIMD
+    while(padded.size() % cv::v_float32::nlanes)
+        padded.push_back(values.back());
+#endif
+    return padded;
+}
+
+// The polynomial acos and cos/sin of FastMath.h, scalar and SIMD, against std::acos/cos/sin in double.
+// acos is swept over [-1,1] including the ends and arguments just beyond them, which are clamped.
+// The divides guarded by safeDivide() have to give 0 instead of NaN or inf.
+static bool testFastMath()
+{
+    const int steps = 200000;
+    vector<float> acosArgs, cosSinArgs;
+    for(int i = 0; i <= steps; i++)
+        acosArgs.push_back(static_cast<float>(-1.0 + 2.0*i/steps));
+    const float acosEdges[] = { -1.0f, 1.0f, 0.0f, -0.0f, std::nextafter(1.0f, 0.0f), std::nextafter(-1.0f, 0.0f),
+                                std::nextafter(1.0f, 2.0f), std::nextafter(-1.0f, -2.0f) };
+    acosArgs.insert(acosArgs.end(), acosEdges, acosEdges + sizeof(acosEdges)/sizeof(acosEdges[0]));
+    for(int i = 0; i <= 2*steps; i++)
+        cosSinArgs.push_back(static_cast<float>(TEST_FAST_MATH_RANGE*(-1.0 + 2.0*i/(2*steps))));
+    // The borders of the quadrants of the range reduction
+    for(int k = -static_cast<int>(TEST_FAST_MATH_RANGE*4.0/M_PI); k <= TEST_FAST_MATH_RANGE*4.0/M_PI; k++)
+        cosSinArgs.push_back(static_cast<float>(k*M_PI/4.0));
+
+    vector<float> acosScalar(acosArgs.size()), cosScalar(cosSinArgs.size()), sinScalar(cosSinArgs.size());
+    for(size_t i = 0; i < acosArgs.size(); i++)
+        acosScalar[i] = fastArcCos(acosArgs[i]);
+    for(size_t i = 0; i < cosSinArgs.size(); i++)
+        fastCosSin(cosSinArgs[i], cosScalar[i], sinScalar[i]);
+    vector<float> acosSimd(acosScalar), cosSimd(cosScalar), sinSimd(sinScalar);
+#if CV_SIMD
+    const int lanes = cv::v_float32::nlanes;
+    const vector<float> acosPadded = padToLanes(acosArgs), cosSinPadded = padToLanes(cosSinArgs);
+    acosSimd.resize(acosPadded.size());
+    for(size_t i = 0; i < acosPadded.size(); i += lanes)
+        cv::v_store(&acosSimd[i], v_fastArcCos(cv::vx_load(&acosPadded[i])));
+    cosSimd.resize(cosSinPadded.size());
+    sinSimd.resize(cosSinPadded.size());
+    for(size_t i = 0; i < cosSinPadded.size(); i += lanes) {
+        cv::v_float32 c, s;
+        v_fastCosSin(cv::vx_load(&cosSinPadded[i]), c, s);
+        cv::v_store(&cosSimd[i], c);
+        cv::v_store(&sinSimd[i], s);
+    }
+#endif
+
+    // NaN fails the comparisons with the bounds, so it is counted as an error of inf
+    double acosError = 0, acosSimdError = 0, cosSinError = 0, cosSinSimdError = 0;
+    for(size_t i = 0; i < acosArgs.size(); i++) {
+        const double reference = std::acos(std::max(-1.0, std::min(1.0, static_cast<double>(acosArgs[i]))));
+        const double error = std::fabs(acosScalar[i] - reference), simdError = std::fabs(acosSimd[i] - reference);
+        acosError = std::max(acosError, error == error ? error : HUGE_VAL);
+        acosSimdError = std::max(acosSimdError, simdError == simdError ? simdError : HUGE_VAL);
+    }
+    for(size_t i = 0; i < cosSinArgs.size(); i++) {
+        const double c = std::cos(static_cast<double>(cosSinArgs[i]));
+        const double s = std::sin(static_cast<double>(cosSinArgs[i]));
+        const double error = std::max(std::fabs(cosScalar[i] - c), std::fabs(sinScalar[i] - s));
+        const double simdError = std::max(std::fabs(cosSimd[i] - c), std::fabs(sinSimd[i] - s));
+        cosSinError = std::max(cosSinError, error == error ? error : HUGE_VAL);
+        cosSinSimdError = std::max(cosSinSimdError, simdError == simdError ? simdError : HUGE_VAL);
+    }
+
+    // Zero, negative zero and NaN denominators like those of pixels without amplitude
+    struct Division {
+        float numerator;
+        float denominator;
+        float quotient;
+    };
+    const float nan = std::numeric_limits<float>::quiet_NaN();
+    const Division divisions[] = {
+        { 1.0f, 0.0f, 0.0f }, { 0.0f, 0.0f, 0.0f }, { -1.0f, -0.0f, 0.0f }, { 1.0f, nan, 0.0f },
+        { 0.0f, nan, 0.0f }, { 1.0f, -2.0f, 0.0f }, { 3.0f, 4.0f, 0.75f }
+    };
+    int wrongDivisions = 0;
+    for(const Division &d : divisions) {
+        bool right = safeDivide(d.numerator, d.denominator) == d.quotient;
+#if CV_SIMD
+        float quotients[cv::v_float32::nlanes];
+        cv::v_store(quotients, v_safeDivide(cv::vx_setall_f32(d.numerator), cv::vx_setall_f32(d.denominator)));
+        for(int lane = 0; lane < lanes; lane++)
+            right &= quotients[lane] == d.quotient;
+#endif
+        if(!right)
+            wrongDivisions++;
+    }
+
+#if CV_SIMD
+    const QString simd = QString("simd %1").arg(std::max(acosSimdError, cosSinSimdError));
+#else
+    const QString simd = "no simd";
+#endif
+    const int nDivisions = sizeof(divisions)/sizeof(divisions[0]);
+    return check(acosError <= TEST_FAST_ACOS_MAX_ERROR && acosSimdError <= TEST_FAST_ACOS_MAX_ERROR &&
+                 cosSinError <= TEST_FAST_COSSIN_MAX_ERROR && cosSinSimdError <= TEST_FAST_COSSIN_MAX_ERROR &&
+                 wrongDivisions == 0, "fast math",
+                 QString("acos max %1, simd %2 (bound %3), cos/sin max %4, simd %5 (bound %6) on [-%7,%7], "
+                         "%8 of %9 guarded divisions wrong (%10)")
+                 .arg(acosError).arg(acosSimdError).arg(TEST_FAST_ACOS_MAX_ERROR)
+                 .arg(cosSinError).arg(cosSinSimdError).arg(TEST_FAST_COSSIN_MAX_ERROR).arg(TEST_FAST_MATH_RANGE)
+                 .arg(wrongDivisions).arg(nDivisions).arg(simd));
+}
+
+// The amplification of a Riesz level like before the fused kernels: expressions of cv::Mat,
+// sepFilter2D, std::cos/sin and patchNaNs() for the divides by zero
+static Mat expressionAmplify(const RieszPyramidLevel &level, double alpha, double threshold)
+{
+    const Mat &lp = level.itsLp;
+    const Mat &re = level.itsR.first;
+    const Mat &im = level.itsR.second;
+    Mat amplitude;
+    sqrt(re.mul(re) + im.mul(im) + lp.mul(lp), amplitude);
+    const Mat changeCos = level.itsRealPass.first - level.itsImagPass.first;
+    const Mat changeSin = level.itsRealPass.second - level.itsImagPass.second;
+
+    const Mat kernel = getGaussianKernel(13, 3.0, CV_32F);
+    Mat sumCos, sumSin, blurredAmplitude;
+    sepFilter2D(changeCos.mul(amplitude), sumCos, -1, kernel, kernel, Point(-1, -1), 0, BORDER_REFLECT_101);
+    sepFilter2D(changeSin.mul(amplitude), sumSin, -1, kernel, kernel, Point(-1, -1), 0, BORDER_REFLECT_101);
+    sepFilter2D(amplitude, blurredAmplitude, -1, kernel, kernel, Point(-1, -1), 0, BORDER_REFLECT_101);
+    Mat c = sumCos / blurredAmplitude;
+    Mat s = sumSin / blurredAmplitude;
+    patchNaNs(c, 0);
+    patchNaNs(s, 0);
+
+    Mat magnitude, truncated;
+    sqrt(c.mul(c) + s.mul(s), magnitude);
+    cv::threshold(magnitude * alpha, truncated, threshold, 0, THRESH_TRUNC);
+    Mat diffCos(truncated.size(), CV_32F), diffSin(truncated.size(), CV_32F);
+    for(int y = 0; y < truncated.rows; y++)
+        for(int x = 0; x < truncated.cols; x++) {
+            diffCos.at<float>(y, x) = std::cos(truncated.at<float>(y, x));
+            diffSin.at<float>(y, x) = std::sin(truncated.at<float>(y, x));
+        }
+    Mat pair = (re.mul(c) + im.mul(s)) / magnitude;
+    patchNaNs(pair, 0);
+    return lp.mul(diffCos) - pair.mul(diffSin);
+}
+
+// One full RieszPyramidLevel::amplify() against expressionAmplify(). The level has odd columns for
+// the scalar tails of the SIMD rows and a block without amplitude, whose blurred amplitude is 0.
+static bool testRieszAmplify()
+{
+    const Size size(333, 251);
+    const Mat noise = testFrame(size, false);
+    RieszPyramidLevel level;
+    level.itsLp = noise - 0.5;
+    flip(noise - 0.5, level.itsR.first, 0);
+    flip(noise - 0.5, level.itsR.second, 1);
+    const Rect still(40, 40, 20, 20);
+    level.itsLp(still).setTo(0);
+    level.itsR.first(still).setTo(0);
+    level.itsR.second(still).setTo(0);
+    // Filtered phases, small enough that only part of them is truncated at threshold
+    Mat *phases[4] = { &level.itsRealPass.first, &level.itsRealPass.second,
+                       &level.itsImagPass.first, &level.itsImagPass.second };
+    RNG rng(TEST_SEED);
+    for(Mat *phase : phases) {
+        phase->create(size, CV_32F);
+        rng.fill(*phase, RNG::UNIFORM, -0.03, 0.03);
+    }
+
+    const double alpha = DEFAULT_PB_AMPLIFICATION;
+    const double threshold = DEFAULT_PB_COWAVELENGTH*M_PI/100.0;
+    const Mat reference = expressionAmplify(level, alpha, threshold);
+    level.amplify(alpha, threshold);
+    const bool finite = checkRange(level.itsAmplified) && checkRange(reference);
+    const double maxError = finite ? norm(reference, level.itsAmplified, NORM_INF) : HUGE_VAL;
+    return check(maxError <= TEST_AMPLIFY_MAX_ERROR, "riesz amplify",
+                 QString("max %1 against the expressions (bound %2)").arg(maxError).arg(TEST_AMPLIFY_MAX_ERROR));
+}
+
+// Texture swaying by 2 pixels in n 8 bit frames, grayscale and BGR
+static void swayingFrames(Size size, int n, vector<Mat> &grayFrames, vector<Mat> &colorFrames)
+{
+    Mat texture = testFrame(size + Size(8, 8), false);
+    texture.convertTo(texture, CV_8U, 255.0);
+    for(int i = 0; i < n; i++) {
+        const double shift = 4.0 + 2.0*std::sin(2.0*M_PI*i/n);
+        Mat warp = (Mat_<double>(2, 3) << 1, 0, -shift, 0, 1, -4);
+        Mat gray, color;
+        warpAffine(texture, gray, warp, size, INTER_LINEAR);
+        cvtColor(gray, color, COLOR_GRAY2BGR);
+        grayFrames.push_back(gray);
+        colorFrames.push_back(color);
+    }
+}
+
+// Default settings of the Laplace or Riesz magnification of frames of size
+static ImageProcessingSettings magnifySettings(bool riesz, Size size)
+{
+    ImageProcessingSettings settings;
+    settings.amplification = riesz ? DEFAULT_PB_AMPLIFICATION : DEFAULT_MM_AMPLIFICATION;
+    settings.coWavelength = riesz ? DEFAULT_PB_COWAVELENGTH : DEFAULT_MM_COWAVELENGTH*10.0;
+    settings.coLow = riesz ? DEFAULT_PB_COLOW : DEFAULT_MM_COLOW/100.0;
+    settings.coHigh = riesz ? DEFAULT_PB_COHIGH : DEFAULT_MM_COHIGH/100.0;
+    settings.chromAttenuation = riesz ? 0 : DEFAULT_MM_CHROMATTENUATION/100.0;
+    settings.framerate = DEFAULT_EXECUTOR_FRAMERATE;
+    settings.frameWidth = size.width;
+    settings.frameHeight = size.height;
+    return settings;
+}
+
+// Once warmed up, Laplace and Riesz frames must allocate neither with operator new nor Mat buffers.
+// OpenCV's thread pool allocates a job for every parallel loop, so the executor runs them on 1 core,
+// where parallel loops call their body directly.
+static bool testSteadyStateAllocations()
+{
+    struct Case {
+        const char *name;
+        bool riesz;
+        bool grayscale;
+    };
+    const Case cases[] = {
+        { "laplace", false, false },
+        { "laplace grayscale", false, true },
+        { "riesz", true, false },
+        { "riesz grayscale", true, true }
+    };
+
+    // Built before counting
+    const Size size(320, 240);
+    vector<Mat> colorFrames, grayFrames;
+    swayingFrames(size, TEST_ALLOCATION_FRAMES, grayFrames, colorFrames);
+
+    const int threads = getNumThreads();
+    CountingMatAllocator allocator;
+    Mat::setDefaultAllocator(&allocator);
+    bool passed = true;
+    {
+        MagnificationExecutor executor(1);
+        const int stream = executor.addStream();
+        for(const Case &c : cases) {
+            ImageProcessingFlags flags;
+            flags.laplaceMagnifyOn = !c.riesz;
+            flags.rieszMagnifyOn = c.riesz;
+            flags.grayscaleOn = c.grayscale;
+            ImageProcessingSettings settings = magnifySettings(c.riesz, size);
+
+            const vector<Mat> &frames = c.grayscale ? grayFrames : colorFrames;
+            vector<Mat> buffer;
+            buffer.reserve(2);
+            Magnificator magnificator(&buffer, &flags, &settings);
+            long long allocations = 0, matAllocations = 0;
+            for(int n = 0; n < TEST_ALLOCATION_WARMUP + TEST_ALLOCATION_FRAMES; n++) {
+                // Like rvm-bench, 2 frames in the processing buffer and the magnified frame dropped
+                const long long allocationsBefore = allocationCount();
+                const long long matAllocationsBefore = matAllocationCount();
+                while(buffer.size() < 2)
+                    buffer.push_back(frames[(n + buffer.size()) % frames.size()]);
+                executor.run(stream, [&]() {
+                    if(c.riesz)
+                        magnificator.rieszMagnify();
+                    else
+                        magnificator.laplaceMagnify();
+                });
+                magnificator.getFrameFirst();
+                if(n >= TEST_ALLOCATION_WARMUP) {
+                    allocations += allocationCount() - allocationsBefore;
+                    matAllocations += matAllocationCount() - matAllocationsBefore;
+                }
+            }
+            passed &= check(allocations == 0 && matAllocations == 0,
+                            QString("steady state allocations, ") + c.name,
+                            QString("%1 allocations, %2 of them Mat buffers in %3 frames (bound 0)")
+                            .arg(allocations).arg(matAllocations).arg(TEST_ALLOCATION_FRAMES));
+        }
+    }
+    Mat::setDefaultAllocator(0);
+    setNumThreads(threads);
+    return passed;
+}
+
+// The processing pipeline decomposes a frame with one Magnificator and filters it with another, which
+// has to give the frames of laplaceMagnify() and rieszMagnify() bit for bit. These magnify the first
+// frame twice, the first time it is returned unmagnified, so the pipeline gets it twice too.
+static bool testSplitMagnify()
+{
+    struct Case {
+        const char *name;
+        bool riesz;
+        bool grayscale;
+    };
+    const Case cases[] = {
+        { "laplace", false, false },
+        { "laplace grayscale", false, true },
+        { "riesz", true, false },
+        { "riesz grayscale", true, true }
+    };
+
+    const Size size(320, 240);
+    vector<Mat> colorFrames, grayFrames;
+    swayingFrames(size, TEST_SPLIT_FRAMES, grayFrames, colorFrames);
+
+    bool passed = true;
+    for(const Case &c : cases) {
+        ImageProcessingFlags flags;
+        flags.laplaceMagnifyOn = !c.riesz;
+        flags.rieszMagnifyOn = c.riesz;
+        flags.grayscaleOn = c.grayscale;
+        ImageProcessingSettings settings = magnifySettings(c.riesz, size);
+
+        const vector<Mat> &frames = c.grayscale ? grayFrames : colorFrames;
+        vector<Mat> buffer;
+        Magnificator magnificator(&buffer, &flags, &settings);
+        Magnificator decomposer(0, &flags, &settings);
+        Magnificator filter(0, &flags, &settings);
+        SpatialFrame spatial;
+        double maxError = 0;
+        for(int n = 0; n < TEST_SPLIT_FRAMES; n++) {
+            // Like the processing thread before the split, 2 frames in the processing buffer
+            while(buffer.size() < 2)
+                buffer.push_back(frames[(n + buffer.size()) % frames.size()]);
+            if(c.riesz)
+                magnificator.rieszMagnify();
+            else
+                magnificator.laplaceMagnify();
+            const Mat expected = magnificator.getFrameFirst();
+
+            decomposer.decompose(frames[std::max(n-1, 0)], spatial);
+            filter.magnify(spatial);
+            const Mat split = filter.getFrameFirst();
+            maxError = std::max(maxError, norm(expected, split, NORM_INF));
+        }
+        passed &= check(maxError == 0, QString("split decomposition, ") + c.name,
+                        QString("max error %1 gray values in %2 frames (bound 0)")
+                        .arg(maxError).arg(TEST_SPLIT_FRAMES));
+    }
+    return passed;
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+    QCoreApplication::setApplicationName("rvm-test");
+    QCoreApplication::setApplicationVersion(APP_VERSION);
+
+    bool passed = true;
+    passed &= testRieszFilterTolerance();
+    passed &= testSlidingBandpass();
+    passed &= testLaplacePyramid();
+    passed &= testFastMath();
+    passed &= testRieszAmplify();
+    passed &= testSteadyStateAllocations();
+    passed &= testSplitMagnify();
+    passed &= testParallelExport();
+
+    QTextStream(stderr) << (passed ? "All checks passed.\n" : "Checks failed.\n");
+    return passed ? 0 : 1;
+}
@@ -25,11 +25,11 @@
 #include "main/threads/CaptureThread.h"
 
 CaptureThread::CaptureThread(SharedImageBuffer *sharedImageBuffer, int deviceNumber,
-                             bool dropFrameIfBufferFull, int width, int height, int fpsLimit)
-    : QThread(), sharedImageBuffer(sharedImageBuffer)
+                             BufferFullPolicy bufferFullPolicy, int width, int height, int fpsLimit)
+    : QThread(), sharedImageBuffer(sharedImageBuffer), framePool(FRAME_POOL_MAX_SIZE)
 {
     // Save passed parameters
-    this->dropFrameIfBufferFull=dropFrameIfBufferFull;
+    this->bufferFullPolicy=bufferFullPolicy;
     this->deviceNumber=deviceNumber;
     this->width = width;
     this->height = height;
@@ -41,6 +41,7 @@ CaptureThread::CaptureThread(SharedImageBuffer *sharedImageBuffer, int deviceNum
     fps.clear();
     statsData.averageFPS=0;
     statsData.nFramesProcessed=0;
+    statsData.nFramesDropped=0;
 }
 
 void CaptureThread::run()
@@ -69,11 +70,13 @@ void CaptureThread::run()
         // Capture frame (if available)
         if (!cap.grab())
             continue;
-        // Retrieve frame
+        // Retrieve frame into a pooled frame no one else uses anymore
+        Mat &grabbedFrame = framePool.acquire();
         cap.retrieve(grabbedFrame);
 
-        // Add frame to buffer
-        sharedImageBuffer->getByDeviceNumber(deviceNumber)->add(grabbedFrame, dropFrameIfBufferFull);
+        // Add frame to buffer, count the frame if it (or the oldest one) was dropped
+        if(!sharedImageBuffer->getByDeviceNumber(deviceNumber)->add(grabbedFrame, bufferFullPolicy))
+            statsData.nFramesDropped++;
 
         // Update statistics
         updateFPS(captureTime);
@@ -31,6 +31,7 @@
 // OpenCV
 #include <opencv2/highgui/highgui.hpp>
 // Local
+#include "main/helper/FramePool.h"
 #include "main/helper/SharedImageBuffer.h"
 #include "main/other/Config.h"
 #include "main/other/Structures.h"
@@ -45,7 +46,7 @@ class CaptureThread : public QThread
 
     public:
         CaptureThread(SharedImageBuffer *sharedImageBuffer, int deviceNumber,
-                      bool dropFrameIfBufferFull, int width, int height, int fpsLimit);
+                      BufferFullPolicy bufferFullPolicy, int width, int height, int fpsLimit);
         void stop();
         bool connectToCamera();
         bool disconnectCamera();
@@ -57,7 +58,7 @@ class CaptureThread : public QThread
         void updateFPS(int);
         SharedImageBuffer *sharedImageBuffer;
         VideoCapture cap;
-        Mat grabbedFrame;
+        FramePool framePool;
         QTime t;
         QMutex doStopMutex;
         QQueue<int> fps;
@@ -66,7 +67,7 @@ class CaptureThread : public QThread
         int captureTime;
         int sampleNumber;
         int fpsSum;
-        bool dropFrameIfBufferFull;
+        BufferFullPolicy bufferFullPolicy;
         int deviceNumber;
         int width;
         int height;
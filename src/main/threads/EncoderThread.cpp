@@ -0,0 +1,273 @@
+/************************************************************************************/
+/* An OpenCV/Qt based realtime application to magnify motion and color              */
+/* Copyright (C) 2015  Jens Schindel <kontakt@jens-schindel.de>                     */
+/*                                                                                  */
+/* Based on the work of                                                             */
+/*      Joseph Pan      <https://github.com/wzpan/QtEVM>                            */
+/*      Nick D'Ademo    <https://github.com/nickdademo/qt-opencv-multithreaded>     */
+/*                                                                                  */
+/* Realtime-Video-Magnification->EncoderThread.cpp                                  */
+/*                                                                                  */
+/* This program is free software: you can redistribute it and/or modify             */
+/* it under the terms of the GNU General Public License as published by             */
+/* the Free Software Foundation, either version 3 of the License, or                */
+/* (at your option) any later version.                                              */
+/*                                                                                  */
+/* This program is distributed in the hope that it will be useful,                  */
+/* but WITHOUT ANY WARRANTY; without even the implied warranty of                   */
+/* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                    */
+/* GNU General Public License for more details.                                     */
+/*                                                                                  */
+/* You should have received a copy of the GNU General Public License                */
+/* along with this program.  If not, see <http://www.gnu.org/licenses/>.            */
+/************************************************************************************/
+
+#include "main/threads/EncoderThread.h"
+// Qt
+#include <QDebug>
+
+EncoderThread::EncoderThread(int queueSize, EncoderQueuePolicy policy) : QThread(),
+    frames(queueSize),
+    policy(policy),
+    profiler(0),
+    composePool(2)
+{
+    // Initialize variables(s)
+    spillWritePos = 0;
+    framesWritten = 0;
+}
+
+EncoderThread::~EncoderThread()
+{
+    if(isRunning())
+        stop();
+}
+
+void EncoderThread::setPolicy(EncoderQueuePolicy policy)
+{
+    this->policy = policy;
+}
+
+void EncoderThread::setProfiler(Profiler *profiler)
+{
+    this->profiler = profiler;
+    frames.setProfiler(profiler, "encoderFrames.getWait", "encoderFrames.addWait", "encoderFrames.depth");
+}
+
+bool EncoderThread::add(const Mat &frame, const Mat &original, const Ptr<VideoWriter> &writer)
+{
+    EncoderFrame item;
+    item.frame = frame;
+    item.original = original;
+    item.writer = writer;
+
+    if(policy == EncoderBlock)
+    {
+        frames.add(item, BlockIfFull);
+        return true;
+    }
+    if(policy == EncoderDrop)
+    {
+        if(frames.add(item, DropNewestIfFull))
+            return true;
+        if(profiler)
+            profiler->addValue("encoder.dropped", 1);
+        return false;
+    }
+
+    // Spill only if the queue is full or older frames are still spilled, decided
+    // under the lock like takeNext(), so the encoder can't take a newer frame first
+    spillMutex.lock();
+    if(spilledFrames.empty() && frames.add(item, DropNewestIfFull))
+    {
+        spillMutex.unlock();
+        return true;
+    }
+    // Drained, the encoder doesn't read the file anymore, start over at its beginning
+    if(spilledFrames.empty())
+        spillWritePos = 0;
+    SpilledFrame spilled;
+    spilled.writer = writer;
+    spilled.hasOriginal = !original.empty();
+    spilled.pos = spillWritePos;
+    spilled.written = false;
+    spilledFrames.push_back(spilled);
+    spillMutex.unlock();
+
+    // The encoder waits for this frame meanwhile, and add() is the only one to append
+    const bool ok = spill(item);
+    QMutexLocker locker(&spillMutex);
+    if(ok)
+        spilledFrames.back().written = true;
+    else
+        spilledFrames.pop_back();
+    spillWritten.wakeAll();
+    if(ok)
+    {
+        if(profiler)
+            profiler->addValue("encoder.spillDepth", spilledFrames.size());
+        return true;
+    }
+    if(profiler)
+        profiler->addValue("encoder.dropped", 1);
+    return false;
+}
+
+void EncoderThread::stop()
+{
+    // The sentinel is queued behind every frame, blocking, so it can't get lost
+    EncoderFrame last;
+    last.last = true;
+    frames.add(last, BlockIfFull);
+    wait();
+}
+
+void EncoderThread::run()
+{
+    while(1)
+    {
+        EncoderFrame item;
+        if(!takeNext(item))
+            item = frames.get();
+        if(item.last)
+        {
+            // Frames added before the sentinel may still be spilled
+            while(takeNext(item))
+                encode(item);
+            break;
+        }
+        encode(item);
+    }
+    currentWriter.release();
+    composePool.clear();
+}
+
+void EncoderThread::encode(const EncoderFrame &item)
+{
+    if(item.writer.empty() || !item.writer->isOpened())
+        return;
+    const qint64 start = Profiler::now();
+
+    if(item.original.empty())
+        item.writer->write(item.frame);
+    else
+    {
+        // Compose processed and original frame side by side into a reused frame
+        const int w = item.frame.cols;
+        const int h = item.frame.rows;
+        Mat &combined = composePool.acquire();
+        combined.create(Size(w*2, h), item.frame.type());
+        item.frame.copyTo(combined(Rect(0, 0, w, h)));
+        item.original.copyTo(combined(Rect(w, 0, w, h)));
+        item.writer->write(combined);
+    }
+
+    if(profiler)
+        profiler->addSpan("encoder.write", start, Profiler::now() - start);
+    // A new recording starts counting at 0
+    if(item.writer != currentWriter)
+    {
+        currentWriter = item.writer;
+        framesWritten = 0;
+    }
+    framesWritten++;
+    emit frameWritten(framesWritten);
+}
+
+// Appends the frame to the spill file at spillWritePos, called by add() without spillMutex
+bool EncoderThread::spill(const EncoderFrame &item)
+{
+    if(!spillFile.isOpen() && !spillFile.open())
+    {
+        qDebug() << "ERROR: Could not open spill file for the encoder.";
+        return false;
+    }
+    if(spillWritePos == 0)
+        spillFile.resize(0);
+    spillFile.seek(spillWritePos);
+    // Flushed, so the encoder reads the frame through its own handle
+    if(!writeMat(spillFile, item.frame) || (!item.original.empty() && !writeMat(spillFile, item.original))
+       || !spillFile.flush())
+    {
+        // Disk is full, forget the partially written frame
+        qDebug() << "ERROR: Could not spill frame to" << spillFile.fileName();
+        return false;
+    }
+    spillWritePos = spillFile.pos();
+    return true;
+}
+
+// Takes the oldest frame, false if none is queued or spilled. Queued frames are older than
+// spilled ones, both are checked under spillMutex, so add() can't queue or spill in between
+bool EncoderThread::takeNext(EncoderFrame &item)
+{
+    QMutexLocker locker(&spillMutex);
+    while(1)
+    {
+        if(frames.tryGet(item))
+            return true;
+        if(spilledFrames.empty())
+            return false;
+        if(spilledFrames.front().written)
+            break;
+        spillWritten.wait(&spillMutex);
+    }
+
+    // add() only appends while the frame is read, its space is reused once it's popped
+    const SpilledFrame spilled = spilledFrames.front();
+    locker.unlock();
+    readSpilled(spilled, item);
+    locker.relock();
+    spilledFrames.pop_front();
+    return true;
+}
+
+// Reads the spilled frame back, item has no writer if that failed
+void EncoderThread::readSpilled(const SpilledFrame &spilled, EncoderFrame &item)
+{
+    // Unbuffered, add() overwrites the file once it's drained
+    if(!spillReader.isOpen())
+    {
+        spillReader.setFileName(spillFile.fileName());
+        spillReader.open(QIODevice::ReadOnly | QIODevice::Unbuffered);
+    }
+    // The frames are read into the same buffers every time, encode() copies them
+    bool ok = spillReader.seek(spilled.pos) && readMat(spillReader, spillFrame);
+    if(spilled.hasOriginal)
+        ok = ok && readMat(spillReader, spillOriginal);
+    if(!ok)
+        qDebug() << "ERROR: Could not read spilled frame from" << spillFile.fileName();
+
+    item = EncoderFrame();
+    if(ok)
+    {
+        item.frame = spillFrame;
+        item.original = spilled.hasOriginal ? spillOriginal : Mat();
+        item.writer = spilled.writer;
+    }
+}
+
+bool EncoderThread::writeMat(QIODevice &file, const Mat &mat)
+{
+    const int header[3] = { mat.rows, mat.cols, mat.type() };
+    if(file.write((const char*)header, sizeof(header)) != sizeof(header))
+        return false;
+    const qint64 rowBytes = mat.cols*mat.elemSize();
+    for(int y = 0; y < mat.rows; y++)
+    {
+        if(file.write((const char*)mat.ptr(y), rowBytes) != rowBytes)
+            return false;
+    }
+    return true;
+}
+
+bool EncoderThread::readMat(QIODevice &file, Mat &mat)
+{
+    int header[3];
+    if(file.read((char*)header, sizeof(header)) != sizeof(header))
+        return false;
+    // Keeps the storage if the size didn't change
+    mat.create(header[0], header[1], header[2]);
+    const qint64 bytes = mat.total()*mat.elemSize();
+    return file.read((char*)mat.data, bytes) == bytes;
+}
@@ -0,0 +1,131 @@
+/************************************************************************************/
+/* An OpenCV/Qt based realtime application to magnify motion and color              */
+/* Copyright (C) 2015  Jens Schindel <kontakt@jens-schindel.de>                     */
+/*                                                                                  */
+/* Based on the work of                                                             */
+/*      Joseph Pan      <https://github.com/wzpan/QtEVM>                            */
+/*      Nick D'Ademo    <https://github.com/nickdademo/qt-opencv-multithreaded>     */
+/*                                                                                  */
+/* Realtime-Video-Magnification->EncoderThread.h                                    */
+/*                                                                                  */
+/* This program is free software: you can redistribute it and/or modify             */
+/* it under the terms of the GNU General Public License as published by             */
+/* the Free Software Foundation, either version 3 of the License, or                */
+/* (at your option) any later version.                                              */
+/*                                                                                  */
+/* This program is distributed in the hope that it will be useful,                  */
+/* but WITHOUT ANY WARRANTY; without even the implied warranty of                   */
+/* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                    */
+/* GNU General Public License for more details.                                     */
+/*                                                                                  */
+/* You should have received a copy of the GNU General Public License                */
+/* along with this program.  If not, see <http://www.gnu.org/licenses/>.            */
+/************************************************************************************/
+
+#ifndef ENCODERTHREAD_H
+#define ENCODERTHREAD_H
+
+// Qt
+#include <QtCore/QThread>
+#include <QtCore/QFile>
+#include <QtCore/QMutex>
+#include <QtCore/QTemporaryFile>
+#include <QtCore/QWaitCondition>
+// OpenCV
+#include <opencv2/core.hpp>
+#include <opencv2/videoio.hpp>
+// C++
+#include <atomic>
+#include <deque>
+// Local
+#include "main/other/Buffer.h"
+#include "main/helper/FramePool.h"
+#include "main/helper/Profiler.h"
+
+using namespace cv;
+
+// Behaviour of EncoderThread::add() if the encoder can't keep up
+enum EncoderQueuePolicy {
+    EncoderBlock,   // Wait for the encoder, the processing slows down
+    EncoderDrop,    // Discard the frame, the recording skips it
+    EncoderSpill    // Write the frame to a temporary file, it is encoded later
+};
+
+// Frame of a recording, writer is shared by all frames of the recording and
+// released once the last of them is encoded
+struct EncoderFrame{
+    Mat frame;
+    // Empty if the original isn't recorded
+    Mat original;
+    Ptr<VideoWriter> writer;
+    // Sentinel that stops the thread
+    bool last;
+
+    EncoderFrame() :
+        last(false)
+    {
+    }
+};
+
+// Writer stage of the recording. Frames are queued without copy and encoded in
+// this thread, so a stalling encoder doesn't stall the processing pipeline
+// unless the policy is EncoderBlock.
+class EncoderThread : public QThread
+{
+    Q_OBJECT
+
+    public:
+        EncoderThread(int queueSize, EncoderQueuePolicy policy);
+        ~EncoderThread();
+        // Queues frame, and original to its right if not empty. Only 1 thread may add
+        // frames. Returns false if the frame was dropped
+        bool add(const Mat &frame, const Mat &original, const Ptr<VideoWriter> &writer);
+        // Encodes the queued and spilled frames, then stops the thread
+        void stop();
+        // Has to be set before the thread is started
+        void setPolicy(EncoderQueuePolicy policy);
+        void setProfiler(Profiler *profiler);
+
+    private:
+        bool spill(const EncoderFrame &item);
+        bool takeNext(EncoderFrame &item);
+        bool writeMat(QIODevice &file, const Mat &mat);
+        bool readMat(QIODevice &file, Mat &mat);
+        void encode(const EncoderFrame &item);
+        Buffer<EncoderFrame> frames;
+        EncoderQueuePolicy policy;
+        Profiler *profiler;
+        // Side by side frames are composed into a frame of this pool
+        FramePool composePool;
+        // Frames that did not fit into the queue, in order. Once a frame is
+        // spilled, the following frames are spilled too until the encoder
+        // has read all of them back. The file is written by add() and read
+        // by the encoder through its own handle, both without spillMutex
+        struct SpilledFrame{
+            Ptr<VideoWriter> writer;
+            bool hasOriginal;
+            qint64 pos;
+            // False while add() still writes the frame
+            bool written;
+        };
+        void readSpilled(const SpilledFrame &spilled, EncoderFrame &item);
+        QMutex spillMutex;
+        QWaitCondition spillWritten;
+        QTemporaryFile spillFile;
+        QFile spillReader;
+        std::deque<SpilledFrame> spilledFrames;
+        qint64 spillWritePos;
+        Mat spillFrame;
+        Mat spillOriginal;
+        // Frames written to the current writer
+        Ptr<VideoWriter> currentWriter;
+        int framesWritten;
+
+    protected:
+        void run();
+
+    signals:
+        void frameWritten(int frames);
+};
+
+#endif // ENCODERTHREAD_H
@@ -25,12 +25,19 @@
 #include "main/threads/PlayerThread.h"
 
 // Constructor
-PlayerThread::PlayerThread(const std::string filepath, int width, int height, double fps)
+PlayerThread::PlayerThread(const std::string filepath, MagnificationExecutor *executor, int width, int height, double fps)
     : QThread(),
       filepath(filepath),
+      executor(executor),
+      roiPool(FRAME_POOL_MAX_SIZE),
+      decodedFrames(PLAYER_LOOKAHEAD_FRAMES),
       width(width),
       height(height),
       fps(fps),
+      displayPool(DISPLAY_POOL_MAX_SIZE),
+      originalDisplayPool(DISPLAY_POOL_MAX_SIZE),
+      displayMailbox(0),
+      originalDisplayMailbox(0),
       emitOriginal(false)
 {
     doStop = true;
@@ -49,9 +56,20 @@ PlayerThread::PlayerThread(const std::string filepath, int width, int height, do
     fpsSum = 0;
     fpsQueue.clear();
 
-    this->magnificator = Magnificator(&processingBuffer, &imgProcFlags, &imgProcSettings);
+    // The magnificator reads the copies of the player, the slots only change the originals
+    bufferGeneration = 0;
+    clearedGeneration = 0;
+    syncOriginals = false;
+    this->magnificator = Magnificator(&processingBuffer, &magnifyFlags, &magnifySettings);
+    this->magnificator.setProfiler(&profiler);
+    decodedFrames.setProfiler(&profiler, "decodedFrames.getWait", "decodedFrames.addWait", "decodedFrames.depth");
+    seekGeneration = 0;
+    decoderStop = false;
+    currentFramenumber = 0;
     this->cap = VideoCapture();
     currentWriteIndex = 0;
+    // Magnification of this video is scheduled by the shared executor
+    stream = executor->addStream();
 }
 
 // Destructor
@@ -63,6 +81,7 @@ PlayerThread::~PlayerThread()
         qDebug() << "Released File.";
     doStopMutex.unlock();
     wait();
+    executor->removeStream(stream);
 }
 
 // Thread
@@ -72,6 +91,9 @@ void PlayerThread::run()
     double delay = 1000.0/fps;
     qDebug() << "Starting player thread...";
     QTime mTime;
+    // Frames are decoded ahead on their own thread, so decoding doesn't add to the frame time
+    decoderStop = false;
+    std::thread decoder(&PlayerThread::decodeFrames, this);
 
     /////////////////////////////////////
     /// Stop thread if doStop=TRUE /////
@@ -106,8 +128,13 @@ void PlayerThread::run()
         // Start timer and capture time needed to process 1 frame here
         if(getCurrentReadIndex() == processingBufferLength-1)
             mTime.start();
+        // Apply what the slots changed during the last magnification
+        processingMutex.lock();
+        syncBuffers();
+        processingMutex.unlock();
+
         // Switch to process images on the fly instead of processing a whole buffer, reducing MEM
-        if(imgProcFlags.colorMagnifyOn && processingBufferLength > 2 && magnificator.getBufferSize() > 2) {
+        if(magnifyFlags.colorMagnifyOn && processingBufferLength > 2 && magnificator.getBufferSize() > 2) {
             processingBufferLength = 2;
         }
 
@@ -115,33 +142,38 @@ void PlayerThread::run()
         /////////// Capturing ////////////
         /////////////////////////////////
         // Fill buffer, check if it's the start of magnification or not
-        for(int i = processingBuffer.size(); i < processingBufferLength && getCurrentFramenumber() < lengthInFrames; i++) {
+        for(int i = processingBuffer.size(); i < processingBufferLength && getCurrentFramenumber() < lengthInFrames; ) {
+            // Take the next frame the decoder has read, cropped and converted already
+            DecodedFrame item = decodedFrames.get();
             processingMutex.lock();
+            // Buffers were reset together with the seek below, fill them from the start
+            if(syncBuffers())
+                i = 0;
 
-            // Try to grab the next Frame
-            if(cap.read(grabbedFrame)) {
-                // Preprocessing
-                // Set ROI of frame
-                currentFrame = Mat(grabbedFrame.clone(), currentROI);
-                // Convert to grayscale
-                if(imgProcFlags.grayscaleOn && (currentFrame.channels() == 3 || currentFrame.channels() == 4)) {
-                    cvtColor(currentFrame, currentFrame, cv::COLOR_BGR2GRAY, 1);
-                }
-
-                // Fill fuffer
-                processingBuffer.push_back(currentFrame);
-                if(emitOriginal)
-                    originalBuffer.push_back(currentFrame.clone());
+            // Frame was read before a seek
+            if(item.generation != seekGeneration) {
+                processingMutex.unlock();
+                continue;
             }
 
             // Wasn't able to grab frame, abort thread
-            else {
+            if(item.last) {
                 processingMutex.unlock();
-                endOfFrame_action();
+                if(!doStop)
+                    endOfFrame_action();
                 break;
             }
 
+            // Fill fuffer
+            currentFramenumber = item.framenumber + 1;
+            currentFrame = item.frame;
+            statsData.bytesCopiedPerFrame = item.bytesCopied;
+            processingBuffer.push_back(currentFrame);
+            if(emitOriginal)
+                originalBuffer.push_back(currentFrame.clone());
+
             processingMutex.unlock();
+            i++;
         }
         // Breakpoint if grabbing frames wasn't succesful
         if(doStop) {
@@ -151,27 +183,35 @@ void PlayerThread::run()
         ///////////////////////////////////
         /////////// Magnifying ///////////
         /////////////////////////////////
+        // Copy what the slots may change, the magnification runs without the lock
+        // so the GUI never waits for a frame to be magnified
         processingMutex.lock();
-
-        if(imgProcFlags.colorMagnifyOn)
-        {
-            magnificator.colorMagnify();
-            if(magnificator.hasFrame())
-            {
-                currentFrame = magnificator.getFrameFirst();
-            }
+        // Buffers were reset while they were filled, fill them again
+        if(syncBuffers()) {
+            processingMutex.unlock();
+            continue;
         }
-        else if(imgProcFlags.laplaceMagnifyOn)
+        magnifyFlags = imgProcFlags;
+        magnifySettings = imgProcSettings;
+
+        if(magnifyFlags.colorMagnifyOn || magnifyFlags.laplaceMagnifyOn || magnifyFlags.rieszMagnifyOn)
         {
-            magnificator.laplaceMagnify();
-            if(magnificator.hasFrame())
-            {
-                currentFrame = magnificator.getFrameFirst();
+            processingMutex.unlock();
+            // Wait for a core of the shared executor, then magnify in this thread
+            executor->run(stream, [this]() {
+                if(magnifyFlags.colorMagnifyOn)
+                    magnificator.colorMagnify();
+                else if(magnifyFlags.laplaceMagnifyOn)
+                    magnificator.laplaceMagnify();
+                else
+                    magnificator.rieszMagnify();
+            });
+            processingMutex.lock();
+            // Buffers were reset during the magnification, the frame belongs to the old ones
+            if(syncBuffers()) {
+                processingMutex.unlock();
+                continue;
             }
-        }
-        else if(imgProcFlags.rieszMagnifyOn)
-        {
-            magnificator.rieszMagnify();
             if(magnificator.hasFrame())
             {
                 currentFrame = magnificator.getFrameFirst();
@@ -186,9 +226,18 @@ void PlayerThread::run()
         // Increase number of frames given to GUI
         currentWriteIndex++;
 
-        frame = MatToQImage(currentFrame);
+        // Post the frames for the display, the GUI only takes the newest one when it repaints
+        displayMutex.lock();
+        DisplayMailbox *frames = displayMailbox;
+        DisplayMailbox *originals = originalDisplayMailbox;
+        const QSize shownSize = displaySize;
+        const QSize originalShownSize = originalDisplaySize;
+        displayMutex.unlock();
+        if(frames)
+            frames->post(MatToQImage(currentFrame, shownSize, &displayPool));
         if(emitOriginal) {
-            originalFrame = MatToQImage(originalBuffer.front());
+            if(originals && !originalBuffer.empty())
+                originals->post(MatToQImage(originalBuffer.front(), originalShownSize, &originalDisplayPool));
             if(!originalBuffer.empty())
                 originalBuffer.erase(originalBuffer.begin());
         }
@@ -198,12 +247,6 @@ void PlayerThread::run()
         ///////////////////////////////////
         /////////// Updating /////////////
         /////////////////////////////////
-        // Inform GUI thread of new frame
-        emit newFrame(frame);
-        // Inform GUI thread of original frame if option was set
-        if(emitOriginal)
-            emit origFrame(originalFrame);
-
         // Update statistics
         updateFPS(processingTime);
         statsData.nFramesProcessed = currentWriteIndex;
@@ -215,9 +258,74 @@ void PlayerThread::run()
         int wait = max(delay-diff,0.0);
         this->msleep(wait);
     }
+
+    // Stop the decoder, it waits either for a seek or for room in the queue
+    decoderStop = true;
+    captureMutex.lock();
+    seeked.wakeAll();
+    captureMutex.unlock();
+    decodedFrames.clear();
+    decoder.join();
+    // Frames that are still queued are read again when playing is resumed
+    decodedFrames.clear();
     qDebug() << "Stopping player thread...";
 }
 
+void PlayerThread::decodeFrames()
+{
+    while(!decoderStop)
+    {
+        DecodedFrame item;
+        const qint64 start = Profiler::now();
+        captureMutex.lock();
+        item.generation = seekGeneration;
+        item.framenumber = cap.isOpened() ? (int)cap.get(cv::CAP_PROP_POS_FRAMES) : 0;
+        const bool grabbed = cap.isOpened() && item.framenumber < lengthInFrames && cap.read(grabbedFrame);
+        captureMutex.unlock();
+
+        // End of video (or released), tell the player and wait for a seek
+        if(!grabbed) {
+            item.last = true;
+            decodedFrames.add(item);
+            captureMutex.lock();
+            while(!decoderStop && item.generation == seekGeneration)
+                seeked.wait(&captureMutex);
+            captureMutex.unlock();
+            continue;
+        }
+
+        processingMutex.lock();
+        const Rect roi = currentROI;
+        const bool grayscaleOn = imgProcFlags.grayscaleOn;
+        processingMutex.unlock();
+
+        // Preprocessing
+        // Copy only the ROI of frame, grabbedFrame is overwritten by the next read
+        item.frame = roiPool.copyRoi(grabbedFrame, roi);
+        item.bytesCopied = item.frame.total()*item.frame.elemSize();
+        // Convert to grayscale
+        if(grayscaleOn && (item.frame.channels() == 3 || item.frame.channels() == 4)) {
+            cvtColor(item.frame, item.frame, cv::COLOR_BGR2GRAY, 1);
+        }
+
+        profiler.addSpan("player.decode", start, Profiler::now() - start);
+        decodedFrames.add(item);
+    }
+}
+
+void PlayerThread::seek(int property, double value)
+{
+    QMutexLocker locker(&captureMutex);
+    if(!cap.isOpened())
+        return;
+    cap.set(property, value);
+    currentFramenumber = (int)cap.get(cv::CAP_PROP_POS_FRAMES);
+    // Frames read before are dropped by the player, the decoder may already be waiting at the end
+    seekGeneration++;
+    decodedFrames.clear();
+    seeked.wakeAll();
+}
+
 int PlayerThread::getCurrentReadIndex()
 {
     return std::min(currentWriteIndex, processingBufferLength-1);
@@ -233,11 +341,16 @@ void PlayerThread::getOriginalFrame(bool doEmit)
     QMutexLocker locker1(&doStopMutex);
     QMutexLocker locker2(&processingMutex);
 
-    originalBuffer.clear();
-    originalBuffer = processingBuffer;
+    // The player copies its processing buffer before the next frame
+    syncOriginals = true;
     emitOriginal = doEmit;
 }
 
+Profiler *PlayerThread::getProfiler()
+{
+    return &profiler;
+}
+
 // Load videofile
 bool PlayerThread::loadFile()
 {
@@ -271,11 +384,13 @@ bool PlayerThread::loadFile()
     // Write information in Settings
     statsData.averageFPS = fps;
     imgProcSettings.framerate = fps;
+    executor->setStreamFramerate(stream, fps);
     imgProcSettings.frameHeight = cap.get(cv::CAP_PROP_FRAME_HEIGHT);
     imgProcSettings.frameWidth = cap.get(cv::CAP_PROP_FRAME_WIDTH);
 
     // Save total length of video
     lengthInFrames = cap.get(cv::CAP_PROP_FRAME_COUNT);
+    currentFramenumber = 0;
 
     return openResult;
 }
@@ -283,6 +398,7 @@ bool PlayerThread::loadFile()
 // Release the file from VideoCapture
 bool PlayerThread::releaseFile()
 {
+    QMutexLocker locker(&captureMutex);
     // File is loaded
     if(cap.isOpened())
     {
@@ -340,13 +456,31 @@ void PlayerThread::setROI(QRect roi)
     currentROI.width = roi.width();
     currentROI.height = roi.height();
     int levels = magnificator.calculateMaxLevels(roi);
-    magnificator.clearBuffer();
     locker1.unlock();
     locker2.unlock();
     setBufferSize();
     emit maxLevels(levels);
 }
 
+void PlayerThread::setDisplayMailboxes(DisplayMailbox *frames, DisplayMailbox *originals)
+{
+    QMutexLocker locker(&displayMutex);
+    displayMailbox = frames;
+    originalDisplayMailbox = originals;
+}
+
+void PlayerThread::setDisplaySize(QSize size)
+{
+    QMutexLocker locker(&displayMutex);
+    displaySize = size;
+}
+
+void PlayerThread::setOriginalDisplaySize(QSize size)
+{
+    QMutexLocker locker(&displayMutex);
+    originalDisplaySize = size;
+}
+
 QRect PlayerThread::getCurrentROI()
 {
     return QRect(currentROI.x, currentROI.y, currentROI.width, currentROI.height);
@@ -378,6 +512,7 @@ void PlayerThread::updateImageProcessingSettings(struct ImageProcessingSettings
     this->imgProcSettings.coLow = imgProcessingSettings.coLow;
     this->imgProcSettings.coHigh = imgProcessingSettings.coHigh;
     this->imgProcSettings.chromAttenuation = imgProcessingSettings.chromAttenuation;
+    this->imgProcSettings.rieszFilterTolerance = imgProcessingSettings.rieszFilterTolerance;
     this->imgProcSettings.levels = imgProcessingSettings.levels;
 
     if(resetBuffer) {
@@ -399,7 +534,8 @@ void PlayerThread::playAction()
             doStop = false;
             doPause = false;
             doPlay = true;
-            cap.set(cv::CAP_PROP_POS_FRAMES, getCurrentFramenumber());
+            // Continue behind the last played frame, not behind the frames read ahead
+            seek(cv::CAP_PROP_POS_FRAMES, getCurrentFramenumber());
             start();
         }
         else if(isStopping()) {
@@ -449,8 +585,8 @@ void PlayerThread::setCurrentFrame(int framenumber)
 
 void PlayerThread::setCurrentTime(int ms)
 {
-    if(cap.isOpened())
-        cap.set(cv::CAP_PROP_POS_MSEC, ms);
+    QMutexLocker locker(&processingMutex);
+    seek(cv::CAP_PROP_POS_MSEC, ms);
 }
 
 double PlayerThread::getInputFrameLength()
@@ -463,11 +599,11 @@ double PlayerThread::getInputTimeLength() {
 }
 
 double PlayerThread::getCurrentFramenumber() {
-    return cap.get(cv::CAP_PROP_POS_FRAMES);
+    return currentFramenumber;
 }
 
 double PlayerThread::getCurrentPosition() {
-    return cap.get(cv::CAP_PROP_POS_MSEC);
+    return getCurrentFramenumber()*1000.0/fps;
 }
 
 void PlayerThread::updateFPS(int timeElapsed)
@@ -505,6 +641,24 @@ void PlayerThread::fillProcessingBuffer()
     processingBuffer.push_back(currentFrame);
 }
 
+// Called by the player with processingMutex locked, true if the buffers were cleared
+bool PlayerThread::syncBuffers()
+{
+    bool cleared = false;
+    if(clearedGeneration != bufferGeneration) {
+        processingBuffer.clear();
+        originalBuffer.clear();
+        magnificator.clearBuffer();
+        clearedGeneration = bufferGeneration;
+        cleared = true;
+    }
+    if(syncOriginals) {
+        originalBuffer = processingBuffer;
+        syncOriginals = false;
+    }
+    return cleared;
+}
+
 bool PlayerThread::processingBufferFilled()
 {
     return (processingBuffer.size() == processingBufferLength);
@@ -515,9 +669,8 @@ void PlayerThread::setBufferSize()
     QMutexLocker locker1(&doStopMutex);
     QMutexLocker locker2(&processingMutex);
 
-    processingBuffer.clear();
-    originalBuffer.clear();
-    magnificator.clearBuffer();
+    // The player clears its buffers and the magnificator before the next frame
+    bufferGeneration++;
 
     if(imgProcFlags.colorMagnifyOn) {
         processingBufferLength = magnificator.getOptimalBufferSize(imgProcSettings.framerate);
@@ -533,5 +686,5 @@ void PlayerThread::setBufferSize()
     }
 
     if(cap.isOpened() || !doStop)
-        cap.set(cv::CAP_PROP_POS_FRAMES, std::max(currentWriteIndex-processingBufferLength,0));
+        seek(cv::CAP_PROP_POS_FRAMES, std::max(currentWriteIndex-processingBufferLength,0));
 }
@@ -26,30 +26,59 @@
 #define PLAYERTHREAD_H
 
 // C++
+#include <atomic>
 #include <cmath>
+#include <thread>
 // Qt
 #include <QtCore/QThread>
 #include <QFile>
 #include <QMutex>
+#include <QWaitCondition>
 #include <QDebug>
 #include <QtCore/QTime>
 #include <QtCore/QQueue>
+#include <QtCore/QSize>
 // OpenCV
 #include <opencv2/highgui/highgui.hpp>
 // Local
 #include "main/other/Config.h"
 #include "main/other/Structures.h"
+#include "main/other/Buffer.h"
+#include "main/helper/FramePool.h"
+#include "main/helper/MagnificationExecutor.h"
 #include "main/helper/MatToQImage.h"
+#include "main/helper/DisplayMailbox.h"
+#include "main/helper/Profiler.h"
 #include "main/magnification/Magnificator.h"
 
 using namespace cv;
 
+// Frame that the decoder stage reads ahead of the playback
+struct DecodedFrame{
+    Mat frame;
+    // Position of the frame in the video
+    int framenumber;
+    // Value of PlayerThread::seekGeneration when the frame was read
+    int generation;
+    // Sentinel at the end of the video
+    bool last;
+    double bytesCopied;
+
+    DecodedFrame() :
+        framenumber(0),
+        generation(0),
+        last(false),
+        bytesCopied(0)
+    {
+    }
+};
+
 class PlayerThread : public QThread
 {
     Q_OBJECT
     
     public:
-        PlayerThread(const std::string filepath, int width, int height, double fps);
+        PlayerThread(const std::string filepath, MagnificationExecutor *executor, int width, int height, double fps);
         ~PlayerThread();
         void stop();
         // Capture
@@ -75,6 +104,10 @@ class PlayerThread : public QThread
         double getInputTimeLength();
         double getFPS();
         void getOriginalFrame(bool doEmit);
+        // Frames for the display are posted to these, set before starting
+        void setDisplayMailboxes(DisplayMailbox *frames, DisplayMailbox *originals);
+        // Stages of the magnification
+        Profiler *getProfiler();
 
 private:
         QMutex doStopMutex;
@@ -82,10 +115,26 @@ private:
         double lengthInMs;
         double lengthInFrames;
         const std::string filepath;
+        MagnificationExecutor *executor;
+        int stream;
         int getCurrentReadIndex();
         // Capture
         VideoCapture cap;
         Mat grabbedFrame;
+        FramePool roiPool;
+        // Decoder stage, reads and crops up to PLAYER_LOOKAHEAD_FRAMES frames ahead of the playback
+        void decodeFrames();
+        // Moves the capture to value of property (frames or ms) and discards the frames read ahead
+        void seek(int property, double value);
+        Buffer<DecodedFrame> decodedFrames;
+        // Guards cap, which is read by the decoder and moved by seeks
+        QMutex captureMutex;
+        QWaitCondition seeked;
+        // Incremented by every seek, frames read before are dropped
+        std::atomic<int> seekGeneration;
+        std::atomic<bool> decoderStop;
+        // Position of the next frame of the playback, cap is ahead of it
+        std::atomic<int> currentFramenumber;
         int playedTime;
         int width;
         int height;
@@ -99,8 +148,14 @@ private:
         void updateFPS(int timeElapsed);
         Mat currentFrame;
         Rect currentROI;
-        QImage frame;
-        QImage originalFrame;
+        // Frames are scaled to the size of their label before they are emitted
+        FramePool displayPool;
+        FramePool originalDisplayPool;
+        QSize displaySize;
+        QSize originalDisplaySize;
+        DisplayMailbox *displayMailbox;
+        DisplayMailbox *originalDisplayMailbox;
+        QMutex displayMutex;
         // processing measurement
         QTime t;
         int processingTime;
@@ -112,6 +167,15 @@ private:
         Point framePoint;
         struct ImageProcessingFlags imgProcFlags;
         struct ImageProcessingSettings imgProcSettings;
+        // Copies of the player for the magnificator, taken for every frame
+        struct ImageProcessingFlags magnifyFlags;
+        struct ImageProcessingSettings magnifySettings;
+        // Incremented by setBufferSize(), the player clears its buffers once it sees it
+        int bufferGeneration;
+        int clearedGeneration;
+        // Set by getOriginalFrame(), the player copies its processing buffer to originalBuffer
+        bool syncOriginals;
+        bool syncBuffers();
         // Player variables
         volatile bool doStop;
         volatile bool doPause;
@@ -121,6 +185,7 @@ private:
         // Magnifying
         bool processingBufferFilled();
         void fillProcessingBuffer();
+        Profiler profiler;
         Magnificator magnificator;
         std::vector<Mat> processingBuffer;
         int processingBufferLength;
@@ -134,11 +199,11 @@ private slots:
         void updateImageProcessingSettings(struct ImageProcessingSettings);
         void setROI(QRect roi);
         void pauseThread();
+        void setDisplaySize(QSize size);
+        void setOriginalDisplaySize(QSize size);
 
 signals:
         void updateStatisticsInGUI(struct ThreadStatisticsData);
-        void newFrame(const QImage &frame);
-        void origFrame(const QImage &frame);
         void endOfFrame();
         void maxLevels(int levels);
 };
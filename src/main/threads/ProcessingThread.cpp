@@ -24,9 +24,20 @@
 
 #include "main/threads/ProcessingThread.h"
 
-ProcessingThread::ProcessingThread(SharedImageBuffer *sharedImageBuffer, int deviceNumber) : QThread(),
+ProcessingThread::ProcessingThread(SharedImageBuffer *sharedImageBuffer, MagnificationExecutor *executor, int deviceNumber) : QThread(),
     sharedImageBuffer(sharedImageBuffer),
-    emitOriginal(false)
+    executor(executor),
+    roiPool(FRAME_POOL_MAX_SIZE),
+    displayPool(DISPLAY_POOL_MAX_SIZE),
+    originalDisplayPool(DISPLAY_POOL_MAX_SIZE),
+    displayMailbox(0),
+    originalDisplayMailbox(0),
+    preparedFrames(PIPELINE_QUEUE_SIZE),
+    decomposedFrames(PIPELINE_QUEUE_SIZE),
+    magnifiedFrames(PIPELINE_QUEUE_SIZE),
+    generation(0),
+    emitOriginal(false),
+    encoder(RECORD_QUEUE_SIZE, DEFAULT_RECORD_QUEUE_POLICY)
 {
     // Save Device Number
     this->deviceNumber=deviceNumber;
@@ -35,15 +46,28 @@ ProcessingThread::ProcessingThread(SharedImageBuffer *sharedImageBuffer, int dev
     doRecord=false;
     sampleNumber=0;
     fpsSum=0;
-    framesWritten = 0;
     fps.clear();
     statsData.averageFPS=0;
     statsData.nFramesProcessed=0;
     captureOriginal = false;
 
     this->processingBufferLength = 2;
-    this->magnificator = Magnificator(&processingBuffer, &imgProcFlags, &imgProcSettings);
-    this->output = VideoWriter();
+    // The magnificators read the copies of stage 2 and 3, the slots only change the originals
+    magnifiedGeneration = generation;
+    this->magnificator = Magnificator(&processingBuffer, &magnifyFlags, &magnifySettings);
+    this->magnificator.setProfiler(&profiler);
+    decomposedGeneration = generation;
+    this->decomposer = Magnificator(0, &decomposeFlags, &decomposeSettings);
+    this->decomposer.setProfiler(&profiler);
+    preparedFrames.setProfiler(&profiler, "preparedFrames.getWait", "preparedFrames.addWait", "preparedFrames.depth");
+    decomposedFrames.setProfiler(&profiler, "decomposedFrames.getWait", "decomposedFrames.addWait", "decomposedFrames.depth");
+    magnifiedFrames.setProfiler(&profiler, "magnifiedFrames.getWait", "magnifiedFrames.addWait", "magnifiedFrames.depth");
+    // Recorded frames are encoded by the encoder thread, which counts them
+    encoder.setProfiler(&profiler);
+    connect(&encoder, SIGNAL(frameWritten(int)), this, SIGNAL(frameWritten(int)));
+    // Magnification of this camera is scheduled by the shared executor
+    this->stream = executor->addStream();
+    this->decomposeStream = executor->addStream();
 }
 
 // Destructor
@@ -57,15 +81,18 @@ ProcessingThread::~ProcessingThread()
     processingBuffer.clear();
     doStopMutex.unlock();
     wait();
+    executor->removeStream(stream);
+    executor->removeStream(decomposeStream);
 }
 
 // Release videoCapture if available
 bool ProcessingThread::releaseCapture()
 {
-    if(output.isOpened())
+    QMutexLocker locker(&recordMutex);
+    if(!recorder.empty())
     {
-        // Release Video
-        output.release();
+        // Release Video, it is closed once the encoder wrote its queued frames
+        recorder.release();
         return true;
     }
     // There was no video
@@ -76,6 +103,106 @@ bool ProcessingThread::releaseCapture()
 void ProcessingThread::run()
 {
     qDebug() << "Starting processing thread...";
+    // Stage 1, 2 and 4 of the pipeline run on their own threads, this thread is stage 3
+    std::thread prepareStage(&ProcessingThread::prepareFrames, this);
+    std::thread decomposeStage(&ProcessingThread::decomposeFrames, this);
+    std::thread outputStage(&ProcessingThread::outputFrames, this);
+    // Recorded frames are encoded after stage 4 by the encoder thread
+    encoder.start();
+
+    // Stage 3: magnify, the temporal filters keep state between frames, so this stage takes the frames
+    // in order. The pyramid of the next frame is built by stage 2 meanwhile.
+    while(1)
+    {
+        PipelineFrame item = decomposedFrames.get();
+        // Stage 2 stopped, pass it on
+        if(item.last)
+        {
+            magnifiedFrames.add(item);
+            break;
+        }
+        QElapsedTimer stageTime;
+        stageTime.start();
+        const qint64 stageStart = Profiler::now();
+
+        // Copy what the slots may change, the magnification runs without the lock
+        // so the GUI and the other stages never wait for a frame to be magnified
+        processingMutex.lock();
+        const int currentGeneration = generation;
+        magnifyFlags = imgProcFlags;
+        magnifySettings = imgProcSettings;
+        processingMutex.unlock();
+
+        // Frame was prepared with an ROI or flags that were replaced in the meantime
+        if(item.generation != currentGeneration)
+            continue;
+        // Frames of the old ROI, flags or levels are still buffered, only this stage touches them
+        if(magnifiedGeneration != currentGeneration)
+        {
+            processingBuffer.clear();
+            magnificator.clearBuffer();
+            magnifiedGeneration = currentGeneration;
+        }
+        currentFrame = item.frame;
+
+        ////////////////////////// ///////// // 
+        // PERFORM IMAGE PROCESSING BELOW // 
+        ////////////////////////// ///////// // 
+
+       if(item.spatial) {
+           // Laplace or Riesz, decomposed by stage 2 under the same generation.
+           // Wait for a core of the shared executor, then filter in this thread
+           executor->run(stream, [this, &item]() {
+               magnificator.magnify(*item.spatial);
+           });
+           currentFrame = magnificator.getFrameFirst();
+           // The decomposition goes back to stage 2
+           item.spatial.reset();
+       }
+       else {
+           // Fill Buffer that is processed by Magnificator
+           fillProcessingBuffer();
+
+           if (processingBufferFilled()) {
+               if(magnifyFlags.colorMagnifyOn)
+               {
+                   // Wait for a core of the shared executor, then magnify in this thread
+                   executor->run(stream, [this]() {
+                       magnificator.colorMagnify();
+                   });
+                   currentFrame = magnificator.getFrameLast();
+               }
+               else
+                   processingBuffer.erase(processingBuffer.begin());
+           }
+       }
+
+        ////////////////////////// ///////// // 
+        // PERFORM IMAGE PROCESSING ABOVE // 
+        ////////////////////////// ///////// // 
+
+        item.frame = currentFrame;
+
+        item.magnifyTime = stageTime.nsecsElapsed()/1000000.0;
+        profiler.addSpan("pipeline.magnify", stageStart, Profiler::now() - stageStart);
+        magnifiedFrames.add(item);
+    }
+
+    outputStage.join();
+    decomposeStage.join();
+    prepareStage.join();
+    // Stage 4 stopped, encode the frames it recorded
+    encoder.stop();
+    // Frames that are still queued belong to the stopped pipeline
+    preparedFrames.clear();
+    decomposedFrames.clear();
+    magnifiedFrames.clear();
+    qDebug() << "Stopping processing thread...";
+}
+
+// Stage 1: dequeue, crop ROI and convert to grayscale
+void ProcessingThread::prepareFrames()
+{
     while(1)
     {
         ////////////////////////// /////// 
@@ -92,96 +219,160 @@ void ProcessingThread::run()
         ////////////////////////// ////////
         ////////////////////////// ////////
 
-        // Save processing time
-        processingTime=t.elapsed();
-        // Start timer (used to calculate processing rate)
-        t.start();
+        // Get frame from queue, the frame goes back to the pool of the capture thread
+        // once it isn't referenced anymore
+        Mat grabbedFrame = sharedImageBuffer->getByDeviceNumber(deviceNumber)->get();
+        QElapsedTimer stageTime;
+        stageTime.start();
+        const qint64 stageStart = Profiler::now();
 
+        PipelineFrame item;
         processingMutex.lock();
-        // Get frame from queue, store in currentFrame, set ROI
-        currentFrame=Mat(sharedImageBuffer->getByDeviceNumber(deviceNumber)->get().clone(), currentROI);
-
-        ////////////////////////// ///////// // 
-        // PERFORM IMAGE PROCESSING BELOW // 
-        ////////////////////////// ///////// // 
+        const Rect roi = currentROI;
+        const bool grayscaleOn = imgProcFlags.grayscaleOn;
+        item.generation = generation;
+        processingMutex.unlock();
 
-        // Grayscale conversion (in-place operation)
-       if(imgProcFlags.grayscaleOn && (currentFrame.channels() == 3 || currentFrame.channels() == 4)) {
-           cvtColor(currentFrame, currentFrame, cv::COLOR_BGR2GRAY, 1);
-       }
+        // A full frame ROI is used without copy, else only the ROI is copied into a compact frame
+        if(roi == Rect(0, 0, grabbedFrame.cols, grabbedFrame.rows)) {
+            item.frame = grabbedFrame;
+            item.bytesCopied = 0;
+        }
+        else {
+            item.frame = roiPool.copyRoi(grabbedFrame, roi);
+            item.bytesCopied = item.frame.total()*item.frame.elemSize();
+        }
 
-       // Save the original Frame after grayscale conversion, so VideoWriter works correct
-       if(emitOriginal || captureOriginal)
-           originalFrame = currentFrame.clone();
+        // Grayscale conversion
+        if(grayscaleOn && (item.frame.channels() == 3 || item.frame.channels() == 4)) {
+            cvtColor(item.frame, item.frame, cv::COLOR_BGR2GRAY, 1);
+        }
 
-       // Fill Buffer that is processed by Magnificator
-       fillProcessingBuffer();
+        // Keep the original Frame after grayscale conversion, so VideoWriter works correct.
+        // The following stages only read it, so it is shared without copy
+        item.original = item.frame;
 
-       if (processingBufferFilled()) {
-           if(imgProcFlags.colorMagnifyOn)
-           {
-               magnificator.colorMagnify();
-               currentFrame = magnificator.getFrameLast();
-           }
-           else if(imgProcFlags.laplaceMagnifyOn)
+        item.prepareTime = stageTime.nsecsElapsed()/1000000.0;
+        profiler.addSpan("pipeline.prepare", stageStart, Profiler::now() - stageStart);
+        preparedFrames.add(item);
+    }
+    // Tell the following stages to stop
+    PipelineFrame last;
+    last.last = true;
+    preparedFrames.add(last);
+}
 
-           {
-               magnificator.laplaceMagnify();
-               currentFrame = magnificator.getFrameLast();
-           }
-           else if(imgProcFlags.rieszMagnifyOn)
-           {
-               magnificator.rieszMagnify();
-               currentFrame = magnificator.getFrameLast();
-           }
-           else
-               processingBuffer.erase(processingBuffer.begin());
-       }
+// Stage 2: spatial decomposition of the Laplace and Riesz magnification. The pyramid of a frame needs
+// none of the temporal state, only the Riesz phase is unwrapped against the frame before, which this
+// stage keeps itself. The color magnification decomposes a window of frames at once in stage 3.
+void ProcessingThread::decomposeFrames()
+{
+    while(1)
+    {
+        PipelineFrame item = preparedFrames.get();
+        // Stage 1 stopped, pass it on
+        if(item.last)
+        {
+            decomposedFrames.add(item);
+            break;
+        }
+        QElapsedTimer stageTime;
+        stageTime.start();
+        const qint64 stageStart = Profiler::now();
 
-        ////////////////////////// ///////// // 
-        // PERFORM IMAGE PROCESSING ABOVE // 
-        ////////////////////////// ///////// // 
+        processingMutex.lock();
+        const int currentGeneration = generation;
+        decomposeFlags = imgProcFlags;
+        decomposeSettings = imgProcSettings;
+        processingMutex.unlock();
 
-        // Convert Mat to QImage
-        frame=MatToQImage(currentFrame);
+        // Frame was prepared with an ROI or flags that were replaced in the meantime
+        if(item.generation != currentGeneration)
+            continue;
+        // Phases of the old ROI, flags or levels aren't unwrapped against
+        if(decomposedGeneration != currentGeneration)
+        {
+            decomposer.clearBuffer();
+            decomposedGeneration = currentGeneration;
+        }
+        if(!decomposeFlags.colorMagnifyOn && (decomposeFlags.laplaceMagnifyOn || decomposeFlags.rieszMagnifyOn))
+        {
+            item.spatial = freeSpatialFrame();
+            executor->run(decomposeStream, [this, &item]() {
+                decomposer.decompose(item.frame, *item.spatial);
+            });
+        }
 
-        processingMutex.unlock();
+        item.decomposeTime = stageTime.nsecsElapsed()/1000000.0;
+        profiler.addSpan("pipeline.decompose", stageStart, Profiler::now() - stageStart);
+        decomposedFrames.add(item);
+    }
+}
 
-        // Save the Stream
-        if(doRecord) { 
-            if(output.isOpened()) { 
-                if(captureOriginal) {
-
-                    processingMutex.lock();
-                    // Combine original and processed frame
-                    combinedFrame = combineFrames(currentFrame,originalFrame);
-                    processingMutex.unlock();
-
-                    output.write(combinedFrame);
-                }
-                else {
-                    output.write(currentFrame);
-                }
-
-                framesWritten++;
-                emit frameWritten(framesWritten);
-            }
+std::shared_ptr<SpatialFrame> ProcessingThread::freeSpatialFrame()
+{
+    for(size_t i = 0; i < spatialFrames.size(); i++)
+        if(spatialFrames[i].use_count() == 1) {
+            // Pairs with the release of the last reference of stage 3
+            std::atomic_thread_fence(std::memory_order_acquire);
+            return spatialFrames[i];
         }
+    // All are queued or filtered, the pool stops growing at the depth of the pipeline
+    spatialFrames.push_back(std::make_shared<SpatialFrame>());
+    return spatialFrames.back();
+}
 
-        // Emit the original image before converting to grayscale
-       if(emitOriginal)
-           emit origFrame(MatToQImage(originalFrame));
-        // Inform GUI thread of new frame (QImage)
-        // emit newFrame(frame);
-        emit newFrame(MatToQImage(currentFrame));
+// Stage 4: record, convert to QImage and emit
+void ProcessingThread::outputFrames()
+{
+    while(1)
+    {
+        PipelineFrame item = magnifiedFrames.get();
+        if(item.last)
+            break;
+        QElapsedTimer stageTime;
+        stageTime.start();
+        const qint64 stageStart = Profiler::now();
+
+        // Save processing time
+        processingTime=t.elapsed();
+        // Start timer (used to calculate processing rate)
+        t.start();
 
-        // Update statistics
+        // Save the Stream, the encoder thread writes the frame (side by side with the original)
+        recordMutex.lock();
+        const Ptr<VideoWriter> writer = doRecord ? recorder : Ptr<VideoWriter>();
+        const bool recordOriginal = captureOriginal;
+        recordMutex.unlock();
+        if(!writer.empty())
+            encoder.add(item.frame, recordOriginal ? item.original : Mat(), writer);
+
+        // Post the frames for the display, the GUI only takes the newest one when it repaints
+        displayMutex.lock();
+        DisplayMailbox *frames = displayMailbox;
+        DisplayMailbox *originals = originalDisplayMailbox;
+        const QSize shownSize = displaySize;
+        const QSize originalShownSize = originalDisplaySize;
+        displayMutex.unlock();
+        if(emitOriginal && originals)
+            originals->post(MatToQImage(item.original, originalShownSize, &originalDisplayPool));
+        if(frames)
+            frames->post(MatToQImage(item.frame, shownSize, &displayPool));
+
+        // Update statistics, stage latencies are smoothed
+        const double outputTime = stageTime.nsecsElapsed()/1000000.0;
+        profiler.addSpan("pipeline.output", stageStart, Profiler::now() - stageStart);
+        const double weight = statsData.nFramesProcessed > 0 ? PIPELINE_LATENCY_SMOOTHING : 1.0;
+        statsData.prepareLatency += weight*(item.prepareTime - statsData.prepareLatency);
+        statsData.decomposeLatency += weight*(item.decomposeTime - statsData.decomposeLatency);
+        statsData.magnifyLatency += weight*(item.magnifyTime - statsData.magnifyLatency);
+        statsData.outputLatency += weight*(outputTime - statsData.outputLatency);
+        statsData.bytesCopiedPerFrame = item.bytesCopied;
         updateFPS(processingTime);
         statsData.nFramesProcessed++;
         // Inform GUI of updated statistics
         emit updateStatisticsInGUI(statsData);
     }
-    qDebug() << "Stopping processing thread...";
 }
 
 void ProcessingThread::fillProcessingBuffer()
@@ -199,6 +390,11 @@ void ProcessingThread::getOriginalFrame(bool doEmit)
     emitOriginal = doEmit;
 }
 
+Profiler *ProcessingThread::getProfiler()
+{
+    return &profiler;
+}
+
 int ProcessingThread::getRecordFPS()
 {
     return recordingFramerate;
@@ -233,6 +429,7 @@ void ProcessingThread::updateFPS(int timeElapsed)
 
         // save new fps in settings and inform magnification thread about it
         // (this is important for fps based color magnification)
+        QMutexLocker locker(&processingMutex);
         imgProcSettings.framerate = statsData.averageFPS;
     }
 }
@@ -252,8 +449,8 @@ void ProcessingThread::updateImageProcessingFlags(struct ImageProcessingFlags im
     this->imgProcFlags.colorMagnifyOn = imageProcessingFlags.colorMagnifyOn;
     this->imgProcFlags.laplaceMagnifyOn = imageProcessingFlags.laplaceMagnifyOn;
     this->imgProcFlags.rieszMagnifyOn = imageProcessingFlags.rieszMagnifyOn;
-    processingBuffer.clear();
-    magnificator.clearBuffer();
+    // Stage 2 and 3 clear their buffers once they see the new generation
+    generation++;
 }
 
 void ProcessingThread::updateImageProcessingSettings(struct ImageProcessingSettings imgProcessingSettings)
@@ -265,10 +462,9 @@ void ProcessingThread::updateImageProcessingSettings(struct ImageProcessingSetti
     this->imgProcSettings.coLow = imgProcessingSettings.coLow;
     this->imgProcSettings.coHigh = imgProcessingSettings.coHigh;
     this->imgProcSettings.chromAttenuation = imgProcessingSettings.chromAttenuation;
-    if(this->imgProcSettings.levels != imgProcessingSettings.levels) {
-        processingBuffer.clear();
-        magnificator.clearBuffer();
-    }
+    this->imgProcSettings.rieszFilterTolerance = imgProcessingSettings.rieszFilterTolerance;
+    if(this->imgProcSettings.levels != imgProcessingSettings.levels)
+        generation++;
     this->imgProcSettings.levels = imgProcessingSettings.levels;
 }
 
@@ -279,15 +475,34 @@ void ProcessingThread::setROI(QRect roi)
     currentROI.y = roi.y();
     currentROI.width = roi.width();
     currentROI.height = roi.height();
-    processingBuffer.clear();
-    magnificator.clearBuffer();
+    generation++;
     int levels = magnificator.calculateMaxLevels(roi);
     locker.unlock();
     emit maxLevels(levels);
 }
 
+void ProcessingThread::setDisplayMailboxes(DisplayMailbox *frames, DisplayMailbox *originals)
+{
+    QMutexLocker locker(&displayMutex);
+    displayMailbox = frames;
+    originalDisplayMailbox = originals;
+}
+
+void ProcessingThread::setDisplaySize(QSize size)
+{
+    QMutexLocker locker(&displayMutex);
+    displaySize = size;
+}
+
+void ProcessingThread::setOriginalDisplaySize(QSize size)
+{
+    QMutexLocker locker(&displayMutex);
+    originalDisplaySize = size;
+}
+
 QRect ProcessingThread::getCurrentROI()
 {
+    QMutexLocker locker(&processingMutex);
     return QRect(currentROI.x, currentROI.y, currentROI.width, currentROI.height);
 }
 
@@ -296,25 +511,29 @@ bool ProcessingThread::startRecord(std::string filepath, bool captureOriginal)
 {
     // release Video if any was made until now
     releaseCapture();
+    QMutexLocker locker(&recordMutex);
 
     // Initials for the VideoWriter
-    // Size
+    // Size, ROI and flags are only read under the lock stage 2 and 3 take them with
+    processingMutex.lock();
     int w = (int)currentROI.width;
     int h = (int)currentROI.height;
+    const bool grayscaleOn = imgProcFlags.grayscaleOn;
+    processingMutex.unlock();
     // Codec WATCH OUT: Not every codec is available on every PC,
     // MP4V was chosen because it's famous among various systems
     //int codec = CV_FOURCC('M','P','4','V');
     // Check if grayscale is on (or camera only captures grayscale)
-    bool isColor = !((imgProcFlags.grayscaleOn)||(currentFrame.channels() == 1));
+    bool isColor = !((grayscaleOn)||(currentFrame.channels() == 1));
     // Capture size is doubled if original should be captured too
     Size s = captureOriginal ? Size(w*2, h) : Size(w, h);
  
-    bool opened = false;
-    output = VideoWriter();
-    opened = output.open(filepath, savingCodec, statsData.averageFPS, s, isColor);
+    Ptr<VideoWriter> writer = makePtr<VideoWriter>();
+    bool opened = writer->open(filepath, savingCodec, statsData.averageFPS, s, isColor);
     recordingFramerate = statsData.averageFPS;
 
     if(opened) {
+        this->recorder = writer;
         this->doRecord = true;
         this->captureOriginal = captureOriginal;
     }
@@ -324,8 +543,10 @@ bool ProcessingThread::startRecord(std::string filepath, bool captureOriginal)
 
 void ProcessingThread::stopRecord()
 {
+    QMutexLocker locker(&recordMutex);
     this->doRecord = false;
-    framesWritten = 0;
+    // Frames still queued for the encoder keep the video open
+    recorder.release();
 }
 
 bool ProcessingThread::isRecording()
@@ -333,23 +554,11 @@ bool ProcessingThread::isRecording()
     return this->doRecord;
 }
 
-// Combine Frames into one Frame, depending on their size
-Mat ProcessingThread::combineFrames(Mat &frame1, Mat &frame2)
-{
-    Mat roi;
-    int w = (int)currentROI.width;
-    int h = (int)currentROI.height;
-
-    Mat mergedFrame = Mat(Size(w*2, h), frame1.type());
-    roi = Mat(mergedFrame, Rect(0,0,w,h));
-    frame1.copyTo(roi);
-    roi = Mat(mergedFrame, Rect(w,0,w,h));
-    frame2.copyTo(roi);
-
-    return mergedFrame;
-}
-
 void ProcessingThread::updateFramerate(double fps)
 {
+    QMutexLocker locker(&processingMutex);
     imgProcSettings.framerate = fps;
+    // Deadline of every frame is 1 frame period of the camera
+    executor->setStreamFramerate(stream, fps);
+    executor->setStreamFramerate(decomposeStream, fps);
 }
@@ -29,49 +29,113 @@
 #include <QtCore/QThread>
 #include <QtCore/QTime>
 #include <QtCore/QQueue>
+#include <QtCore/QSize>
+#include <QtCore/QElapsedTimer>
 #include "QDebug"
 // OpenCV
 #include <opencv2/opencv.hpp>
 #include <opencv2/highgui/highgui.hpp>
+// C++
+#include <atomic>
+#include <memory>
+#include <thread>
 // Local
 #include "main/other/Structures.h"
 #include "main/other/Config.h"
 #include "main/other/Buffer.h"
+#include "main/helper/FramePool.h"
+#include "main/helper/MagnificationExecutor.h"
 #include "main/helper/MatToQImage.h"
+#include "main/helper/DisplayMailbox.h"
+#include "main/helper/Profiler.h"
 #include "main/helper/SharedImageBuffer.h"
+#include "main/threads/EncoderThread.h"
 #include "main/magnification/Magnificator.h"
 
 using namespace cv;
 
+// Frame that is handed from one stage of the processing pipeline to the next
+struct PipelineFrame{
+    Mat frame;
+    // Frame before magnification, only read by the following stages
+    Mat original;
+    // Laplace or Riesz decomposition of frame, 0 for the other modes
+    std::shared_ptr<SpatialFrame> spatial;
+    // Value of ProcessingThread::generation when the frame was prepared
+    int generation;
+    // Sentinel that stops the following stages
+    bool last;
+    // Time spent in the stages in ms
+    double prepareTime;
+    double decomposeTime;
+    double magnifyTime;
+    double bytesCopied;
+
+    PipelineFrame() :
+        generation(0),
+        last(false),
+        prepareTime(0),
+        decomposeTime(0),
+        magnifyTime(0),
+        bytesCopied(0)
+    {
+    }
+};
+
 class ProcessingThread : public QThread
 {
     Q_OBJECT
 
     public:
-        ProcessingThread(SharedImageBuffer *sharedImageBuffer, int deviceNumber);
+        ProcessingThread(SharedImageBuffer *sharedImageBuffer, MagnificationExecutor *executor, int deviceNumber);
         ~ProcessingThread();
         bool releaseCapture();
         QRect getCurrentROI();
         void stop();
         void getOriginalFrame(bool doEmit);
+        // Frames for the display are posted to these, set before starting
+        void setDisplayMailboxes(DisplayMailbox *frames, DisplayMailbox *originals);
         bool startRecord(std::string filepath, bool captureOriginal);
         void stopRecord();
         bool isRecording();
         int getFPS();
         int getRecordFPS();
+        // Stages of the pipeline, the magnification and the queues between them
+        Profiler *getProfiler();
         int savingCodec;
 
     private:
         void updateFPS(int);
         bool processingBufferFilled();
         void fillProcessingBuffer();
+        void prepareFrames();
+        void decomposeFrames();
+        void outputFrames();
+        // Decomposition no other stage references anymore
+        std::shared_ptr<SpatialFrame> freeSpatialFrame();
+        Profiler profiler;
         Magnificator magnificator;
         SharedImageBuffer *sharedImageBuffer;
+        MagnificationExecutor *executor;
+        int stream;
+        // Stage 2 waits for a core of its own, so both stages keep 1 frame per period
+        int decomposeStream;
         Mat currentFrame;
-        Mat combinedFrame;
-        Mat originalFrame;
+        FramePool roiPool;
+        // Frames are scaled to the size of their label before they are emitted
+        FramePool displayPool;
+        FramePool originalDisplayPool;
+        QSize displaySize;
+        QSize originalDisplaySize;
+        DisplayMailbox *displayMailbox;
+        DisplayMailbox *originalDisplayMailbox;
+        QMutex displayMutex;
+        Buffer<PipelineFrame> preparedFrames;
+        Buffer<PipelineFrame> decomposedFrames;
+        Buffer<PipelineFrame> magnifiedFrames;
+        // Incremented whenever ROI or processing changes, queued frames of older generations are dropped
+        int generation;
         Rect currentROI;
-        QImage frame;
         QTime t;
         QQueue<int> fps;
         QMutex doStopMutex;
@@ -82,6 +146,17 @@ class ProcessingThread : public QThread
         Point framePoint;
         struct ImageProcessingFlags imgProcFlags;
         struct ImageProcessingSettings imgProcSettings;
+        // Copies of stage 3 for the magnificator, taken for every frame, and the generation of its buffers
+        struct ImageProcessingFlags magnifyFlags;
+        struct ImageProcessingSettings magnifySettings;
+        int magnifiedGeneration;
+        // Stage 2 decomposes with a Magnificator and copies of its own
+        Magnificator decomposer;
+        struct ImageProcessingFlags decomposeFlags;
+        struct ImageProcessingSettings decomposeSettings;
+        int decomposedGeneration;
+        // Decompositions of the frames between stage 2 and 3, reused once stage 3 released them
+        std::vector< std::shared_ptr<SpatialFrame> > spatialFrames;
         struct ThreadStatisticsData statsData;
         volatile bool doStop;
         int processingTime;
@@ -90,11 +165,11 @@ class ProcessingThread : public QThread
         int deviceNumber;
         bool emitOriginal;
         bool doRecord;
-        VideoWriter output;
-        int framesWritten;
+        // Writer of the current recording, shared with the frames queued for the encoder
+        Ptr<VideoWriter> recorder;
+        EncoderThread encoder;
         int recordingFramerate;
         bool captureOriginal;
-        Mat combineFrames(Mat &frame1, Mat &frame2);
         QMutex recordMutex;
 
     protected:
@@ -105,10 +180,10 @@ class ProcessingThread : public QThread
         void updateImageProcessingSettings(struct ImageProcessingSettings);
         void setROI(QRect roi);
         void updateFramerate(double fps);
+        void setDisplaySize(QSize size);
+        void setOriginalDisplaySize(QSize size);
 
     signals:
-        void newFrame(const QImage &frame);
-        void origFrame(const QImage &frame);
         void updateStatisticsInGUI(struct ThreadStatisticsData);
         void frameWritten(int frames);
         void maxLevels(int levels);
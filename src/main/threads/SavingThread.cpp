@@ -23,14 +23,30 @@
 /************************************************************************************/
 
 #include "main/threads/SavingThread.h"
+
+// Patterns like frames/%05d.png are image sequences, lossless for tests and editing
+static int videoApi(const std::string &file)
+{
+    return file.find('%') != std::string::npos ? cv::CAP_IMAGES : cv::CAP_ANY;
+}
+
 // Constructor
-SavingThread::SavingThread() : QThread()
+SavingThread::SavingThread(MagnificationExecutor *executor) : QThread(), executor(executor), roiPool(FRAME_POOL_MAX_SIZE)
 {
     this->doStop = true;
+    // Magnification of the export is scheduled by the shared executor
+    stream = executor->addStream();
+    streamFramerate = DEFAULT_EXECUTOR_FRAMERATE;
 
     currentWriteIndex = 0;
     processingBufferLength = 1;
 
+    exportWorkers = DEFAULT_EXPORT_WORKERS;
+    exportPreroll = DEFAULT_EXPORT_PREROLL_FRAMES;
+    exportTolerance = DEFAULT_EXPORT_TOLERANCE;
+    abortChunks = false;
+    failed = false;
+
     cap = VideoCapture();
     out = VideoWriter();
 }
@@ -43,12 +59,20 @@ SavingThread::~SavingThread()
     doStop = true;
     releaseFile();
     wait();
+    executor->removeStream(stream);
 }
 
 // Thread. Is designed to run till completed, then shut itself down
 void SavingThread::run()
 {
     qDebug() << "Starting SavingThread thread";
+    // Long Laplace and Riesz exports are magnified in chunks by several workers
+    int workers = exportWorkers > 0 ? exportWorkers : executor->cores();
+    int preroll = prerollFrames();
+    if(workers > 1 && preroll >= 0 && videoLength > std::max(EXPORT_CHUNK_FRAMES, 2*preroll)) {
+        // Stops the serial loop below when done
+        runParallel(preroll);
+    }
     while(1) {
         ////////////////////////// /////// 
         // Stop thread if doStop=TRUE // 
@@ -72,8 +96,8 @@ void SavingThread::run()
             for(int i = processingBuffer.size(); i < processingBufferLength; i++) {
                 // Try to read the Frame
                 if(cap.read(grabbedFrame)) {
-                    // Clone the most recent frame
-                    currentFrame = Mat(grabbedFrame.clone(), ROI);
+                    // Copy only the ROI of the most recent frame, grabbedFrame is overwritten by the next read
+                    currentFrame = roiPool.copyRoi(grabbedFrame, ROI);
 
                     // Do the PREPROCESSING
                     if(imgProcFlags.grayscaleOn && (currentFrame.channels() == 3 || currentFrame.channels() == 4)) {
@@ -99,16 +123,16 @@ void SavingThread::run()
         processingMutex.lock();
         ///Process
 
-        if(imgProcFlags.colorMagnifyOn) {
-            magnificator.colorMagnify();
-            processedFrame = magnificator.getFrameFirst();
-        }
-        else if(imgProcFlags.laplaceMagnifyOn) {
-            magnificator.laplaceMagnify();
-            processedFrame = magnificator.getFrameFirst();
-        }
-        else if(imgProcFlags.rieszMagnifyOn) {
-            magnificator.rieszMagnify();
+        if(imgProcFlags.colorMagnifyOn || imgProcFlags.laplaceMagnifyOn || imgProcFlags.rieszMagnifyOn) {
+            // Wait for a core of the shared executor, then magnify in this thread
+            executor->run(stream, [this]() {
+                if(imgProcFlags.colorMagnifyOn)
+                    magnificator.colorMagnify();
+                else if(imgProcFlags.laplaceMagnifyOn)
+                    magnificator.laplaceMagnify();
+                else
+                    magnificator.rieszMagnify();
+            });
             processedFrame = magnificator.getFrameFirst();
         }
         else {
@@ -170,7 +194,9 @@ void SavingThread::stop()
 
 bool SavingThread::loadFile(std::string source)
 {
-    if(cap.open(source)) {
+    if(cap.open(source, videoApi(source))) {
+        // Workers of the parallel export open their own capture
+        this->source = source;
         videoLength = cap.get(cv::CAP_PROP_FRAME_COUNT);
         return true;
     }
@@ -178,6 +204,13 @@ bool SavingThread::loadFile(std::string source)
         return false;
 }
 
+void SavingThread::setParallelExport(int workers, int preroll, double tolerance)
+{
+    exportWorkers = workers;
+    exportPreroll = preroll;
+    exportTolerance = tolerance;
+}
+
 void SavingThread::settings(ImageProcessingFlags imageProcFlags, ImageProcessingSettings imageProcSettings)
 {
     this->imgProcFlags = imageProcFlags;
@@ -188,6 +221,8 @@ void SavingThread::settings(ImageProcessingFlags imageProcFlags, ImageProcessing
 
 bool SavingThread::saveFile(std::string destination, double framerate, QRect dimensions, bool captureOriginal)
 {
+    executor->setStreamFramerate(stream, framerate);
+    streamFramerate = framerate;
     if(imgProcFlags.colorMagnifyOn) {
         processingBufferLength = magnificator.getOptimalBufferSize(framerate);
     }
@@ -207,9 +242,10 @@ bool SavingThread::saveFile(std::string destination, double framerate, QRect dim
     // MP4V was chosen because it's famous among various systems
     //int codec = CV_FOURCC('M','P','4','V');
 
-    bool success = (out.open(destination, savingCodec, framerate, s, !(imgProcFlags.grayscaleOn)));
+    bool success = (out.open(destination, videoApi(destination), savingCodec, framerate, s, !(imgProcFlags.grayscaleOn)));
     // Update the settings, to add framerate
     imgProcSettings.framerate = framerate;
+    failed = false;
     // If succesful, indicate thread is running
     if(success)
         doStop = false;
@@ -258,6 +294,279 @@ Mat SavingThread::combineFrames(Mat &frame1, Mat &frame2)
     return mergedFrame;
 }
 
+// Frames a chunk has to be magnified ahead of its start, until the state of the temporal
+// filters has forgotten its first frame, or -1 if the settings need a serial export
+int SavingThread::prerollFrames()
+{
+    double decay, gain;
+    double amplification = std::max(imgProcSettings.amplification, 1.0);
+    if(exportTolerance <= 0)
+        return -1;
+    if(imgProcFlags.laplaceMagnifyOn) {
+        // Both lowpasses of iirFilter() forget by 1-cutoff per frame
+        double cutoffLo = imgProcSettings.coLow == 0 ? 0.01 : imgProcSettings.coLow;
+        decay = 1.0 - std::min(cutoffLo, imgProcSettings.coHigh);
+        // Their difference is amplified on every level
+        gain = 2.0 * amplification * imgProcSettings.levels;
+    }
+    else if(imgProcFlags.rieszMagnifyOn) {
+        // Slowest pole of the Butterworth lowpasses
+        RieszTemporalFilter lo(imgProcSettings.coLow, imgProcSettings.framerate);
+        RieszTemporalFilter hi(imgProcSettings.coHigh, imgProcSettings.framerate);
+        lo.computeCoefficients();
+        hi.computeCoefficients();
+        decay = std::max(std::fabs(lo.itsA[1]/lo.itsA[0]), std::fabs(hi.itsA[1]/hi.itsA[0]));
+        // Filtered phase changes up to pi get amplified
+        gain = M_PI * amplification;
+    }
+    else {
+        // Color magnification filters a whole window of frames
+        return -1;
+    }
+    // Also catches NaN of invalid cutoffs
+    if(!(decay < 1.0))
+        return -1;
+
+    int frames = exportPreroll;
+    if(decay > 0)
+        frames = std::max(frames, (int)std::ceil(std::log(exportTolerance/(255.0*gain)) / std::log(decay)));
+    // The magnificator outputs 2 frames of the first input
+    frames += 2;
+
+    return frames <= EXPORT_MAX_PREROLL_FRAMES ? frames : -1;
+}
+
+// Writes the chunks in order while the workers magnify the following ones
+void SavingThread::runParallel(int preroll)
+{
+    int workers = exportWorkers > 0 ? exportWorkers : executor->cores();
+    chunkLength = std::max(EXPORT_CHUNK_FRAMES, 2*preroll);
+    nChunks = (videoLength + chunkLength - 1) / chunkLength;
+    workers = std::min(workers, nChunks);
+    nextChunk = 0;
+    writingChunk = 0;
+    chunks.clear();
+    bufferedBytes = 0;
+    abortChunks = false;
+    qDebug() << "Exporting" << nChunks << "chunks on" << workers << "workers," << preroll << "frames pre-roll";
+
+    // Each worker may start 1 chunk ahead of the written one
+    std::vector<std::thread> chunkWorkers;
+    for(int i = 0; i < workers; i++)
+        chunkWorkers.push_back(std::thread(&SavingThread::exportChunks, this, workers, preroll));
+
+    int resumeIndex = -1;
+    int chunk = 0;
+    while(chunk < nChunks && !isStopping()) {
+        Mat frame;
+        bool finished = false;
+        bool chunkFailed = false;
+        chunkMutex.lock();
+        ExportChunk &current = chunks[chunk];
+        while(current.frames.empty() && !current.finished && !isStopping())
+            chunkReady.wait(&chunkMutex, 100);
+        if(!current.frames.empty()) {
+            frame = current.frames.front();
+            current.frames.pop_front();
+            bufferedBytes -= frame.total()*frame.elemSize();
+            chunkWritten.wakeAll();
+        }
+        else if(current.finished) {
+            finished = true;
+            chunkFailed = current.failed;
+            chunks.erase(chunk);
+            writingChunk = chunk + 1;
+            chunkWritten.wakeAll();
+        }
+        chunkMutex.unlock();
+
+        ///Record
+        if(!frame.empty()) {
+            writeFrame(frame);
+            continue;
+        }
+        if(!finished)
+            continue;
+        if(chunkFailed) {
+            resumeIndex = currentWriteIndex;
+            break;
+        }
+        // A chunk is short if the video ended before its frame count, like the serial export
+        if(currentWriteIndex < std::min((chunk + 1)*chunkLength, videoLength)) {
+            qWarning() << "Video ended at frame" << currentWriteIndex << "of" << videoLength;
+            break;
+        }
+        chunk++;
+    }
+
+    abortChunks = true;
+    chunkMutex.lock();
+    chunkWritten.wakeAll();
+    chunkMutex.unlock();
+    for(size_t i = 0; i < chunkWorkers.size(); i++)
+        chunkWorkers[i].join();
+    chunks.clear();
+    bufferedBytes = 0;
+
+    // Export the rest in this thread if a chunk couldn't open or seek the video
+    if(resumeIndex >= 0 && !isStopping()) {
+        qWarning() << "Chunk of frame" << resumeIndex << "failed, exporting the rest serially";
+        abortChunks = false;
+        if(!magnifyChunk(resumeIndex, videoLength, preroll, stream, [this](const Mat &frame) { return writeFrame(frame); })
+           && !isStopping()) {
+            qWarning() << "Export failed at frame" << currentWriteIndex << "of" << videoLength;
+            failed = true;
+        }
+    }
+
+    QMutexLocker locker(&doStopMutex);
+    doStop = true;
+}
+
+// Worker of the parallel export, magnifies the next chunk till all are done
+void SavingThread::exportChunks(int window, int preroll)
+{
+    // Every worker is a stream of its own, so it waits for a core with at most 1 frame like
+    // a camera or video and the export can't take the turns of the live streams
+    const int workerStream = executor->addStream();
+    executor->setStreamFramerate(workerStream, streamFramerate);
+
+    while(!abortChunks) {
+        chunkMutex.lock();
+        while(nextChunk > writingChunk + window && !abortChunks)
+            chunkWritten.wait(&chunkMutex, 100);
+        int chunk = nextChunk++;
+        chunkMutex.unlock();
+        if(abortChunks || chunk >= nChunks)
+            break;
+
+        int first = chunk*chunkLength;
+        bool success = magnifyChunk(first, std::min(first + chunkLength, videoLength), preroll, workerStream,
+                                    [this, chunk](const Mat &frame) { return bufferFrame(chunk, frame); });
+
+        chunkMutex.lock();
+        chunks[chunk].finished = true;
+        chunks[chunk].failed = !success;
+        chunkReady.wakeAll();
+        chunkMutex.unlock();
+    }
+
+    executor->removeStream(workerStream);
+}
+
+// Hands a magnified frame of chunk to the writer. Chunks ahead of the written one wait
+// while the frames held exceed EXPORT_BUFFER_BYTES, the written one passes 1 at a time
+bool SavingThread::bufferFrame(int chunk, const Mat &frame)
+{
+    size_t bytes = frame.total()*frame.elemSize();
+    QMutexLocker locker(&chunkMutex);
+    while(!abortChunks && bufferedBytes + bytes > EXPORT_BUFFER_BYTES
+          && !(chunk == writingChunk && chunks[chunk].frames.empty()))
+        chunkWritten.wait(&chunkMutex, 100);
+    if(abortChunks)
+        return false;
+
+    chunks[chunk].frames.push_back(frame);
+    bufferedBytes += bytes;
+    chunkReady.wakeAll();
+    return true;
+}
+
+bool SavingThread::writeFrame(const Mat &frame)
+{
+    processingMutex.lock();
+    if(out.isOpened())
+        out.write(frame);
+    currentWriteIndex++;
+    processingMutex.unlock();
+
+    // Inform VideoView about saving progress
+    emit updateProgress(currentWriteIndex);
+    return !isStopping();
+}
+
+// Magnifies the output frames first to last-1 into output, starting preroll frames earlier.
+// Replicates the serial export, so output n of the chunk is output start+n of the serial one.
+// Returns false if the video couldn't be opened or output stopped the chunk, a video
+// shorter than its frame count ends the chunk early like the serial export
+bool SavingThread::magnifyChunk(int first, int last, int preroll, int chunkStream,
+                                const std::function<bool(const Mat &frame)> &output)
+{
+    int start = std::max(first - preroll, 0);
+    int api = videoApi(source);
+    VideoCapture chunkCap(source, api);
+    if(!chunkCap.isOpened())
+        return false;
+    // Backends that can't seek to the exact frame are read from the start
+    if(start > 0 && !(chunkCap.set(cv::CAP_PROP_POS_FRAMES, start)
+                      && (int)chunkCap.get(cv::CAP_PROP_POS_FRAMES) == start)) {
+        if(!chunkCap.open(source, api))
+            return false;
+        for(int i = 0; i < start; i++) {
+            if(abortChunks || !chunkCap.grab())
+                return false;
+        }
+    }
+
+    // Own buffers and filter state, flags and settings don't change while saving
+    ImageProcessingFlags flags = imgProcFlags;
+    ImageProcessingSettings settings = imgProcSettings;
+    std::vector<Mat> buffer;
+    std::vector<Mat> originals;
+    Magnificator chunkMagnificator(&buffer, &flags, &settings);
+    FramePool pool(FRAME_POOL_MAX_SIZE);
+    Mat grabbed, frame, magnified;
+
+    int readIndex = start;
+    for(int index = start; index < last; index++) {
+        if(abortChunks)
+            return false;
+        for(int i = buffer.size(); i < processingBufferLength && readIndex < videoLength; i++) {
+            if(!chunkCap.read(grabbed))
+                return true;
+            readIndex++;
+            frame = pool.copyRoi(grabbed, ROI);
+            if(flags.grayscaleOn && (frame.channels() == 3 || frame.channels() == 4)) {
+                cvtColor(frame, frame, cv::COLOR_BGR2GRAY, 1);
+            }
+            buffer.push_back(frame);
+            if(captureOriginal)
+                originals.push_back(frame);
+        }
+
+        executor->run(chunkStream, [&]() {
+            if(flags.laplaceMagnifyOn)
+                chunkMagnificator.laplaceMagnify();
+            else
+                chunkMagnificator.rieszMagnify();
+        });
+        magnified = chunkMagnificator.getFrameFirst();
+
+        // Frames before first are the pre-roll
+        if(captureOriginal) {
+            Mat original = originals.front();
+            originals.erase(originals.begin());
+            if(index >= first && !output(combineFrames(magnified, original)))
+                return false;
+        }
+        else if(index >= first && !output(magnified))
+            return false;
+    }
+
+    return true;
+}
+
+bool SavingThread::hasFailed()
+{
+    return failed;
+}
+
+bool SavingThread::isStopping()
+{
+    QMutexLocker locker(&doStopMutex);
+    return doStop;
+}
+
 bool SavingThread::isSaving()
 {
     QMutexLocker locker(&doStopMutex);
@@ -277,3 +586,21 @@ int SavingThread::getVideoCodec()
 
     return codec;
 }
+
+double SavingThread::getVideoFramerate()
+{
+    double framerate = 0;
+    if(cap.isOpened())
+        framerate = cap.get(cv::CAP_PROP_FPS);
+
+    return framerate;
+}
+
+QRect SavingThread::getVideoDimensions()
+{
+    QRect dimensions;
+    if(cap.isOpened())
+        dimensions = QRect(0, 0, cap.get(cv::CAP_PROP_FRAME_WIDTH), cap.get(cv::CAP_PROP_FRAME_HEIGHT));
+
+    return dimensions;
+}
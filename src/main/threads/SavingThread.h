@@ -28,10 +28,21 @@
 // Qt
 #include <QtCore/QThread>
 #include <QMutex>
+#include <QWaitCondition>
+// C++
+#include <atomic>
+#include <cmath>
+#include <deque>
+#include <functional>
+#include <map>
+#include <thread>
 // OpenCV
 #include <opencv2/highgui/highgui.hpp>
 // Local
+#include "main/helper/FramePool.h"
+#include "main/helper/MagnificationExecutor.h"
 #include "main/magnification/Magnificator.h"
+#include "main/other/Config.h"
 #include "main/other/Structures.h"
 
 using namespace cv;
@@ -40,7 +51,7 @@ class SavingThread : public QThread
 {
     Q_OBJECT
 public:
-    SavingThread();
+    SavingThread(MagnificationExecutor *executor);
     ~SavingThread();
     void stop();
     bool loadFile(std::string source);
@@ -49,10 +60,23 @@ public:
     bool isSaving();
     int getVideoLength();
     int getVideoCodec();
+    double getVideoFramerate();
+    QRect getVideoDimensions();
+    // Export Laplace and Riesz magnification in chunks on several workers. Each chunk
+    // is magnified from at least preroll frames before its start, so the temporal filters
+    // converge until the output differs from a serial export by less than tolerance
+    // gray values. workers <= 0 uses all cores of the executor, 1 exports serially.
+    void setParallelExport(int workers, int preroll, double tolerance);
+    // True if the last export couldn't magnify every frame of the video
+    bool hasFailed();
     int savingCodec;
 
 private:
     // Thread
+    MagnificationExecutor *executor;
+    int stream;
+    // Frame rate of stream, each worker of the parallel export has a stream of its own
+    double streamFramerate;
     bool doStop;
     QMutex doStopMutex;
     QMutex processingMutex;
@@ -60,12 +84,14 @@ private:
     void resetSaver();
     // Capture
     VideoCapture cap;
+    std::string source;
     int videoLength;
     std::vector<Mat> processingBuffer;
     std::vector<Mat> originalBuffer;
     int processingBufferLength;
     Rect ROI;
     Mat grabbedFrame;
+    FramePool roiPool;
     Mat currentFrame;
     bool processingBufferFilled();
     // Write
@@ -77,6 +103,36 @@ private:
     int currentWriteIndex;
     int getCurrentReadIndex();
     Mat combineFrames(Mat &frame1, Mat &frame2);
+    // Parallel export
+    int exportWorkers;
+    int exportPreroll;
+    double exportTolerance;
+    struct ExportChunk {
+        ExportChunk() : finished(false), failed(false) {}
+        std::deque<Mat> frames;     // Magnified, but not written yet
+        bool finished;
+        bool failed;
+    };
+    int prerollFrames();
+    void runParallel(int preroll);
+    void exportChunks(int window, int preroll);
+    // Magnifies frames first to last with the executor stream chunkStream
+    bool magnifyChunk(int first, int last, int preroll, int chunkStream,
+                      const std::function<bool(const Mat &frame)> &output);
+    bool bufferFrame(int chunk, const Mat &frame);
+    bool writeFrame(const Mat &frame);
+    bool isStopping();
+    QMutex chunkMutex;
+    QWaitCondition chunkReady;
+    QWaitCondition chunkWritten;
+    std::map<int, ExportChunk> chunks;
+    size_t bufferedBytes;
+    std::atomic<bool> abortChunks;
+    std::atomic<bool> failed;
+    int chunkLength;
+    int nChunks;
+    int nextChunk;
+    int writingChunk;
     // Magnify
     Magnificator magnificator;
     ImageProcessingFlags imgProcFlags;
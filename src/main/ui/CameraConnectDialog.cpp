@@ -64,6 +64,7 @@ CameraConnectDialog::CameraConnectDialog(QWidget *parent) :
     connect(ui->fileGroupBox, SIGNAL(clicked(bool)),SLOT(toggleCameraGroupBox(bool)));
     connect(ui->cameraGroupBox, SIGNAL(clicked(bool)),SLOT(toggleFileGroupBox(bool)));
     connect(ui->openButton, SIGNAL(released()), SLOT(openButton_clicked()));
+    connect(ui->dropFrameCheckBox, SIGNAL(toggled(bool)), ui->dropOldestFrameCheckBox, SLOT(setEnabled(bool)));
 }
 
 CameraConnectDialog::~CameraConnectDialog()
@@ -152,6 +153,18 @@ bool CameraConnectDialog::getDropFrameCheckBoxState()
     return ui->dropFrameCheckBox->isChecked();
 }
 
+bool CameraConnectDialog::getDropOldestFrameCheckBoxState()
+{
+    return ui->dropOldestFrameCheckBox->isChecked();
+}
+
+BufferFullPolicy CameraConnectDialog::getBufferFullPolicy()
+{
+    if(!getDropFrameCheckBoxState())
+        return BlockIfFull;
+    return getDropOldestFrameCheckBoxState() ? DropOldestIfFull : DropNewestIfFull;
+}
+
 int CameraConnectDialog::getCaptureThreadPrio()
 {
     return ui->capturePrioComboBox->currentIndex();
@@ -183,6 +196,8 @@ void CameraConnectDialog::resetToDefaults()
     ui->imageBufferSizeEdit->setText(QString::number(DEFAULT_IMAGE_BUFFER_SIZE));
     // Drop frames
     ui->dropFrameCheckBox->setChecked(DEFAULT_DROP_FRAMES);
+    ui->dropOldestFrameCheckBox->setChecked(DEFAULT_DROP_OLDEST_FRAMES);
+    ui->dropOldestFrameCheckBox->setEnabled(DEFAULT_DROP_FRAMES);
     // Capture thread
     if(DEFAULT_CAP_THREAD_PRIO==QThread::IdlePriority)
         ui->capturePrioComboBox->setCurrentIndex(0);
@@ -33,6 +33,7 @@
 #include <QDebug>
 // Local
 #include "main/other/Config.h"
+#include "main/other/Buffer.h"
 // OpenCV
 #include <opencv2/highgui/highgui.hpp>
 
@@ -55,6 +56,8 @@ class CameraConnectDialog : public QDialog
         int getFpsNumber();
         int getImageBufferSize();
         bool getDropFrameCheckBoxState();
+        bool getDropOldestFrameCheckBoxState();
+        BufferFullPolicy getBufferFullPolicy();
         bool getPgDevCheckBoxState();
         int getCaptureThreadPrio();
         int getProcessingThreadPrio();
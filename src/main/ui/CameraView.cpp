@@ -25,10 +25,11 @@
 #include "main/ui/CameraView.h"
 #include "ui_CameraView.h"
 
-CameraView::CameraView(QWidget *parent, int deviceNumber, SharedImageBuffer *sharedImageBuffer) :
+CameraView::CameraView(QWidget *parent, int deviceNumber, SharedImageBuffer *sharedImageBuffer, MagnificationExecutor *executor) :
     QWidget(parent),
     ui(new Ui::CameraView),
     sharedImageBuffer(sharedImageBuffer),
+    executor(executor),
     codec(-1)
 {
     // Setup UI
@@ -98,18 +99,18 @@ CameraView::~CameraView()
     delete ui;
 }
 
-bool CameraView::connectToCamera(bool dropFrameIfBufferFull, int capThreadPrio, int procThreadPrio,
+bool CameraView::connectToCamera(BufferFullPolicy bufferFullPolicy, int capThreadPrio, int procThreadPrio,
                                  int width, int height, int fps)
 {
     ui->frameLabel->setText(tr("Connecting to camera..."));
 
     // Create capture thread
-    captureThread = new CaptureThread(sharedImageBuffer, deviceNumber, dropFrameIfBufferFull, width, height, fps);
+    captureThread = new CaptureThread(sharedImageBuffer, deviceNumber, bufferFullPolicy, width, height, fps);
     // Attempt to connect to camera
     if(captureThread->connectToCamera())
     {
         // Create processing thread
-        processingThread = new ProcessingThread(sharedImageBuffer, deviceNumber);
+        processingThread = new ProcessingThread(sharedImageBuffer, executor, deviceNumber);
 
         // Create MagnifyOptions tab and set current
         this->magnifyOptionsTab = new MagnifyOptions(this);
@@ -119,8 +120,11 @@ bool CameraView::connectToCamera(bool dropFrameIfBufferFull, int capThreadPrio,
 
         // Setup signal/slot connections
         connect(ui->tabWidget, SIGNAL(currentChanged(int)), this, SLOT(handleTabChange(int)));
-        connect(processingThread, SIGNAL(newFrame(QImage)), this, SLOT(updateFrame(QImage)));
-        connect(processingThread, SIGNAL(origFrame(QImage)), this, SLOT(updateOriginalFrame(QImage)));
+        processingThread->setDisplayMailboxes(ui->frameLabel->mailbox(), originalFrame->mailbox());
+        connect(ui->frameLabel, SIGNAL(resized(QSize)), processingThread, SLOT(setDisplaySize(QSize)));
+        connect(originalFrame, SIGNAL(resized(QSize)), processingThread, SLOT(setOriginalDisplaySize(QSize)));
+        processingThread->setDisplaySize(ui->frameLabel->size());
+        processingThread->setOriginalDisplaySize(originalFrame->size());
         connect(processingThread, SIGNAL(updateStatisticsInGUI(struct ThreadStatisticsData)), this, SLOT(updateProcessingThreadStats(struct ThreadStatisticsData)));
         connect(captureThread, SIGNAL(updateStatisticsInGUI(struct ThreadStatisticsData)), this, SLOT(updateCaptureThreadStats(struct ThreadStatisticsData)));
         connect(captureThread, SIGNAL(updateFramerate(double)), processingThread, SLOT(updateFramerate(double)));
@@ -130,6 +134,11 @@ bool CameraView::connectToCamera(bool dropFrameIfBufferFull, int capThreadPrio,
         connect(ui->recordButton, SIGNAL(released()),this, SLOT(record()));
         connect(ui->recordPathButton, SIGNAL(released()),this,SLOT(selectButton_action()));
         connect(processingThread, SIGNAL(frameWritten(int)), this, SLOT(frameWritten(int)));
+        // Percentiles of the profiler take too long to update them every frame
+        profilerTimer = new QTimer(this);
+        profilerTimer->setInterval(PROFILER_SUMMARY_INTERVAL);
+        connect(profilerTimer, SIGNAL(timeout()), this, SLOT(updateProfilerSummary()));
+        profilerTimer->start();
 
         // Setup signal/slot connections for MagnifyOptions
         connect(magnifyOptionsTab, SIGNAL(newImageProcessingFlags(struct ImageProcessingFlags)), processingThread, SLOT(updateImageProcessingFlags(struct ImageProcessingFlags)));
@@ -196,33 +205,34 @@ void CameraView::updateCaptureThreadStats(struct ThreadStatisticsData statData)
 
     // Show processing rate in captureRateLabel
     ui->captureRateLabel->setText(QString::number(statData.averageFPS)+" fps");
-    // Show number of frames captured in nFramesCapturedLabel
-    ui->nFramesCapturedLabel->setText(QString("[") + QString::number(statData.nFramesProcessed) + QString("]"));
+    // Show number of frames captured and dropped in nFramesCapturedLabel
+    ui->nFramesCapturedLabel->setText(QString("[") + QString::number(statData.nFramesProcessed) + QString("] ") +
+                                      QString::number(statData.nFramesDropped) + tr(" dropped"));
 }
 
 void CameraView::updateProcessingThreadStats(struct ThreadStatisticsData statData)
 {
-    // Show processing rate in processingRateLabel
-    ui->processingRateLabel->setText(QString::number(statData.averageFPS)+" fps");
+    // Show processing rate and latency of the pipeline stages (prepare/decompose/magnify/output) in processingRateLabel
+    ui->processingRateLabel->setText(QString::number(statData.averageFPS)+" fps ("+
+                                     QString::number(statData.prepareLatency, 'f', 1)+"/"+
+                                     QString::number(statData.decomposeLatency, 'f', 1)+"/"+
+                                     QString::number(statData.magnifyLatency, 'f', 1)+"/"+
+                                     QString::number(statData.outputLatency, 'f', 1)+" ms)");
     // Show ROI information in roiLabel
     ui->roiLabel->setText(QString("(")+QString::number(processingThread->getCurrentROI().x())+QString(",")+
                           QString::number(processingThread->getCurrentROI().y())+QString(") ")+
                           QString::number(processingThread->getCurrentROI().width())+
-                          QString("x")+QString::number(processingThread->getCurrentROI().height()));
+                          QString("x")+QString::number(processingThread->getCurrentROI().height())+
+                          QString(", ")+QString::number(statData.bytesCopiedPerFrame/1024.0, 'f', 1)+tr(" KB copied/frame"));
     // Show number of frames processed in nFramesProcessedLabel
     ui->nFramesProcessedLabel->setText(QString("[") + QString::number(statData.nFramesProcessed) + QString("]"));
 }
 
-void CameraView::updateFrame(const QImage &frame)
+// Percentiles of every stage and queue in the tooltip of processingRateLabel
+void CameraView::updateProfilerSummary()
 {
-    // Display frame
-    ui->frameLabel->setPixmap(QPixmap::fromImage(frame).scaled(ui->frameLabel->width(), ui->frameLabel->height(),Qt::KeepAspectRatio));
-}
-
-void CameraView::updateOriginalFrame(const QImage &frame)
-{
-    // Display frame
-    originalFrame->setPixmap(QPixmap::fromImage(frame).scaled(ui->frameLabel->width(), ui->frameLabel->height(),Qt::KeepAspectRatio));
+    if(ui->processingRateLabel->isVisible())
+        ui->processingRateLabel->setToolTip(processingThread->getProfiler()->summary());
 }
 
 void CameraView::handleOriginalWindow(bool doEmit)
@@ -247,13 +257,13 @@ void CameraView::updateMouseCursorPosLabel()
                                      QString(")"));
 
     // Show pixel cursor position if camera is connected (image is being shown)
-    if(ui->frameLabel->pixmap()!=0)
+    if(ui->frameLabel->image()!=0)
     {
         // Scaling factor calculation depends on whether frame is scaled to fit label or not
         if(!ui->frameLabel->hasScaledContents())
         {
-            double xScalingFactor=((double) ui->frameLabel->getMouseCursorPos().x() - ((ui->frameLabel->width() - ui->frameLabel->pixmap()->width()) / 2)) / (double) ui->frameLabel->pixmap()->width();
-            double yScalingFactor=((double) ui->frameLabel->getMouseCursorPos().y() - ((ui->frameLabel->height() - ui->frameLabel->pixmap()->height()) / 2)) / (double) ui->frameLabel->pixmap()->height();
+            double xScalingFactor=((double) ui->frameLabel->getMouseCursorPos().x() - ((ui->frameLabel->width() - ui->frameLabel->image()->width()) / 2)) / (double) ui->frameLabel->image()->width();
+            double yScalingFactor=((double) ui->frameLabel->getMouseCursorPos().y() - ((ui->frameLabel->height() - ui->frameLabel->image()->height()) / 2)) / (double) ui->frameLabel->image()->height();
 
             ui->mouseCursorPosLabel->setText(ui->mouseCursorPosLabel->text()+
                                              QString(" [")+QString::number((int)(xScalingFactor*processingThread->getCurrentROI().width()))+
@@ -290,10 +300,10 @@ void CameraView::newMouseData(struct MouseData mouseData)
         // Selection box calculation depends on whether frame is scaled to fit label or not
         if(!ui->frameLabel->hasScaledContents())
         {
-            xScalingFactor=((double) mouseData.selectionBox.x() - ((ui->frameLabel->width() - ui->frameLabel->pixmap()->width()) / 2)) / (double) ui->frameLabel->pixmap()->width();
-            yScalingFactor=((double) mouseData.selectionBox.y() - ((ui->frameLabel->height() - ui->frameLabel->pixmap()->height()) / 2)) / (double) ui->frameLabel->pixmap()->height();
-            wScalingFactor=(double) processingThread->getCurrentROI().width() / (double) ui->frameLabel->pixmap()->width();
-            hScalingFactor=(double) processingThread->getCurrentROI().height() / (double) ui->frameLabel->pixmap()->height();
+            xScalingFactor=((double) mouseData.selectionBox.x() - ((ui->frameLabel->width() - ui->frameLabel->image()->width()) / 2)) / (double) ui->frameLabel->image()->width();
+            yScalingFactor=((double) mouseData.selectionBox.y() - ((ui->frameLabel->height() - ui->frameLabel->image()->height()) / 2)) / (double) ui->frameLabel->image()->height();
+            wScalingFactor=(double) processingThread->getCurrentROI().width() / (double) ui->frameLabel->image()->width();
+            hScalingFactor=(double) processingThread->getCurrentROI().height() / (double) ui->frameLabel->image()->height();
         }
         else
         {
@@ -353,13 +363,13 @@ void CameraView::updateMouseCursorPosLabelOriginalFrame()
                                      QString(")"));
 
     // Show pixel cursor position if camera is connected (image is being shown)
-    if(originalFrame->pixmap()!=0)
+    if(originalFrame->image()!=0)
     {
         // Scaling factor calculation depends on whether frame is scaled to fit label or not
         if(!originalFrame->hasScaledContents())
         {
-            double xScalingFactor=((double) originalFrame->getMouseCursorPos().x() - ((originalFrame->width() - originalFrame->pixmap()->width()) / 2)) / (double) originalFrame->pixmap()->width();
-            double yScalingFactor=((double) originalFrame->getMouseCursorPos().y() - ((originalFrame->height() - originalFrame->pixmap()->height()) / 2)) / (double) originalFrame->pixmap()->height();
+            double xScalingFactor=((double) originalFrame->getMouseCursorPos().x() - ((originalFrame->width() - originalFrame->image()->width()) / 2)) / (double) originalFrame->image()->width();
+            double yScalingFactor=((double) originalFrame->getMouseCursorPos().y() - ((originalFrame->height() - originalFrame->image()->height()) / 2)) / (double) originalFrame->image()->height();
 
             ui->mouseCursorPosLabel->setText(ui->mouseCursorPosLabel->text()+
                                              QString(" [")+QString::number((int)(xScalingFactor*processingThread->getCurrentROI().width()))+
@@ -396,10 +406,10 @@ void CameraView::newMouseDataOriginalFrame(struct MouseData mouseData)
         // Selection box calculation depends on whether frame is scaled to fit label or not
         if(!originalFrame->hasScaledContents())
         {
-            xScalingFactor=((double) mouseData.selectionBox.x() - ((originalFrame->width() - originalFrame->pixmap()->width()) / 2)) / (double) originalFrame->pixmap()->width();
-            yScalingFactor=((double) mouseData.selectionBox.y() - ((originalFrame->height() - originalFrame->pixmap()->height()) / 2)) / (double) originalFrame->pixmap()->height();
-            wScalingFactor=(double) processingThread->getCurrentROI().width() / (double) originalFrame->pixmap()->width();
-            hScalingFactor=(double) processingThread->getCurrentROI().height() / (double) originalFrame->pixmap()->height();
+            xScalingFactor=((double) mouseData.selectionBox.x() - ((originalFrame->width() - originalFrame->image()->width()) / 2)) / (double) originalFrame->image()->width();
+            yScalingFactor=((double) mouseData.selectionBox.y() - ((originalFrame->height() - originalFrame->image()->height()) / 2)) / (double) originalFrame->image()->height();
+            wScalingFactor=(double) processingThread->getCurrentROI().width() / (double) originalFrame->image()->width();
+            hScalingFactor=(double) processingThread->getCurrentROI().height() / (double) originalFrame->image()->height();
         }
         else
         {
@@ -474,6 +484,26 @@ void CameraView::handleContextMenuAction(QAction *action)
     }
     else if(action->text()=="Show Original Frame")
         handleOriginalWindow(action->isChecked());
+    else if(action->text()=="Save Profile as JSON...")
+        saveProfile(false);
+    else if(action->text()=="Save Profile as Chrome Trace...")
+        saveProfile(true);
+}
+
+// Write the profile of the magnification as JSON statistics or Chrome trace
+void CameraView::saveProfile(bool chromeTrace)
+{
+    QString fileName = QFileDialog::getSaveFileName(this,
+                                                    chromeTrace ? tr("Save Chrome Trace") : tr("Save Profile"),
+                                                    ".",
+                                                    tr("JSON File (*.json)"));
+    if(fileName.isEmpty())
+        return;
+    Profiler *profiler = processingThread->getProfiler();
+    QFile file(fileName);
+    const QByteArray json = chromeTrace ? profiler->toChromeTrace() : profiler->toJson();
+    if(!file.open(QIODevice::WriteOnly) || file.write(json) != json.size())
+        QMessageBox::warning(this->parentWidget(), tr("WARNING:"), tr("Not able to write ")+fileName);
 }
 
 // Hide the lower Tab (Setting and Streaminfo)
@@ -29,11 +29,13 @@
 #include <QDebug>
 #include <QFileDialog>
 #include <QMessageBox>
+#include <QTimer>
 // Local
 #include "main/threads/CaptureThread.h"
 #include "main/threads/ProcessingThread.h"
 #include "main/other/Structures.h"
 #include "main/helper/SharedImageBuffer.h"
+#include "main/helper/MagnificationExecutor.h"
 #include "main/ui/MagnifyOptions.h"
 #include "main/ui/FrameLabel.h"
 
@@ -46,9 +48,9 @@ class CameraView : public QWidget
     Q_OBJECT
 
     public:
-        explicit CameraView(QWidget *parent, int deviceNumber, SharedImageBuffer *sharedImageBuffer);
+        explicit CameraView(QWidget *parent, int deviceNumber, SharedImageBuffer *sharedImageBuffer, MagnificationExecutor *executor);
         ~CameraView();
-        bool connectToCamera(bool dropFrame, int capThreadPrio, int procThreadPrio, int width, int height, int fps);
+        bool connectToCamera(BufferFullPolicy bufferFullPolicy, int capThreadPrio, int procThreadPrio, int width, int height, int fps);
         void setCodec(int codec);
 
     private:
@@ -56,6 +58,7 @@ class CameraView : public QWidget
         ProcessingThread *processingThread;
         CaptureThread *captureThread;
         SharedImageBuffer *sharedImageBuffer;
+        MagnificationExecutor *executor;
         ImageProcessingFlags imageProcessingFlags;
         void stopCaptureThread();
         void stopProcessingThread();
@@ -63,8 +66,10 @@ class CameraView : public QWidget
         bool isCameraConnected;
         MagnifyOptions *magnifyOptionsTab;
         FrameLabel *originalFrame;
+        QTimer *profilerTimer;
         void handleOriginalWindow(bool doEmit);
         QString getFormattedTime(int timeInMSeconds);
+        void saveProfile(bool chromeTrace);
         int codec;
 
     public slots:
@@ -76,9 +81,8 @@ class CameraView : public QWidget
         void frameWritten(int frames);
 
     private slots:
-        void updateFrame(const QImage &frame);
-        void updateOriginalFrame(const QImage &frame);
         void updateProcessingThreadStats(struct ThreadStatisticsData statData);
+        void updateProfilerSummary();
         void updateCaptureThreadStats(struct ThreadStatisticsData statData);
         void handleContextMenuAction(QAction *action);
         void hideSettings();
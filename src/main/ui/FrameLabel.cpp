@@ -23,6 +23,11 @@
 /************************************************************************************/
 
 #include "main/ui/FrameLabel.h"
+// Qt
+#include <QGuiApplication>
+#include <QScreen>
+// Local
+#include "main/other/Config.h"
 
 FrameLabel::FrameLabel(QWidget *parent) : QLabel(parent)
 {
@@ -34,6 +39,16 @@ FrameLabel::FrameLabel(QWidget *parent) : QLabel(parent)
     mouseData.leftButtonRelease=false;
     mouseData.rightButtonRelease=false;
     createContextMenu();
+
+    // Pull frames once per screen refresh, independent of the source framerate
+    qreal refreshRate = DISPLAY_DEFAULT_REFRESH_RATE;
+    if(QGuiApplication::primaryScreen() && QGuiApplication::primaryScreen()->refreshRate() > 0)
+        refreshRate = QGuiApplication::primaryScreen()->refreshRate();
+    refreshTimer = new QTimer(this);
+    refreshTimer->setTimerType(Qt::PreciseTimer);
+    refreshTimer->setInterval(qMax(1, qRound(1000.0/refreshRate)));
+    connect(refreshTimer, SIGNAL(timeout()), this, SLOT(refresh()));
+    refreshTimer->start();
 }
 
 FrameLabel::~FrameLabel()
@@ -118,10 +133,51 @@ void FrameLabel::mousePressEvent(QMouseEvent *ev)
     }
 }
 
+void FrameLabel::setImage(const QImage &image)
+{
+    // A text like "Connecting to camera..." is replaced by the frames
+    if(!text().isEmpty())
+        clear();
+    frame = image;
+    update();
+}
+
+const QImage *FrameLabel::image()
+{
+    return frame.isNull() ? 0 : &frame;
+}
+
+DisplayMailbox *FrameLabel::mailbox()
+{
+    return &displayMailbox;
+}
+
+void FrameLabel::refresh()
+{
+    // Repaint only if a thread posted a frame since the last refresh
+    QImage image;
+    if(displayMailbox.take(image))
+        setImage(image);
+}
+
+void FrameLabel::resizeEvent(QResizeEvent *ev)
+{
+    QLabel::resizeEvent(ev);
+    emit resized(size());
+}
+
 void FrameLabel::paintEvent(QPaintEvent *ev)
 {
     QLabel::paintEvent(ev);
     QPainter painter(this);
+    // Draw frame, only a text set after the last frame is shown instead
+    if(!frame.isNull() && text().isEmpty())
+    {
+        if(hasScaledContents())
+            painter.drawImage(rect(), frame);
+        else
+            painter.drawImage((width()-frame.width())/2, (height()-frame.height())/2, frame);
+    }
     // Draw box
     if(drawBox)
     {
@@ -152,4 +208,12 @@ void FrameLabel::createContextMenu()
     menu->addAction(action);
 
     menu->addSeparator();
+
+    action = new QAction(this);
+    action->setText(tr("Save Profile as JSON..."));
+    menu->addAction(action);
+
+    action = new QAction(this);
+    action->setText(tr("Save Profile as Chrome Trace..."));
+    menu->addAction(action);
 }
@@ -29,12 +29,16 @@
 #include <QtCore/QObject>
 #include <QtCore/QPoint>
 #include <QtCore/QRect>
+#include <QtCore/QSize>
+#include <QtCore/QTimer>
+#include <QtGui/QImage>
 #include <QLabel>
 #include <QMenu>
 #include <QtGui/QPainter>
 #include <QtGui/QMouseEvent>
 // Local
 #include "main/other/Structures.h"
+#include "main/helper/DisplayMailbox.h"
 
 class FrameLabel : public QLabel
 {
@@ -45,6 +49,14 @@ class FrameLabel : public QLabel
         ~FrameLabel();
         void setMouseCursorPos(QPoint);
         QPoint getMouseCursorPos();
+        // Shows image centered and unscaled (stretched with scaled contents). The
+        // threads scale frames to the size of the label, see resized()
+        void setImage(const QImage &image);
+        // Shown image, 0 if there is none
+        const QImage *image();
+        // Threads post their frames here, the label shows the newest one at
+        // the refresh rate of the screen
+        DisplayMailbox *mailbox();
         QMenu *menu;
 
     private:
@@ -54,16 +66,24 @@ class FrameLabel : public QLabel
         QPoint mouseCursorPos;
         bool drawBox;
         QRect *box;
+        QImage frame;
+        DisplayMailbox displayMailbox;
+        QTimer *refreshTimer;
 
     protected:
         void mouseMoveEvent(QMouseEvent *ev);
         void mousePressEvent(QMouseEvent *ev);
         void mouseReleaseEvent(QMouseEvent *ev);
         void paintEvent(QPaintEvent *ev);
+        void resizeEvent(QResizeEvent *ev);
+
+    private slots:
+        void refresh();
 
     signals:
         void newMouseData(struct MouseData mouseData);
         void onMouseMoveEvent();
+        void resized(QSize size);
 };
 
 #endif // FRAMELABEL_H
@@ -56,13 +56,18 @@ MainWindow::MainWindow(QWidget *parent) :
     connect(ui->actionConnect_Open, SIGNAL(triggered()), this, SLOT(connectToCamera()));
     // Create SharedImageBuffer object
     sharedImageBuffer = new SharedImageBuffer();
+    // Create the executor all views magnify with
+    executor = new MagnificationExecutor(DEFAULT_MAGNIFICATION_CORES);
 
     addCodecs();
+    addCoreMenu();
 }
 
 MainWindow::~MainWindow()
 {
     delete ui;
+    // Views are deleted with ui, no stream uses the executor anymore
+    delete executor;
 }
 
 void MainWindow::connectToCamera()
@@ -84,9 +89,9 @@ void MainWindow::connectToCamera()
                 // Add created ImageBuffer to SharedImageBuffer object
                 sharedImageBuffer->add(deviceNumber, imageBuffer);
                 // Create CameraView
-                cameraViewMap[deviceNumber] = new CameraView(ui->tabWidget, deviceNumber, sharedImageBuffer);
+                cameraViewMap[deviceNumber] = new CameraView(ui->tabWidget, deviceNumber, sharedImageBuffer, executor);
                 // Attempt to connect to camera
-                if(cameraViewMap[deviceNumber]->connectToCamera(cameraConnectDialog->getDropFrameCheckBoxState(),
+                if(cameraViewMap[deviceNumber]->connectToCamera(cameraConnectDialog->getBufferFullPolicy(),
                                                cameraConnectDialog->getCaptureThreadPrio(),
                                                cameraConnectDialog->getProcessingThreadPrio(),
                                                cameraConnectDialog->getResolutionWidth(),
@@ -143,7 +148,7 @@ void MainWindow::connectToCamera()
             QString filename = file.fileName();
             if(file.exists()){
                 // Create new Videofile entry in QMap
-                videoViewMap[filename] = new VideoView(ui->tabWidget,filepath);
+                videoViewMap[filename] = new VideoView(ui->tabWidget,filepath,executor);
                 // Attemp to load the video
                 if(videoViewMap[filename]->loadVideo(cameraConnectDialog->getPlayerThreadPrio(),
                                                      cameraConnectDialog->getResolutionWidth(),
@@ -408,6 +413,36 @@ void MainWindow::addCodecs()
     ui->menuFile->insertMenu(ui->actionQuit,codecMenu);
 }
 
+void MainWindow::addCoreMenu()
+{
+    QMenu *coreMenu;
+    QActionGroup *coreGroup;
+    QAction *coreAction;
+
+    //Set up Menu and action group
+    coreMenu = new QMenu(tr("Magnification Cores"), ui->menuFile);
+    coreGroup = new QActionGroup(this);
+    coreGroup->setExclusive(true);
+
+    //Add 1 action per core, the data is the number of cores
+    for(int cores = 1; cores <= qMax(QThread::idealThreadCount(), 1); cores++) {
+        coreAction = coreMenu->addAction(QString::number(cores));
+        coreAction->setData(cores);
+        coreAction->setCheckable(true);
+        coreAction->setChecked(cores == executor->cores());
+        coreGroup->addAction(coreAction);
+    }
+
+    //Connect and add to MenuBar
+    connect(coreMenu, SIGNAL(triggered(QAction*)), this, SLOT(setCores(QAction*)));
+    ui->menuFile->insertMenu(ui->actionQuit,coreMenu);
+}
+
+void MainWindow::setCores(QAction *action)
+{
+    executor->setCores(action->data().toInt());
+}
+
 void MainWindow::setCodec(QAction *action)
 {
     QString name = action->text();
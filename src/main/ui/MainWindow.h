@@ -38,6 +38,7 @@
 #include "main/ui/VideoView.h"
 #include "main/other/Buffer.h"
 #include "main/helper/SharedImageBuffer.h"
+#include "main/helper/MagnificationExecutor.h"
 
 namespace Ui {
     class MainWindow;
@@ -60,12 +61,14 @@ class MainWindow : public QMainWindow
         QMap<QString, int> fileNumberMap;
         QMap<QString, VideoView*> videoViewMap;
         SharedImageBuffer *sharedImageBuffer;
+        MagnificationExecutor *executor;
         bool removeFromMapByTabIndex(QMap<int, int>& map, int tabIndex);
         void updateMapValues(QMap<int, int>& map, int tabIndex);
         bool removeFromMapByTabIndex(QMap<QString, int>& map, int tabIndex);
         void updateMapValues(QMap<QString, int>& map, int tabIndex);
         void setTabCloseToolTips(QTabWidget *tabs, QString tooltip);
         void addCodecs();
+        void addCoreMenu();
         //Codecs
         int saveCodec;
         bool useVideoCodec;
@@ -78,6 +81,7 @@ class MainWindow : public QMainWindow
         void showHelpDialog();
         void setFullScreen(bool);
         void setCodec(QAction* action);
+        void setCores(QAction* action);
 };
 
 #endif // MAINWINDOW_H
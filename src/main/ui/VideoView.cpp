@@ -25,9 +25,10 @@
 #include "main/ui/VideoView.h"
 #include "ui_VideoView.h"
 
-VideoView::VideoView(QWidget *parent, QString filepath) :
+VideoView::VideoView(QWidget *parent, QString filepath, MagnificationExecutor *executor) :
     QWidget(parent),
     ui(new Ui::VideoView),
+    executor(executor),
     codec(-1),
     useVideoCodec(true)
 {
@@ -98,7 +99,7 @@ bool VideoView::loadVideo(int threadPrio, int width, int height, double fps)
     QString filepath = file.absoluteFilePath();
     std::string stringFilepath= filepath.toStdString();
     // create player thread
-    playerThread = new PlayerThread(stringFilepath, width, height, fps);
+    playerThread = new PlayerThread(stringFilepath, executor, width, height, fps);
 
     if(playerThread->loadFile())
     {
@@ -124,17 +125,25 @@ bool VideoView::loadVideo(int threadPrio, int width, int height, double fps)
         // Setup signal/slot for PlayerThread
         connect(playerThread, SIGNAL(endOfFrame()), this, SLOT(endOfFrame_action()));
         connect(playerThread, SIGNAL(updateStatisticsInGUI(struct ThreadStatisticsData)), this, SLOT(updatePlayerThreadStats(struct ThreadStatisticsData)));
+        // Percentiles of the profiler take too long to update them every frame
+        profilerTimer = new QTimer(this);
+        profilerTimer->setInterval(PROFILER_SUMMARY_INTERVAL);
+        connect(profilerTimer, SIGNAL(timeout()), this, SLOT(updateProfilerSummary()));
+        profilerTimer->start();
         connect(ui->PlayButton, SIGNAL(clicked()), this, SLOT(play()));
         connect(ui->StopButton, SIGNAL(clicked()), this, SLOT(stop()));
         connect(ui->TimeSlider, SIGNAL(sliderPressed()), playerThread, SLOT(pauseThread()));
         connect(ui->TimeSlider, SIGNAL(sliderReleased()), this, SLOT(setTime()));
 
-        // Connect frames emitting
-        connect(playerThread, SIGNAL(newFrame(QImage)), this, SLOT(updateFrame(QImage)));
-        connect(playerThread, SIGNAL(origFrame(QImage)), this, SLOT(updateOriginalFrame(QImage)));
+        // Frames are posted to the labels, which show the newest one per screen refresh
+        playerThread->setDisplayMailboxes(ui->frameLabel->mailbox(), originalFrame->mailbox());
+        connect(ui->frameLabel, SIGNAL(resized(QSize)), playerThread, SLOT(setDisplaySize(QSize)));
+        connect(originalFrame, SIGNAL(resized(QSize)), playerThread, SLOT(setOriginalDisplaySize(QSize)));
+        playerThread->setDisplaySize(ui->frameLabel->size());
+        playerThread->setOriginalDisplaySize(originalFrame->size());
 
         // Create the SavingThread and connect buttons to it's meant functions
-        vidSaver = new SavingThread();
+        vidSaver = new SavingThread(executor);
         connect(ui->saveButton, SIGNAL(clicked()), this, SLOT(save_action()));
         connect(vidSaver, SIGNAL(updateProgress(int)), this, SLOT(updateProgressBar(int)));
         connect(vidSaver, SIGNAL(endOfSaving()), this, SLOT(endOfSaving_action()));
@@ -162,12 +171,6 @@ bool VideoView::loadVideo(int threadPrio, int width, int height, double fps)
         return false;
 }
 
-void VideoView::updateOriginalFrame(const QImage &frame)
-{
-    // Display frame
-    originalFrame->setPixmap(QPixmap::fromImage(frame).scaled(ui->frameLabel->width(), ui->frameLabel->height(),Qt::KeepAspectRatio));
-}
-
 QString VideoView::getFormattedTime(int timeInSeconds){
 
     int seconds = (int) (timeInSeconds) % 60 ;
@@ -212,15 +215,15 @@ void VideoView::updatePlayerThreadStats(struct ThreadStatisticsData statData)
     ui->roiLabel->setText(QString("(")+QString::number(playerThread->getCurrentROI().x())+QString(",")+
                           QString::number(playerThread->getCurrentROI().y())+QString(") ")+
                           QString::number(playerThread->getCurrentROI().width())+
-                          QString("x")+QString::number(playerThread->getCurrentROI().height()));
+                          QString("x")+QString::number(playerThread->getCurrentROI().height())+
+                          QString(", ")+QString::number(statData.bytesCopiedPerFrame/1024.0, 'f', 1)+tr(" KB copied/frame"));
 }
 
-void VideoView::updateFrame(const QImage &frame)
+// Percentiles of every stage in the tooltip of processingRateLabel
+void VideoView::updateProfilerSummary()
 {
-    int w =ui->frameLabel->width();
-    int h = ui->frameLabel->height();
-    // Display frame
-    ui->frameLabel->setPixmap(QPixmap::fromImage(frame).scaled(w, h, Qt::KeepAspectRatio));
+    if(ui->processingRateLabel->isVisible())
+        ui->processingRateLabel->setToolTip(playerThread->getProfiler()->summary());
 }
 
 void VideoView::updateMouseCursorPosLabel()
@@ -231,13 +234,13 @@ void VideoView::updateMouseCursorPosLabel()
                                      QString(")"));
 
     // Show pixel cursor position if camera is connected (image is being shown)
-    if(ui->frameLabel->pixmap()!=0)
+    if(ui->frameLabel->image()!=0)
     {
         // Scaling factor calculation depends on whether frame is scaled to fit label or not
         if(!ui->frameLabel->hasScaledContents())
         {
-            double xScalingFactor=((double) ui->frameLabel->getMouseCursorPos().x() - ((ui->frameLabel->width() - ui->frameLabel->pixmap()->width()) / 2)) / (double) ui->frameLabel->pixmap()->width();
-            double yScalingFactor=((double) ui->frameLabel->getMouseCursorPos().y() - ((ui->frameLabel->height() - ui->frameLabel->pixmap()->height()) / 2)) / (double) ui->frameLabel->pixmap()->height();
+            double xScalingFactor=((double) ui->frameLabel->getMouseCursorPos().x() - ((ui->frameLabel->width() - ui->frameLabel->image()->width()) / 2)) / (double) ui->frameLabel->image()->width();
+            double yScalingFactor=((double) ui->frameLabel->getMouseCursorPos().y() - ((ui->frameLabel->height() - ui->frameLabel->image()->height()) / 2)) / (double) ui->frameLabel->image()->height();
 
             ui->mouseCursorPosLabel->setText(ui->mouseCursorPosLabel->text()+
                                              QString(" [")+QString::number((int)(xScalingFactor*playerThread->getCurrentROI().width()))+
@@ -274,10 +277,10 @@ void VideoView::newMouseData(struct MouseData mouseData)
         // Selection box calculation depends on whether frame is scaled to fit label or not
         if(!ui->frameLabel->hasScaledContents())
         {
-            xScalingFactor=((double) mouseData.selectionBox.x() - ((ui->frameLabel->width() - ui->frameLabel->pixmap()->width()) / 2)) / (double) ui->frameLabel->pixmap()->width();
-            yScalingFactor=((double) mouseData.selectionBox.y() - ((ui->frameLabel->height() - ui->frameLabel->pixmap()->height()) / 2)) / (double) ui->frameLabel->pixmap()->height();
-            wScalingFactor=(double) playerThread->getCurrentROI().width() / (double) ui->frameLabel->pixmap()->width();
-            hScalingFactor=(double) playerThread->getCurrentROI().height() / (double) ui->frameLabel->pixmap()->height();
+            xScalingFactor=((double) mouseData.selectionBox.x() - ((ui->frameLabel->width() - ui->frameLabel->image()->width()) / 2)) / (double) ui->frameLabel->image()->width();
+            yScalingFactor=((double) mouseData.selectionBox.y() - ((ui->frameLabel->height() - ui->frameLabel->image()->height()) / 2)) / (double) ui->frameLabel->image()->height();
+            wScalingFactor=(double) playerThread->getCurrentROI().width() / (double) ui->frameLabel->image()->width();
+            hScalingFactor=(double) playerThread->getCurrentROI().height() / (double) ui->frameLabel->image()->height();
         }
         else
         {
@@ -337,13 +340,13 @@ void VideoView::updateMouseCursorPosLabelOriginalFrame()
                                      QString(")"));
 
     // Show pixel cursor position if camera is connected (image is being shown)
-    if(originalFrame->pixmap()!=0)
+    if(originalFrame->image()!=0)
     {
         // Scaling factor calculation depends on whether frame is scaled to fit label or not
         if(!originalFrame->hasScaledContents())
         {
-            double xScalingFactor=((double) originalFrame->getMouseCursorPos().x() - ((originalFrame->width() - originalFrame->pixmap()->width()) / 2)) / (double) originalFrame->pixmap()->width();
-            double yScalingFactor=((double) originalFrame->getMouseCursorPos().y() - ((originalFrame->height() - originalFrame->pixmap()->height()) / 2)) / (double) originalFrame->pixmap()->height();
+            double xScalingFactor=((double) originalFrame->getMouseCursorPos().x() - ((originalFrame->width() - originalFrame->image()->width()) / 2)) / (double) originalFrame->image()->width();
+            double yScalingFactor=((double) originalFrame->getMouseCursorPos().y() - ((originalFrame->height() - originalFrame->image()->height()) / 2)) / (double) originalFrame->image()->height();
 
             ui->mouseCursorPosLabel->setText(ui->mouseCursorPosLabel->text()+
                                              QString(" [")+QString::number((int)(xScalingFactor*playerThread->getCurrentROI().width()))+
@@ -380,10 +383,10 @@ void VideoView::newMouseDataOriginalFrame(struct MouseData mouseData)
         // Selection box calculation depends on whether frame is scaled to fit label or not
         if(!originalFrame->hasScaledContents())
         {
-            xScalingFactor=((double) mouseData.selectionBox.x() - ((originalFrame->width() - originalFrame->pixmap()->width()) / 2)) / (double) originalFrame->pixmap()->width();
-            yScalingFactor=((double) mouseData.selectionBox.y() - ((originalFrame->height() - originalFrame->pixmap()->height()) / 2)) / (double) originalFrame->pixmap()->height();
-            wScalingFactor=(double) playerThread->getCurrentROI().width() / (double) originalFrame->pixmap()->width();
-            hScalingFactor=(double) playerThread->getCurrentROI().height() / (double) originalFrame->pixmap()->height();
+            xScalingFactor=((double) mouseData.selectionBox.x() - ((originalFrame->width() - originalFrame->image()->width()) / 2)) / (double) originalFrame->image()->width();
+            yScalingFactor=((double) mouseData.selectionBox.y() - ((originalFrame->height() - originalFrame->image()->height()) / 2)) / (double) originalFrame->image()->height();
+            wScalingFactor=(double) playerThread->getCurrentROI().width() / (double) originalFrame->image()->width();
+            hScalingFactor=(double) playerThread->getCurrentROI().height() / (double) originalFrame->image()->height();
         }
         else
         {
@@ -445,6 +448,26 @@ void VideoView::handleContextMenuAction(QAction *action)
     }
     else if(action->text()=="Show Original Frame")
         handleOriginalWindow(action->isChecked());
+    else if(action->text()=="Save Profile as JSON...")
+        saveProfile(false);
+    else if(action->text()=="Save Profile as Chrome Trace...")
+        saveProfile(true);
+}
+
+// Write the profile of the magnification as JSON statistics or Chrome trace
+void VideoView::saveProfile(bool chromeTrace)
+{
+    QString fileName = QFileDialog::getSaveFileName(this,
+                                                    chromeTrace ? tr("Save Chrome Trace") : tr("Save Profile"),
+                                                    ".",
+                                                    tr("JSON File (*.json)"));
+    if(fileName.isEmpty())
+        return;
+    Profiler *profiler = playerThread->getProfiler();
+    QFile file(fileName);
+    const QByteArray json = chromeTrace ? profiler->toChromeTrace() : profiler->toJson();
+    if(!file.open(QIODevice::WriteOnly) || file.write(json) != json.size())
+        QMessageBox::warning(this->parentWidget(), tr("WARNING:"), tr("Not able to write ")+fileName);
 }
 
 void VideoView::handleOriginalWindow(bool doEmit)
@@ -29,12 +29,14 @@
 #include <QFileInfo>
 #include <QMessageBox>
 #include <QFileDialog>
+#include <QTimer>
 // Local
 #include "main/ui/MagnifyOptions.h"
 #include "main/other/Structures.h"
 #include "main/threads/PlayerThread.h"
 #include "main/ui/FrameLabel.h"
 #include "main/threads/SavingThread.h"
+#include "main/helper/MagnificationExecutor.h"
 namespace Ui {
     class VideoView;
 }
@@ -44,7 +46,7 @@ class VideoView : public QWidget
     Q_OBJECT
 
 public:
-    explicit VideoView(QWidget *parent, QString filepath);
+    explicit VideoView(QWidget *parent, QString filepath, MagnificationExecutor *executor);
     ~VideoView();
     bool loadVideo(int threadPrio, int width, int height, double fps);
     void setCodec(int codec);
@@ -52,6 +54,7 @@ public:
 
 private:
     Ui::VideoView *ui;
+    MagnificationExecutor *executor;
     QFileInfo file;
     QString filename;
     PlayerThread *playerThread;
@@ -61,7 +64,9 @@ private:
     void stopPlayerThread();
     QString getFormattedTime(int time);
     void handleOriginalWindow(bool doEmit);
+    void saveProfile(bool chromeTrace);
     FrameLabel *originalFrame;
+    QTimer *profilerTimer;
     SavingThread *vidSaver;
     int codec;
     bool useVideoCodec;
@@ -76,9 +81,8 @@ public slots:
     void updateProgressBar(int frame);
 
 private slots:
-    void updateFrame(const QImage &frame);
-    void updateOriginalFrame(const QImage &frame);
     void updatePlayerThreadStats(struct ThreadStatisticsData statData);
+    void updateProfilerSummary();
     void handleContextMenuAction(QAction *action);
     void play();
     void stop();
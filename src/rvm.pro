@@ -48,9 +48,6 @@ win32 {
     CV22_LIB =
 }
 
-greaterThan(QT_MAJOR_VERSION, 4): QT += widgets
-
-TARGET = rvm
 TEMPLATE = app
 
 DEFINES += APP_VERSION=\\\"1.0\\\"
@@ -64,58 +61,115 @@ INCLUDEPATH += $$PWD/main \
     $$PWD/external \
     $$PWD/external/qxtSlider
 
-SOURCES += main/main.cpp \
-    main/helper/MatToQImage.cpp \
-    main/helper/SharedImageBuffer.cpp \
+# Magnification and saving, shared by the GUI, the command-line tool and the benchmark
+SOURCES += \
+    main/helper/FramePool.cpp \
+    main/helper/MagnificationExecutor.cpp \
+    main/helper/ParallelLevels.cpp \
+    main/helper/Profiler.cpp \
     main/magnification/Magnificator.cpp \
     main/magnification/RieszPyramid.cpp \
     main/magnification/SpatialFilter.cpp \
     main/magnification/TemporalFilter.cpp \
-    main/threads/CaptureThread.cpp \
-    main/threads/PlayerThread.cpp \
-    main/threads/ProcessingThread.cpp \
-    main/threads/SavingThread.cpp \
-    main/ui/CameraConnectDialog.cpp \
-    main/ui/CameraView.cpp \
-    main/ui/FrameLabel.cpp \
-    main/ui/MagnifyOptions.cpp \
-    main/ui/MainWindow.cpp \
-    main/ui/VideoView.cpp \
-    external/qxtSlider/qxtglobal.cpp \
-    external/qxtSlider/qxtspanslider.cpp
+    main/threads/SavingThread.cpp
 
 HEADERS += \
     main/helper/ComplexMat.h \
-    main/helper/MatToQImage.h \
-    main/helper/SharedImageBuffer.h \
+    main/helper/FastMath.h \
+    main/helper/FramePool.h \
+    main/helper/MagnificationExecutor.h \
+    main/helper/ParallelLevels.h \
+    main/helper/Profiler.h \
     main/magnification/Magnificator.h \
     main/magnification/RieszPyramid.h \
     main/magnification/SpatialFilter.h \
     main/magnification/TemporalFilter.h \
-    main/threads/CaptureThread.h \
-    main/threads/PlayerThread.h \
-    main/threads/ProcessingThread.h \
     main/threads/SavingThread.h \
-    main/ui/CameraConnectDialog.h \
-    main/ui/CameraView.h \
-    main/ui/FrameLabel.h \
-    main/ui/MagnifyOptions.h \
-    main/ui/MainWindow.h \
-    main/ui/VideoView.h \
     main/other/Buffer.h \
     main/other/Config.h \
-    main/other/Structures.h \
-    external/qxtSlider/qxtglobal.h \
-    external/qxtSlider/qxtnamespace.h \
-    external/qxtSlider/qxtspanslider.h \
-    external/qxtSlider/qxtspanslider_p.h
-
-FORMS += \
-    main/ui/MainWindow.ui \
-    main/ui/CameraView.ui \
-    main/ui/CameraConnectDialog.ui \
-    main/ui/MagnifyOptions.ui \
-    main/ui/VideoView.ui
+    main/other/Structures.h
+
+CONFIG(cli) {
+    # Headless batch magnifier without widgets, build with: qmake CONFIG+=cli
+    QT -= gui
+    CONFIG += console
+    CONFIG -= app_bundle
+
+    TARGET = rvm-cli
+
+    SOURCES += main/cli.cpp
+} else:CONFIG(bench) {
+    # Benchmark of the magnification, build with: qmake CONFIG+=bench
+    QT -= gui
+    CONFIG += console
+    CONFIG -= app_bundle
+
+    TARGET = rvm-bench
+
+    SOURCES += main/bench.cpp \
+        main/helper/AllocationCounter.cpp
+    HEADERS += main/helper/AllocationCounter.h
+    # Peak working set
+    win32: LIBS += -lpsapi
+} else:CONFIG(test) {
+    # Checks of the magnification, build with: qmake CONFIG+=test
+    QT -= gui
+    CONFIG += console
+    CONFIG -= app_bundle
+
+    TARGET = rvm-test
+
+    SOURCES += main/test.cpp \
+        main/helper/AllocationCounter.cpp
+    HEADERS += main/helper/AllocationCounter.h
+} else {
+    greaterThan(QT_MAJOR_VERSION, 4): QT += widgets
+
+    TARGET = rvm
+
+    SOURCES += main/main.cpp \
+        main/helper/DisplayMailbox.cpp \
+        main/helper/MatToQImage.cpp \
+        main/helper/SharedImageBuffer.cpp \
+        main/threads/CaptureThread.cpp \
+        main/threads/EncoderThread.cpp \
+        main/threads/PlayerThread.cpp \
+        main/threads/ProcessingThread.cpp \
+        main/ui/CameraConnectDialog.cpp \
+        main/ui/CameraView.cpp \
+        main/ui/FrameLabel.cpp \
+        main/ui/MagnifyOptions.cpp \
+        main/ui/MainWindow.cpp \
+        main/ui/VideoView.cpp \
+        external/qxtSlider/qxtglobal.cpp \
+        external/qxtSlider/qxtspanslider.cpp
+
+    HEADERS += \
+        main/helper/DisplayMailbox.h \
+        main/helper/MatToQImage.h \
+        main/helper/SharedImageBuffer.h \
+        main/threads/CaptureThread.h \
+        main/threads/EncoderThread.h \
+        main/threads/PlayerThread.h \
+        main/threads/ProcessingThread.h \
+        main/ui/CameraConnectDialog.h \
+        main/ui/CameraView.h \
+        main/ui/FrameLabel.h \
+        main/ui/MagnifyOptions.h \
+        main/ui/MainWindow.h \
+        main/ui/VideoView.h \
+        external/qxtSlider/qxtglobal.h \
+        external/qxtSlider/qxtnamespace.h \
+        external/qxtSlider/qxtspanslider.h \
+        external/qxtSlider/qxtspanslider_p.h
+
+    FORMS += \
+        main/ui/MainWindow.ui \
+        main/ui/CameraView.ui \
+        main/ui/CameraConnectDialog.ui \
+        main/ui/MagnifyOptions.ui \
+        main/ui/VideoView.ui
+}
 
 # Spare me those nasty C++ compiler warnings and pray instead
 QMAKE_CXXFLAGS += -W2